@@ -0,0 +1,241 @@
+//===- ImageBenchmarks.cpp - Image Benchmarks -------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Image/Color.h"
+#include "Image/Image.h"
+#include "Image/ImageComparators.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+
+#include "benchmark/benchmark.h"
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace offloadtest;
+
+namespace {
+// Square test image with a color gradient, so neighbouring pixels differ the
+// way they do in rendered output. Offset shifts the gradient, giving a second
+// image that is slightly different from the first.
+class TestImage {
+  std::string Data;
+  ImageRef Ref;
+
+  template <typename T> void fill(uint32_t Size, uint8_t Channels, T Offset) {
+    Data.resize(static_cast<size_t>(Size) * Size * Channels * sizeof(T));
+    T *Ptr = reinterpret_cast<T *>(Data.data());
+    for (uint32_t Y = 0; Y < Size; ++Y) {
+      for (uint32_t X = 0; X < Size; ++X) {
+        double Values[] = {static_cast<double>(X) / Size,
+                           static_cast<double>(Y) / Size,
+                           static_cast<double>((X + Y) % Size) / Size, 1.0};
+        for (uint8_t C = 0; C < Channels; ++C) {
+          double V = Values[C];
+          if constexpr (std::is_floating_point_v<T>)
+            *Ptr++ = std::min(static_cast<T>(V) + Offset, static_cast<T>(1));
+          else
+            *Ptr++ = ColorUtils::convertColor<T>(V) | Offset;
+        }
+      }
+    }
+  }
+
+public:
+  TestImage(uint32_t Size, uint8_t Depth, uint8_t Channels, bool Float,
+            uint8_t Offset = 0) {
+    switch (Depth) {
+    case 1:
+      fill<uint8_t>(Size, Channels, Offset);
+      break;
+    case 2:
+      fill<uint16_t>(Size, Channels, Offset);
+      break;
+    case 4:
+      if (Float)
+        fill<float>(Size, Channels, Offset / 255.0f);
+      else
+        fill<uint32_t>(Size, Channels, Offset);
+      break;
+    }
+    Ref = ImageRef(Size, Size, Depth, Channels, Float, Data);
+  }
+
+  ImageRef get() const { return Ref; }
+};
+} // namespace
+
+static void setPixelsProcessed(benchmark::State &State) {
+  State.SetItemsProcessed(State.iterations() * State.range(0) *
+                          State.range(0));
+}
+
+// Translates an 8-bit RGBA image into the 32-bit float RGB format images are
+// compared in.
+static void BM_TranslateImageToFloat(benchmark::State &State) {
+  TestImage Src(State.range(0), 1, 4, false);
+  for (auto _ : State) {
+    Image Dst = Image::translateImage(Src.get(), 4, 3, true);
+    benchmark::DoNotOptimize(Dst.data());
+  }
+  setPixelsProcessed(State);
+}
+BENCHMARK(BM_TranslateImageToFloat)->RangeMultiplier(4)->Range(64, 1024);
+
+// Translates a 32-bit float RGBA image, as read back from a render target,
+// into 16-bit RGBA.
+static void BM_TranslateImageFromFloat(benchmark::State &State) {
+  TestImage Src(State.range(0), 4, 4, true);
+  for (auto _ : State) {
+    Image Dst = Image::translateImage(Src.get(), 2, 4, false);
+    benchmark::DoNotOptimize(Dst.data());
+  }
+  setPixelsProcessed(State);
+}
+BENCHMARK(BM_TranslateImageFromFloat)->RangeMultiplier(4)->Range(64, 1024);
+
+// Measured in real time, as compareImages spreads the pixels across threads.
+static void BM_CompareImagesDistance(benchmark::State &State) {
+  TestImage LHS(State.range(0), 1, 4, false);
+  TestImage RHS(State.range(0), 1, 4, false, 3);
+  for (auto _ : State) {
+    llvm::SmallVector<ImageComparatorRef> Cmps;
+    Cmps.push_back(make_comparator<ImageComparatorDistance>());
+    if (llvm::Error Err = Image::compareImages(LHS.get(), RHS.get(), Cmps)) {
+      State.SkipWithError(llvm::toString(std::move(Err)).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(Cmps[0].result());
+  }
+  setPixelsProcessed(State);
+}
+BENCHMARK(BM_CompareImagesDistance)
+    ->RangeMultiplier(4)
+    ->Range(64, 1024)
+    ->UseRealTime();
+
+// Compares an image to an identical copy, as when a test passes.
+static void BM_CompareImagesIdentical(benchmark::State &State) {
+  TestImage LHS(State.range(0), 1, 4, false);
+  TestImage RHS(State.range(0), 1, 4, false);
+  for (auto _ : State) {
+    llvm::SmallVector<ImageComparatorRef> Cmps;
+    Cmps.push_back(make_comparator<ImageComparatorDistance>());
+    if (llvm::Error Err = Image::compareImages(LHS.get(), RHS.get(), Cmps)) {
+      State.SkipWithError(llvm::toString(std::move(Err)).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(Cmps[0].result());
+  }
+  setPixelsProcessed(State);
+}
+BENCHMARK(BM_CompareImagesIdentical)
+    ->RangeMultiplier(4)
+    ->Range(64, 4096)
+    ->UseRealTime();
+
+static void BM_CIE75Distance(benchmark::State &State) {
+  constexpr int Count = 4096;
+  llvm::SmallVector<Color> Colors;
+  for (int I = 0; I < Count + 1; ++I)
+    Colors.push_back(Color((I % 17) / 16.0, (I % 29) / 28.0, (I % 61) / 60.0));
+  for (auto _ : State) {
+    for (int I = 0; I < Count; ++I)
+      benchmark::DoNotOptimize(
+          Color::CIE75Distance(Colors[I], Colors[I + 1]));
+  }
+  State.SetItemsProcessed(State.iterations() * Count);
+}
+BENCHMARK(BM_CIE75Distance);
+
+// The same distances as BM_CIE75Distance, computed with the batch function.
+static void BM_CIE75Distances(benchmark::State &State) {
+  constexpr int Count = 4096;
+  std::vector<float> LHS[3], RHS[3];
+  for (int I = 0; I < Count + 1; ++I) {
+    float Values[] = {(I % 17) / 16.0f, (I % 29) / 28.0f, (I % 61) / 60.0f};
+    for (int C = 0; C < 3; ++C) {
+      if (I < Count)
+        LHS[C].push_back(Values[C]);
+      if (I > 0)
+        RHS[C].push_back(Values[C]);
+    }
+  }
+  const float *const L[] = {LHS[0].data(), LHS[1].data(), LHS[2].data()};
+  const float *const R[] = {RHS[0].data(), RHS[1].data(), RHS[2].data()};
+  std::vector<float> Distances(Count);
+  for (auto _ : State) {
+    Color::CIE75Distances(L, R, Distances.data(), Count);
+    benchmark::DoNotOptimize(Distances.data());
+  }
+  State.SetItemsProcessed(State.iterations() * Count);
+}
+BENCHMARK(BM_CIE75Distances);
+
+static void runWritePNG(benchmark::State &State, const TestImage &Src) {
+  llvm::SmallString<128> Path;
+  if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+          "offloadtest-bench", "png", Path)) {
+    State.SkipWithError(EC.message().c_str());
+    return;
+  }
+  for (auto _ : State) {
+    if (llvm::Error Err = Image::writePNG(Src.get(), Path)) {
+      State.SkipWithError(llvm::toString(std::move(Err)).c_str());
+      break;
+    }
+  }
+  llvm::sys::fs::remove(Path);
+  setPixelsProcessed(State);
+}
+
+static void BM_WritePNG(benchmark::State &State) {
+  runWritePNG(State, TestImage(State.range(0), 1, 4, false));
+}
+BENCHMARK(BM_WritePNG)->RangeMultiplier(4)->Range(64, 1024);
+
+// Float images are converted to 16 bits as they are written.
+static void BM_WritePNGFloat(benchmark::State &State) {
+  runWritePNG(State, TestImage(State.range(0), 4, 4, true));
+}
+BENCHMARK(BM_WritePNGFloat)->RangeMultiplier(4)->Range(64, 1024);
+
+static void BM_LoadPNG(benchmark::State &State) {
+  TestImage Src(State.range(0), 1, 4, false);
+  llvm::SmallString<128> Path;
+  if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+          "offloadtest-bench", "png", Path)) {
+    State.SkipWithError(EC.message().c_str());
+    return;
+  }
+  if (llvm::Error Err = Image::writePNG(Src.get(), Path)) {
+    State.SkipWithError(llvm::toString(std::move(Err)).c_str());
+    llvm::sys::fs::remove(Path);
+    return;
+  }
+  for (auto _ : State) {
+    llvm::Expected<Image> Loaded = Image::loadPNG(Path);
+    if (!Loaded) {
+      State.SkipWithError(llvm::toString(Loaded.takeError()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(Loaded->data());
+  }
+  llvm::sys::fs::remove(Path);
+  setPixelsProcessed(State);
+}
+BENCHMARK(BM_LoadPNG)->RangeMultiplier(4)->Range(64, 1024);
+
+BENCHMARK_MAIN();
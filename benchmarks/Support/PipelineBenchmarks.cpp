@@ -0,0 +1,125 @@
+//===- PipelineBenchmarks.cpp - Pipeline Description Benchmarks -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "benchmark/benchmark.h"
+
+#include <string>
+
+using namespace offloadtest;
+
+namespace {
+struct FormatInfo {
+  DataFormat Format;
+  const char *Name;
+  bool IsHex;
+  bool IsSigned;
+  bool IsFloat;
+};
+} // namespace
+
+static const FormatInfo Formats[] = {
+    {DataFormat::Hex8, "Hex8", true, false, false},
+    {DataFormat::Hex16, "Hex16", true, false, false},
+    {DataFormat::Hex32, "Hex32", true, false, false},
+    {DataFormat::Hex64, "Hex64", true, false, false},
+    {DataFormat::UInt16, "UInt16", false, false, false},
+    {DataFormat::UInt32, "UInt32", false, false, false},
+    {DataFormat::UInt64, "UInt64", false, false, false},
+    {DataFormat::Int16, "Int16", false, true, false},
+    {DataFormat::Int32, "Int32", false, true, false},
+    {DataFormat::Int64, "Int64", false, true, false},
+    {DataFormat::Float32, "Float32", false, true, true},
+    {DataFormat::Float64, "Float64", false, true, true},
+};
+
+// Returns the YAML of a read-write resource with Count elements of format F.
+static std::string getResourceYAML(const FormatInfo &F, int64_t Count) {
+  std::string YAML;
+  llvm::raw_string_ostream OS(YAML);
+  OS << "Access: ReadWrite\nFormat: " << F.Name << "\nData: [ ";
+  for (int64_t I = 0; I < Count; ++I) {
+    if (I)
+      OS << ", ";
+    // Values fit in every format, including Hex8.
+    int64_t V = I % 251;
+    if (F.IsHex)
+      OS << llvm::format_hex(V, 4);
+    else if (F.IsFloat)
+      OS << (V - 125) * 0.25;
+    else
+      OS << (F.IsSigned ? V - 125 : V);
+  }
+  OS << " ]\nDirectXBinding:\n  Register: 0\n  Space: 0\n";
+  return YAML;
+}
+
+static void BM_ParseResource(benchmark::State &State, const FormatInfo &F) {
+  std::string YAML = getResourceYAML(F, State.range(0));
+  for (auto _ : State) {
+    Resource R;
+    llvm::yaml::Input YIn(YAML);
+    YIn >> R;
+    if (YIn.error()) {
+      State.SkipWithError("Failed to parse the resource");
+      break;
+    }
+    benchmark::DoNotOptimize(R.Data.data());
+  }
+  State.SetItemsProcessed(State.iterations() * State.range(0));
+  State.SetBytesProcessed(State.iterations() * YAML.size());
+}
+
+static void BM_EmitResource(benchmark::State &State, const FormatInfo &F) {
+  std::string YAML = getResourceYAML(F, State.range(0));
+  Resource R;
+  llvm::yaml::Input YIn(YAML);
+  YIn >> R;
+  if (YIn.error()) {
+    State.SkipWithError("Failed to parse the resource");
+    return;
+  }
+  for (auto _ : State) {
+    std::string Out;
+    llvm::raw_string_ostream OS(Out);
+    llvm::yaml::Output YOut(OS);
+    YOut << R;
+    benchmark::DoNotOptimize(Out.data());
+  }
+  State.SetItemsProcessed(State.iterations() * State.range(0));
+}
+
+int main(int ArgC, char **ArgV) {
+  for (const FormatInfo &F : Formats) {
+    benchmark::RegisterBenchmark(
+        (std::string("BM_ParseResource/") + F.Name).c_str(), BM_ParseResource,
+        F)
+        ->RangeMultiplier(16)
+        ->Range(16, 16384);
+    benchmark::RegisterBenchmark(
+        (std::string("BM_EmitResource/") + F.Name).c_str(), BM_EmitResource,
+        F)
+        ->RangeMultiplier(16)
+        ->Range(16, 16384);
+  }
+  benchmark::Initialize(&ArgC, ArgV);
+  if (benchmark::ReportUnrecognizedArguments(ArgC, ArgV))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -16,6 +16,7 @@
 #include "API/Capabilities.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator_range.h"
+#include "llvm/Support/Error.h"
 
 #include <memory>
 #include <string>
@@ -28,23 +29,59 @@ namespace offloadtest {
 
 struct Pipeline;
 
+struct ExecutionTimes {
+  // Time between the start and the end of the dispatch as measured on the GPU,
+  // in milliseconds. Negative if the device could not measure it.
+  double GPUMilliseconds = -1.0;
+  // Time the execution spent waiting for other executions on the device's
+  // own locks, in milliseconds.
+  double WaitMilliseconds = 0.0;
+
+  bool hasGPUTime() const { return GPUMilliseconds >= 0.0; }
+};
+
 class Device {
 protected:
   std::string Description;
+  // Identifies the driver build, so results recorded on one driver aren't
+  // reused on another.
+  std::string DriverVersion;
+
+  // Returns the key backends cache compiled pipelines under: a hash of the
+  // program and of the pipeline layout.
+  static uint64_t getPipelineKey(llvm::StringRef Program, const Pipeline &P);
+
+  // The stream backends report the steps of an execution on.
+  static llvm::raw_ostream &progress();
 
 public:
   virtual const Capabilities &getCapabilities() = 0;
   virtual llvm::StringRef getAPIName() const = 0;
   virtual GPUAPI getAPI() const = 0;
-  virtual llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P) = 0;
+  // Devices keep the objects compiled for a program and pipeline layout, so
+  // running the same program again only pays for the resources and dispatch.
+  virtual llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P,
+                                     ExecutionTimes &Times) = 0;
+  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P) {
+    ExecutionTimes Times;
+    return executeProgram(Program, P, Times);
+  }
+  // Devices that support it may execute programs from several threads at
+  // once, otherwise executions must not overlap.
+  virtual bool supportsConcurrentExecution() const { return false; }
   virtual void printExtra(llvm::raw_ostream &OS) {}
 
   virtual ~Device() = 0;
 
   llvm::StringRef getDescription() const { return Description; }
+  llvm::StringRef getDriverVersion() const { return DriverVersion; }
 
   static void registerDevice(std::shared_ptr<Device> D);
   static llvm::Error initialize();
+  // Turns the progress messages printed while executing on or off. Tools
+  // executing from several threads turn them off, as the messages of
+  // different executions would interleave.
+  static void setShowProgress(bool Show);
 
   using DeviceArray = llvm::SmallVector<std::shared_ptr<Device>>;
   using DeviceIterator = DeviceArray::iterator;
@@ -53,6 +90,11 @@ public:
   static DeviceIterator begin();
   static DeviceIterator end();
   static inline DeviceRange devices() { return DeviceRange(begin(), end()); }
+
+  // Returns a device of the API named API, preferably the one described by
+  // Description, or null if there is none. With Warp, only WARP is chosen.
+  static Device *findDevice(llvm::StringRef API, llvm::StringRef Description,
+                            bool Warp);
 };
 
 } // namespace offloadtest
@@ -0,0 +1,64 @@
+//===- Compiler.h - In-Process HLSL Compilation -----------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Compiles HLSL source with the clang libraries of the LLVM tree this project
+// is built in, without starting a compiler process. Arguments are those of
+// clang-dxc, so the same flags produce the same DXIL or SPIR-V.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_COMPILER_COMPILER_H
+#define OFFLOADTEST_COMPILER_COMPILER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace offloadtest {
+
+class ShaderCompiler {
+  std::string ClangPath;
+  llvm::raw_ostream &DiagOS;
+  // Compiled shaders by a hash of the source and arguments, kept for the
+  // lifetime of the compiler.
+  llvm::DenseMap<uint64_t, std::unique_ptr<llvm::MemoryBuffer>> Cache;
+
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+  compileUncached(llvm::StringRef Path, llvm::ArrayRef<std::string> Args);
+
+public:
+  // ClangPath is where a clang executable would be, which locates clang's
+  // resource directory and the HLSL headers in it. Diagnostics are printed to
+  // DiagOS.
+  ShaderCompiler(std::string ClangPath, llvm::raw_ostream &DiagOS);
+
+  // Returns the path of the clang executable installed next to the tool at
+  // ToolPath.
+  static std::string getClangPathForTool(llvm::StringRef ToolPath);
+
+  // Compiles the HLSL file at Path with the clang-dxc arguments Args, such as
+  // {"-T", "cs_6_0", "-E", "main"}. The compiler is run in-process and only
+  // steps clang runs as separate tools, such as validation with dxv, start a
+  // process. Compiling the same source with the same arguments again returns
+  // the earlier result.
+  llvm::Expected<llvm::StringRef> compile(llvm::StringRef Path,
+                                          llvm::ArrayRef<std::string> Args);
+};
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_COMPILER_COMPILER_H
@@ -14,9 +14,13 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <math.h>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 namespace offloadtest {
 
@@ -46,6 +50,21 @@ template <typename NewTy, typename OldTy> NewTy convertColor(OldTy Val) {
     return toInt<NewTy>(Dbl);
   return static_cast<NewTy>(Dbl);
 }
+
+// Returns a table holding convertColor<float>(V) at index V for every value
+// of the 8- or 16-bit type T, which saves converting through double. Built on
+// first use and shared afterwards.
+template <typename T> const float *getFloatTable() {
+  static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>,
+                "Tables are only built for 8- and 16-bit values");
+  static const std::vector<float> Table = [] {
+    std::vector<float> Values(size_t(std::numeric_limits<T>::max()) + 1);
+    for (size_t I = 0; I < Values.size(); ++I)
+      Values[I] = convertColor<float>(static_cast<T>(I));
+    return Values;
+  }();
+  return Table.data();
+}
 } // namespace ColorUtils
 
 enum class ColorSpace { RGB, XYZ, LAB };
@@ -105,6 +124,30 @@ public:
     return sqrt((Res.R * Res.R) + (Res.G * Res.G) + (Res.B * Res.B));
   }
 
+  // Maximum difference between the batch functions below and the scalar path
+  // (translateSpace and CIE75Distance), in L*a*b* units, for RGB inputs in
+  // [0, 1]. It is far below VisibleDiff of the distance comparator.
+  static constexpr double BatchTolerance = 1e-3;
+
+  // Converts Count RGB pixels to L*a*b*. Rows are planar: RGB[0] points to
+  // the red values, RGB[1] to the green and RGB[2] to the blue, and likewise
+  // for LAB. Single precision with an approximated cube root; see
+  // BatchTolerance.
+  static void translateRGBToLAB(const float *const RGB[3], float *const LAB[3],
+                                size_t Count);
+
+  // Writes the CIE76 distance between pixel I of the planar RGB rows LHS and
+  // RHS to Distances[I], for I < Count.
+  static void CIE75Distances(const float *const LHS[3],
+                             const float *const RHS[3], float *Distances,
+                             size_t Count);
+
+  // CIE75Distances with the LHS pixels already converted by
+  // translateRGBToLAB.
+  static void CIE75DistancesFromLAB(const float *const LHSLAB[3],
+                                    const float *const RHS[3],
+                                    float *Distances, size_t Count);
+
 private:
   Color translateSpaceImpl(ColorSpace NewCS);
 };
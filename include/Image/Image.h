@@ -21,7 +21,9 @@
 #include "llvm/Support/Error.h"
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 
 namespace llvm {
 class raw_ostream;
@@ -32,6 +34,41 @@ class ImageComparatorBase {
 public:
   virtual ~ImageComparatorBase() {}
   virtual void processPixel(Color L, Color R) = 0;
+  // Processes Count consecutive pixels of a row. The pixels are float RGB
+  // stored planar: L[0] points to the red values of the expected image, L[1]
+  // to the green and L[2] to the blue, and likewise R for the actual image.
+  // The default calls processPixel for each pixel; comparators override it
+  // to work on the whole span at once.
+  virtual void processSpan(const float *const L[3], const float *const R[3],
+                           size_t Count) {
+    for (size_t I = 0; I < Count; ++I)
+      processPixel(Color(L[0][I], L[1][I], L[2][I]),
+                   Color(R[0][I], R[1][I], R[2][I]));
+  }
+  // processSpan with the expected pixels also given converted to L*a*b* by
+  // Color::translateRGBToLAB, planar in LLAB. Comparators that work in
+  // L*a*b* override it to skip converting them again.
+  virtual void processSpanLAB(const float *const L[3],
+                              const float *const LLAB[3],
+                              const float *const R[3], size_t Count) {
+    processSpan(L, R, Count);
+  }
+  // Processes Count consecutive pixels that are byte-identical in both
+  // images, without their values. Returns false if the comparator needs the
+  // values, in which case they are passed to processSpan instead.
+  virtual bool processIdentical(size_t Count) { return false; }
+  // Called when the next pixel processed is the first of row Row.
+  // compareImages calls it at the start of each tile of rows.
+  virtual void setRow(uint32_t Row) {}
+  // Returns a comparator with no pixels processed, which compareImages gives
+  // a tile of rows on another thread and then merges into this one. Return
+  // null to see every pixel in order on one thread.
+  virtual std::unique_ptr<ImageComparatorBase> clone() const {
+    return nullptr;
+  }
+  // Adds the pixels Other, a clone of this comparator, processed, as if this
+  // comparator processed them after its own.
+  virtual void merge(ImageComparatorBase &Other) {}
   virtual void print(llvm::raw_ostream &OS) {}
   virtual bool result() { return true; }
 };
@@ -45,6 +82,21 @@ public:
       : Comp(std::move(C)) {}
   ImageComparatorRef(ImageComparatorRef &&) = default;
   void processPixel(Color L, Color R) { Comp->processPixel(L, R); }
+  void processSpan(const float *const L[3], const float *const R[3],
+                   size_t Count) {
+    Comp->processSpan(L, R, Count);
+  }
+  void processSpanLAB(const float *const L[3], const float *const LLAB[3],
+                      const float *const R[3], size_t Count) {
+    Comp->processSpanLAB(L, LLAB, R, Count);
+  }
+  bool processIdentical(size_t Count) { return Comp->processIdentical(Count); }
+  void setRow(uint32_t Row) { Comp->setRow(Row); }
+
+  // Returns an empty ImageComparatorRef if the comparator can't be cloned.
+  ImageComparatorRef clone() const { return ImageComparatorRef(Comp->clone()); }
+  void merge(ImageComparatorRef &Other) { Comp->merge(*Other.Comp); }
+  explicit operator bool() const { return Comp != nullptr; }
 
   void print(llvm::raw_ostream &OS) { Comp->print(OS); };
 
@@ -90,7 +142,7 @@ public:
                  R.getSingleElementSize(), R.Channels,
                  R.Format == DataFormat::Float32 ||
                      R.Format == DataFormat::Float64,
-                 llvm::StringRef(R.Data.get(), R.Size)) {}
+                 llvm::StringRef(R.Data.data(), R.Size)) {}
 
   uint32_t getHeight() const { return Height; }
   uint32_t getWidth() const { return Width; }
@@ -107,11 +159,12 @@ public:
 class Image : public ImageRef {
   std::unique_ptr<char[]> OwnedData;
 
+  // The pixels are left uninitialized, as every user writes all of them.
   Image(uint32_t H, uint32_t W, uint8_t D, uint8_t C, bool F)
       : ImageRef(H, W, D, C, F) {
     uint64_t Sz = static_cast<uint64_t>(H) * static_cast<uint64_t>(W) *
                   static_cast<uint64_t>(D) * static_cast<uint64_t>(C);
-    OwnedData = std::make_unique<char[]>(Sz);
+    OwnedData.reset(new char[Sz]);
     Data = llvm::StringRef(OwnedData.get(), Sz);
   }
 
@@ -143,9 +196,17 @@ public:
                               bool Float);
   static llvm::Expected<Image> loadPNG(llvm::StringRef Path);
 
+  // Converts Count pixels of Img, starting at Src, to float RGB, writing
+  // channel C to Out[C].
+  static void loadPlanar(ImageRef Img, const char *Src, size_t Count,
+                         float *const Out[3]);
+
+  // LHSLAB optionally holds the pixels of LHS already converted to L*a*b*,
+  // as three planes of Height * Width values, as a CachedImage provides.
   static llvm::Error
   compareImages(ImageRef LHS, ImageRef RHS,
-                llvm::MutableArrayRef<ImageComparatorRef> Comparators);
+                llvm::MutableArrayRef<ImageComparatorRef> Comparators,
+                const float *const LHSLAB[3] = nullptr);
 
   char *data() { return OwnedData.get(); }
 };
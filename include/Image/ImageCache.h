@@ -0,0 +1,69 @@
+//===- ImageCache.h - Converted Golden Image Cache --------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A directory of PNG images that were already decoded and converted to
+// L*a*b*, keyed by a hash of the PNG file's contents. Golden images never
+// change between runs, so after the first comparison against one, later ones
+// map the decoded pixels and L*a*b* values from the cache instead of
+// decoding and converting the PNG again.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_IMAGE_IMAGECACHE_H
+#define OFFLOADTEST_IMAGE_IMAGECACHE_H
+
+#include "Image/Image.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace offloadtest {
+
+class CachedImage {
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  ImageRef Img;
+  const float *LAB[3] = {nullptr, nullptr, nullptr};
+  bool Hit = false;
+
+  CachedImage() = default;
+
+  static bool parse(llvm::MemoryBufferRef Entry, uint64_t Hash,
+                    CachedImage &Result);
+
+public:
+  CachedImage(CachedImage &&) = default;
+  CachedImage &operator=(CachedImage &&) = default;
+
+  // The decoded pixels, as Image::loadPNG returns them.
+  ImageRef getImage() const { return Img; }
+  // The pixels converted by Color::translateRGBToLAB, as three planes of
+  // Height * Width values to pass to Image::compareImages.
+  const float *const *getLAB() const { return LAB; }
+  // Returns true if the image was read from the cache rather than decoded.
+  bool wasCached() const { return Hit; }
+
+  // Returns the path of the cache entry in Dir for a PNG file with the
+  // contents PNGData.
+  static std::string getCachePath(llvm::StringRef Dir,
+                                  llvm::StringRef PNGData);
+
+  // Loads the PNG image at PNGPath through the cache in CacheDir. Missing,
+  // corrupt and stale entries are rebuilt from the PNG; failing to store the
+  // entry isn't an error, as the image was still loaded.
+  static llvm::Expected<CachedImage> load(llvm::StringRef PNGPath,
+                                          llvm::StringRef CacheDir);
+};
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_IMAGE_IMAGECACHE_H
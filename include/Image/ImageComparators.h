@@ -12,10 +12,13 @@
 #include "Image/Color.h"
 #include "Image/Image.h"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
+#include <cmath>
+#include <memory>
 
 #ifndef OFFLOADTEST_IMAGE_IMAGECOMPARATOR_H
 #define OFFLOADTEST_IMAGE_IMAGECOMPARATOR_H
@@ -47,18 +50,15 @@ class ImageComparatorDistance : public ImageComparatorBase {
 
   llvm::SmallString<256> ErrStr;
 
+  // Distances of the span being processed.
+  llvm::SmallVector<float> Distances;
+
   // 2.3 corresponds to a "just noticeable distance" for the CIE76
   // difference algorithm. If no pixels are worse than that, there should be
   // no noticeable difference in the image.
   static constexpr double VisibleDiff = 2.3;
 
-public:
-  ImageComparatorDistance() {
-    Checks.push_back(CompareCheck{CompareCheck::Furthest, VisibleDiff});
-  }
-  ImageComparatorDistance(llvm::ArrayRef<CompareCheck> C) : Checks(C) {}
-  void processPixel(Color L, Color R) override {
-    double Distance = Color::CIE75Distance(L, R);
+  void addDistance(double Distance) {
     if (Distance > VisibleDiff) {
       VisibleDiffs += 1;
       DiffRMS += Distance;
@@ -73,6 +73,54 @@ public:
     Count += 1;
   }
 
+public:
+  ImageComparatorDistance() {
+    Checks.push_back(CompareCheck{CompareCheck::Furthest, VisibleDiff});
+  }
+  ImageComparatorDistance(llvm::ArrayRef<CompareCheck> C) : Checks(C) {}
+  void processPixel(Color L, Color R) override {
+    addDistance(Color::CIE75Distance(L, R));
+  }
+
+  // Uses the batch distance function, so the distances are single precision,
+  // within Color::BatchTolerance of processPixel's.
+  void processSpan(const float *const L[3], const float *const R[3],
+                   size_t Pixels) override {
+    Distances.resize(Pixels);
+    Color::CIE75Distances(L, R, Distances.data(), Pixels);
+    for (float Distance : Distances)
+      addDistance(Distance);
+  }
+
+  void processSpanLAB(const float *const L[3], const float *const LLAB[3],
+                      const float *const R[3], size_t Pixels) override {
+    Distances.resize(Pixels);
+    Color::CIE75DistancesFromLAB(LLAB, R, Distances.data(), Pixels);
+    for (float Distance : Distances)
+      addDistance(Distance);
+  }
+
+  // Identical pixels have a distance of 0, which only adds to the count.
+  bool processIdentical(size_t Pixels) override {
+    Count += Pixels;
+    return true;
+  }
+
+  std::unique_ptr<ImageComparatorBase> clone() const override {
+    return std::make_unique<ImageComparatorDistance>(Checks);
+  }
+
+  void merge(ImageComparatorBase &Other) override {
+    auto &O = static_cast<ImageComparatorDistance &>(Other);
+    Furthest = std::max(Furthest, O.Furthest);
+    RMS += O.RMS;
+    DiffRMS += O.DiffRMS;
+    Count += O.Count;
+    VisibleDiffs += O.VisibleDiffs;
+    for (int I = 0; I < 10; ++I)
+      Histogram[I] += O.Histogram[I];
+  }
+
   void print(llvm::raw_ostream &OS) override {
     double CountDbl = static_cast<double>(Count);
     OS << "RMS Difference: " << RMS << "\n";
@@ -107,15 +155,25 @@ public:
 };
 
 class ImageComparatorDiffImage : public ImageComparatorBase {
-  Image DiffImg;
+  // Shared with the clones, which write disjoint rows of it.
+  std::shared_ptr<Image> DiffImg;
   float *DiffPtr;
   llvm::StringRef OutputFilename;
 
 public:
   virtual ~ImageComparatorDiffImage() {}
   ImageComparatorDiffImage(uint32_t Height, uint32_t Width, llvm::StringRef OF)
-      : DiffImg(Height, Width, 4, 3, true), OutputFilename(OF) {
-    DiffPtr = reinterpret_cast<float *>(DiffImg.data());
+      : DiffImg(new Image(Height, Width, 4, 3, true)), OutputFilename(OF) {
+    DiffPtr = reinterpret_cast<float *>(DiffImg->data());
+  }
+
+  void setRow(uint32_t Row) override {
+    DiffPtr = reinterpret_cast<float *>(DiffImg->data()) +
+              static_cast<uint64_t>(Row) * DiffImg->getWidth() * 3;
+  }
+
+  std::unique_ptr<ImageComparatorBase> clone() const override {
+    return std::make_unique<ImageComparatorDiffImage>(*this);
   }
   void processPixel(Color L, Color R) override {
     // TODO: I should probably instead use a color distance for this too...
@@ -125,8 +183,21 @@ public:
     DiffPtr += 3;
   }
 
+  void processSpan(const float *const L[3], const float *const R[3],
+                   size_t Count) override {
+    for (size_t I = 0; I < Count; ++I, DiffPtr += 3)
+      for (int C = 0; C < 3; ++C)
+        DiffPtr[C] = std::abs(L[C][I] - R[C][I]);
+  }
+
+  bool processIdentical(size_t Count) override {
+    std::fill_n(DiffPtr, Count * 3, 0.0f);
+    DiffPtr += Count * 3;
+    return true;
+  }
+
   void print(llvm::raw_ostream &) override {
-    llvm::consumeError(Image::writePNG(DiffImg, OutputFilename));
+    llvm::consumeError(Image::writePNG(*DiffImg, OutputFilename));
   }
 };
 } // namespace offloadtest
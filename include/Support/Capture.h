@@ -0,0 +1,58 @@
+//===- Capture.h - Execution Capture ----------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A single file recording everything about a run of a pipeline: the compiled
+// shader, the device and driver it ran on, the pipeline with its input data,
+// the results, and the time each execution took. A capture can be replayed
+// without the pipeline description, its data files or the compiler.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_CAPTURE_H
+#define OFFLOADTEST_SUPPORT_CAPTURE_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+namespace offloadtest {
+
+struct CaptureRun {
+  double HostMilliseconds = 0.0;
+  // Negative if the device could not time the dispatch, as in ExecutionTimes.
+  double GPUMilliseconds = -1.0;
+
+  bool hasGPUTime() const { return GPUMilliseconds >= 0.0; }
+};
+
+struct Capture {
+  std::string API;
+  std::string DeviceDescription;
+  std::string DriverVersion;
+  std::string Program;
+  // The pipeline before execution. Data read from data files is stored in
+  // the capture, so the files are not needed to replay it.
+  Pipeline Inputs;
+  // The pipeline after the last execution.
+  Pipeline Outputs;
+  llvm::SmallVector<CaptureRun> Runs;
+};
+
+// Writes C to Path, replacing any existing file atomically.
+llvm::Error writeCapture(const Capture &C, llvm::StringRef Path);
+
+// Reads the capture at Path.
+llvm::Expected<Capture> readCapture(llvm::StringRef Path);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_CAPTURE_H
@@ -0,0 +1,63 @@
+//===- DeviceLock.h - Cross-Process Device Scheduling -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Limits how many processes use a device at once. Each device has a fixed
+// number of slots, each backed by a lock file in a shared directory. A process
+// holds one slot while it runs work on the device, or all of them for
+// exclusive use. Slots are released when the lock is destroyed or the process
+// exits.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_DEVICELOCK_H
+#define OFFLOADTEST_SUPPORT_DEVICELOCK_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+namespace offloadtest {
+
+// Returns DeviceName, a device description, with the characters that aren't
+// valid in file names replaced, to name per-device files.
+std::string getDeviceFileName(llvm::StringRef DeviceName);
+
+class DeviceLock {
+  // Descriptors of the lock files of the held slots.
+  llvm::SmallVector<int> FDs;
+
+public:
+  DeviceLock() = default;
+  DeviceLock(const DeviceLock &) = delete;
+  DeviceLock &operator=(const DeviceLock &) = delete;
+  DeviceLock(DeviceLock &&RHS) : FDs(std::move(RHS.FDs)) { RHS.FDs.clear(); }
+  DeviceLock &operator=(DeviceLock &&RHS);
+  ~DeviceLock() { release(); }
+
+  // Waits for a slot of the device named DeviceName, or for all of its
+  // Concurrency slots if Exclusive is set. Slots are taken in order, so
+  // exclusive and shared users never deadlock.
+  static llvm::Expected<DeviceLock> acquire(llvm::StringRef Dir,
+                                            llvm::StringRef DeviceName,
+                                            unsigned Concurrency,
+                                            bool Exclusive);
+
+  // Returns the path of the lock file of a slot.
+  static std::string getSlotPath(llvm::StringRef Dir,
+                                 llvm::StringRef DeviceName, unsigned Slot);
+
+  unsigned getHeldSlots() const { return FDs.size(); }
+
+  void release();
+};
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_DEVICELOCK_H
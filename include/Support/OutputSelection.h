@@ -0,0 +1,63 @@
+//===- OutputSelection.h - Resource Output Selection ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Narrows the results of a pipeline down to the resources, and the range of
+// elements within them, that a test wants to see. An element is one value of
+// the resource's element size, so all channels of a vector (or all bytes of a
+// raw structure) are selected together.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_OUTPUTSELECTION_H
+#define OFFLOADTEST_SUPPORT_OUTPUTSELECTION_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+namespace offloadtest {
+
+struct OutputSelection {
+  // Resources to keep, each either an OutputProps name or "<set>:<index>".
+  // Every resource is kept if this is empty.
+  llvm::SmallVector<std::string> Resources;
+  // Keep only the first or the last N elements. Zero keeps all elements. At
+  // most one of First and Last may be set.
+  uint64_t First = 0;
+  uint64_t Last = 0;
+  // Keep every Stride-th element of the range, starting with its first.
+  uint64_t Stride = 1;
+
+  bool selectsAll() const {
+    return Resources.empty() && First == 0 && Last == 0 && Stride == 1;
+  }
+};
+
+// Returns true if Selector names the resource R at SetIdx:ResIdx.
+bool matchesSelector(llvm::StringRef Selector, const Resource &R,
+                     unsigned SetIdx, unsigned ResIdx);
+
+// Returns a copy of R restricted to the elements picked by Sel. Contiguous
+// ranges borrow R's data, strided ones are copied. Expected data is dropped.
+Resource selectElements(const Resource &R, const OutputSelection &Sel);
+
+// Returns a pipeline holding the selected resources and elements of P. Sets
+// are kept, even if empty, so set numbers match the original description. P
+// must outlive the result. If ResourceIndices is given, it is set to the
+// index in P of each resource kept, by set.
+llvm::Expected<Pipeline>
+selectOutput(const Pipeline &P, const OutputSelection &Sel,
+             llvm::SmallVectorImpl<llvm::SmallVector<unsigned>>
+                 *ResourceIndices = nullptr);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_OUTPUTSELECTION_H
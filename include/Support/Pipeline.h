@@ -13,6 +13,9 @@
 #ifndef OFFLOADTEST_SUPPORT_PIPELINE_H
 #define OFFLOADTEST_SUPPORT_PIPELINE_H
 
+#include "Support/ResourceBuffer.h"
+
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/YAMLTraits.h"
@@ -54,18 +57,56 @@ struct OutputProperties {
   int Depth;
 };
 
+enum class ToleranceKind {
+  Exact,
+  ULP,
+  Abs,
+};
+
+struct Tolerance {
+  ToleranceKind Kind = ToleranceKind::Exact;
+  // Maximum distance in units in the last place (ToleranceKind::ULP).
+  uint64_t ULP = 0;
+  // Maximum absolute difference (ToleranceKind::Abs).
+  double Abs = 0.0;
+};
+
+// Values a resource is expected to hold after execution. The values are either
+// provided inline or read from a raw binary file in the resource's format.
+struct ExpectedData {
+  size_t Size = 0;
+  ResourceBuffer Data;
+  std::string File;
+  Tolerance Tol;
+
+  bool isSet() const { return Data || !File.empty(); }
+};
+
 struct Resource {
   DataFormat Format;
   int Channels;
   int RawSize;
   DataAccess Access;
   size_t Size;
-  std::unique_ptr<char[]> Data;
+  ResourceBuffer Data;
+  // File the data is read from instead of being given inline, see
+  // loadResourceFiles.
+  std::string DataFile;
   DirectXBinding DXBinding;
   OutputProperties OutputProps;
+  ExpectedData Expected;
+  // The size requested with ZeroInitSize, or 0 if the data was given.
+  size_t ZeroInitSize = 0;
 
   bool isRaw() const { return RawSize > 0; }
 
+  // Returns a copy of this resource. ReadWrite data is copied, any other data
+  // is borrowed, so this resource must outlive the copy.
+  Resource clone() const;
+
+  // Returns a copy of everything but the data and the expected data.
+  Resource cloneDescription() const;
+
   uint32_t getElementSize() const {
     if (isRaw())
       return RawSize;
@@ -96,12 +137,28 @@ struct Resource {
 };
 
 struct DescriptorSet {
-  llvm::SmallVector<Resource> Resources;
+  llvm::SmallVector<Resource, 0> Resources;
+};
+
+// One point of a parameter sweep. Each point runs the pipeline with its own
+// dispatch size and with zero-initialized resources scaled by Scale.
+struct SweepPoint {
+  int DispatchSize[3];
+  uint32_t Scale = 1;
 };
 
 struct Pipeline {
   int DispatchSize[3];
   llvm::SmallVector<DescriptorSet> Sets;
+  llvm::SmallVector<SweepPoint> Sweep;
+
+  // Returns a copy of this pipeline, see Resource::clone.
+  Pipeline clone() const;
+
+  // Returns a hash of everything that determines the pipeline layout (the
+  // sets, and the access, format and binding of each resource) but not the
+  // data or the sizes.
+  llvm::hash_code getLayoutHash() const;
 
   uint32_t getDescriptorCount() const {
     uint32_t DescriptorCount = 0;
@@ -114,6 +171,7 @@ struct Pipeline {
 
 LLVM_YAML_IS_SEQUENCE_VECTOR(offloadtest::DescriptorSet)
 LLVM_YAML_IS_SEQUENCE_VECTOR(offloadtest::Resource)
+LLVM_YAML_IS_SEQUENCE_VECTOR(offloadtest::SweepPoint)
 
 namespace llvm {
 namespace yaml {
@@ -122,6 +180,10 @@ template <> struct MappingTraits<offloadtest::Pipeline> {
   static void mapping(IO &I, offloadtest::Pipeline &P);
 };
 
+template <> struct MappingTraits<offloadtest::SweepPoint> {
+  static void mapping(IO &I, offloadtest::SweepPoint &S);
+};
+
 template <> struct MappingTraits<offloadtest::DescriptorSet> {
   static void mapping(IO &I, offloadtest::DescriptorSet &D);
 };
@@ -130,6 +192,17 @@ template <> struct MappingTraits<offloadtest::Resource> {
   static void mapping(IO &I, offloadtest::Resource &R);
 };
 
+template <>
+struct MappingContextTraits<offloadtest::ExpectedData,
+                            offloadtest::DataFormat> {
+  static void mapping(IO &I, offloadtest::ExpectedData &E,
+                      offloadtest::DataFormat &Format);
+};
+
+template <> struct MappingTraits<offloadtest::Tolerance> {
+  static void mapping(IO &I, offloadtest::Tolerance &T);
+};
+
 template <> struct MappingTraits<offloadtest::DirectXBinding> {
   static void mapping(IO &I, offloadtest::DirectXBinding &B);
 };
@@ -0,0 +1,60 @@
+//===- PipelineBinary.h - Binary Pipeline Serialization ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact binary encoding of a parsed Pipeline. The encoding stores the hash
+// of the YAML source it was produced from so that a `.pipebin` file written
+// next to a pipeline description can be reused for as long as the YAML is
+// unchanged. Resource data is stored 64-byte aligned so it can be used in
+// place from a memory-mapped file.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_PIPELINEBINARY_H
+#define OFFLOADTEST_SUPPORT_PIPELINEBINARY_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+class WritableMemoryBuffer;
+} // namespace llvm
+
+namespace offloadtest {
+
+// Returns the hash used to key a binary pipeline to its YAML source.
+uint64_t hashPipelineSource(llvm::StringRef Source);
+
+// Returns the path of the binary cache file for the pipeline at YAMLPath.
+std::string getPipelineBinaryPath(llvm::StringRef YAMLPath);
+
+// Returns the source hash recorded in a binary pipeline, or 0 if Buffer does
+// not hold a binary pipeline this version can read.
+uint64_t getPipelineBinarySourceHash(llvm::StringRef Buffer);
+
+// Serializes P to OS, tagging it with SourceHash.
+void writePipelineBinary(const Pipeline &P, uint64_t SourceHash,
+                         llvm::raw_ostream &OS);
+
+// Writes P to Path, replacing any existing file atomically.
+llvm::Error writePipelineBinary(const Pipeline &P, uint64_t SourceHash,
+                                llvm::StringRef Path);
+
+// Deserializes a binary pipeline. Resource data is not copied; the returned
+// resources keep Buffer alive and refer to its memory directly.
+llvm::Expected<Pipeline>
+readPipelineBinary(std::unique_ptr<llvm::WritableMemoryBuffer> Buffer);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_PIPELINEBINARY_H
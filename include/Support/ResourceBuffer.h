@@ -0,0 +1,127 @@
+//===- ResourceBuffer.h - Resource Data Storage -----------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// ResourceBuffer owns (or borrows) the host-side bytes backing a Resource.
+// Owned allocations are always at least cache-line aligned so host code can
+// use aligned vector loads, and can optionally be page aligned (and hinted as
+// huge pages) or recycled through a BufferPool. External memory, such as a
+// memory-mapped file or a driver mapping, can be wrapped without copying.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_RESOURCEBUFFER_H
+#define OFFLOADTEST_SUPPORT_RESOURCEBUFFER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace llvm {
+class WritableMemoryBuffer;
+}
+
+namespace offloadtest {
+
+class ResourceBuffer {
+public:
+  // Alignment of every owned allocation. A cache line is wide enough for any
+  // vector load the host-side code issues.
+  static constexpr size_t DefaultAlignment = 64;
+
+  // Called with the data pointer and size when the buffer is released.
+  using ReleaseFn = llvm::unique_function<void(char *, size_t)>;
+
+  ResourceBuffer() = default;
+  ResourceBuffer(const ResourceBuffer &) = delete;
+  ResourceBuffer &operator=(const ResourceBuffer &) = delete;
+  ResourceBuffer(ResourceBuffer &&RHS) noexcept;
+  ResourceBuffer &operator=(ResourceBuffer &&RHS) noexcept;
+  ~ResourceBuffer() { reset(); }
+
+  // Allocates an uninitialized buffer.
+  static ResourceBuffer allocate(size_t Size,
+                                 size_t Alignment = DefaultAlignment);
+
+  // Allocates a zero-filled buffer.
+  static ResourceBuffer allocateZeroed(size_t Size,
+                                       size_t Alignment = DefaultAlignment);
+
+  // Allocates an uninitialized page-aligned buffer. Large allocations are
+  // aligned to and hinted as huge pages where the host supports it.
+  static ResourceBuffer allocatePages(size_t Size);
+
+  // Allocates a buffer and copies Src into it.
+  static ResourceBuffer copy(llvm::ArrayRef<char> Src,
+                             size_t Alignment = DefaultAlignment);
+
+  // Wraps externally owned memory. If Release is empty the memory is borrowed
+  // and must outlive the returned buffer.
+  static ResourceBuffer wrap(char *Ptr, size_t Size,
+                             ReleaseFn Release = nullptr);
+
+  // Takes ownership of a writable (possibly memory-mapped) buffer.
+  static ResourceBuffer wrap(std::unique_ptr<llvm::WritableMemoryBuffer> MB);
+
+  char *data() { return Ptr; }
+  const char *data() const { return Ptr; }
+  size_t size() const { return Size; }
+  bool empty() const { return Size == 0; }
+  explicit operator bool() const { return Ptr != nullptr; }
+
+  // Returns true if this buffer does not own its memory.
+  bool isBorrowed() const { return Ptr && !Release; }
+
+  llvm::MutableArrayRef<char> getBuffer() { return {Ptr, Size}; }
+  llvm::StringRef getStringRef() const { return {Ptr, Size}; }
+
+  void reset();
+
+private:
+  ResourceBuffer(char *P, size_t S, ReleaseFn R)
+      : Ptr(P), Size(S), Release(std::move(R)) {}
+
+  char *Ptr = nullptr;
+  size_t Size = 0;
+  ReleaseFn Release;
+};
+
+// BufferPool recycles ResourceBuffer allocations by power-of-two size class so
+// repeated executions of the same pipeline do not go back to the system
+// allocator. The pool is thread safe, and buffers handed out by a pool may
+// outlive it.
+class BufferPool {
+  struct Impl;
+  std::shared_ptr<Impl> I;
+
+public:
+  explicit BufferPool(size_t Alignment = ResourceBuffer::DefaultAlignment,
+                      bool UseHugePages = false);
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+  ~BufferPool();
+
+  // Returns an uninitialized buffer of at least Size bytes. The returned
+  // buffer's size() is exactly Size.
+  ResourceBuffer allocate(size_t Size);
+
+  // Returns a zero-filled buffer of Size bytes.
+  ResourceBuffer allocateZeroed(size_t Size);
+
+  // Releases all cached free blocks back to the system.
+  void trim();
+
+  // Number of bytes currently cached for reuse.
+  size_t getCachedBytes() const;
+};
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_RESOURCEBUFFER_H
@@ -0,0 +1,68 @@
+//===- ResourceIO.h - Resource Data Files -----------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Reads and writes resource data as files outside of the pipeline
+// description. Files hold either the raw bytes of the resource, a NumPy
+// `.npy` array whose dtype and shape follow the resource's format and
+// channels, or gzip-compressed raw bytes. Files written here can be used as
+// the `DataFile` of a resource or the `File` of an Expected block.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_RESOURCEIO_H
+#define OFFLOADTEST_SUPPORT_RESOURCEIO_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace offloadtest {
+
+enum class ResourceFileFormat {
+  Raw,
+  NumPy,
+  GZip,
+};
+
+// Returns the format implied by the extension of Path: `.npy` for NumPy,
+// `.gz` for gzip and raw bytes for anything else.
+ResourceFileFormat getResourceFileFormat(llvm::StringRef Path);
+
+// Returns the file extension, including the dot, for Format.
+llvm::StringRef getResourceFileExtension(ResourceFileFormat Format);
+
+// Returns the NumPy dtype descriptor for the elements of R, e.g. "<f4".
+// Raw resources are described as opaque records of RawSize bytes.
+std::string getNumPyDType(const Resource &R);
+
+// Writes the `.npy` header describing the data of R.
+void writeNumPyHeader(const Resource &R, llvm::raw_ostream &OS);
+
+// Writes the data of R to Path.
+llvm::Error writeResourceFile(const Resource &R, llvm::StringRef Path,
+                              ResourceFileFormat Format);
+
+// Reads resource data for R from Path, in the format implied by its
+// extension. Raw files are used in place, without copying.
+llvm::Expected<ResourceBuffer> readResourceFile(const Resource &R,
+                                                llvm::StringRef Path);
+
+// Reads the DataFile of every resource that has one. Relative paths are
+// resolved against BaseDir.
+llvm::Error loadResourceFiles(Pipeline &P, llvm::StringRef BaseDir);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_RESOURCEIO_H
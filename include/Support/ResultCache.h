@@ -0,0 +1,62 @@
+//===- ResultCache.h - Execution Result Cache -------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A directory of pipeline results keyed by everything that determines them:
+// the compiled shader, the pipeline description and its input data, and the
+// device and driver it ran on. Each entry is the executed pipeline in the
+// binary pipeline format, named after its key.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_RESULTCACHE_H
+#define OFFLOADTEST_SUPPORT_RESULTCACHE_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <optional>
+#include <string>
+
+namespace offloadtest {
+
+// The inputs a result depends on.
+struct ResultKeyInputs {
+  llvm::StringRef Program;
+  // The hashPipelineSource of the pipeline's YAML source. The data of the
+  // resources Inputs loads from data files is hashed as well.
+  uint64_t PipelineHash = 0;
+  const Pipeline *Inputs = nullptr;
+  llvm::StringRef API;
+  llvm::StringRef DeviceDescription;
+  llvm::StringRef DriverVersion;
+};
+
+// Returns the key results of running with the given inputs are cached under.
+uint64_t getResultKey(const ResultKeyInputs &K);
+
+// Returns the path of the entry for Key in the cache directory Dir.
+std::string getResultCachePath(llvm::StringRef Dir, uint64_t Key);
+
+// Reads the entry for Key. Missing, corrupt and stale entries are all misses.
+std::optional<Pipeline> lookupResult(llvm::StringRef Dir, uint64_t Key);
+
+// Stores the executed pipeline P as the entry for Key.
+llvm::Error storeResult(llvm::StringRef Dir, uint64_t Key, const Pipeline &P);
+
+// Returns true if Cached has the same resources, of the same sizes, as P.
+bool hasResultLayout(const Pipeline &Cached, const Pipeline &P);
+
+// Moves the resource data of a cached result into P. Returns false, leaving
+// P unchanged, if Cached doesn't have P's layout.
+bool applyResult(Pipeline &P, Pipeline &Cached);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_RESULTCACHE_H
@@ -0,0 +1,83 @@
+//===- Statistics.h - Resource Summary Statistics ---------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Summary statistics over the values of a resource, for results too large to
+// print in full. Statistics are computed over individual scalars, so all
+// channels of a vector resource are included.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_STATISTICS_H
+#define OFFLOADTEST_SUPPORT_STATISTICS_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <string>
+#include <vector>
+
+namespace offloadtest {
+
+struct ResourceStatistics {
+  uint64_t Count = 0;
+  // Minimum, maximum, sum and mean of the finite values. NaNs and infinities
+  // are only counted.
+  double Min = 0.0;
+  double Max = 0.0;
+  double Sum = 0.0;
+  double Mean = 0.0;
+  uint64_t NaNCount = 0;
+  uint64_t InfCount = 0;
+  // Number of distinct values. Positive and negative zero are the same value,
+  // as are all NaNs.
+  uint64_t DistinctCount = 0;
+  // Counts of the finite values in equally sized bins spanning [Min, Max].
+  llvm::SmallVector<uint64_t, 16> Histogram;
+};
+
+// Computes the statistics of R's values. The work is split into chunks that
+// run in parallel.
+ResourceStatistics computeStatistics(const Resource &R,
+                                     unsigned HistogramBins = 16);
+
+// Statistics of one resource of a pipeline, as printed by offloader.
+struct ResourceSummary {
+  unsigned Set = 0;
+  unsigned Index = 0;
+  std::string Name;
+  DataFormat Format = DataFormat::Hex8;
+  int Channels = 1;
+  ResourceStatistics Stats;
+};
+
+// Computes the summaries of every resource in P.
+std::vector<ResourceSummary> summarizePipeline(const Pipeline &P,
+                                               unsigned HistogramBins = 16);
+
+// Returns the median of Values, which must not be empty. Used for timings,
+// where it is less affected by outliers than the mean.
+double getMedian(llvm::ArrayRef<double> Values);
+
+} // namespace offloadtest
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(offloadtest::ResourceSummary)
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<offloadtest::ResourceSummary> {
+  static void mapping(IO &I, offloadtest::ResourceSummary &S);
+};
+
+} // namespace yaml
+} // namespace llvm
+
+#endif // OFFLOADTEST_SUPPORT_STATISTICS_H
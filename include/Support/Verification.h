@@ -0,0 +1,64 @@
+//===- Verification.h - Expected Data Verification --------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares resource data against the values in a resource's Expected block.
+// Values are compared element-wise as scalars of the resource's format, so
+// reported indices count individual channels.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_SUPPORT_VERIFICATION_H
+#define OFFLOADTEST_SUPPORT_VERIFICATION_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Error.h"
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace offloadtest {
+
+struct MismatchSummary {
+  uint64_t ValueCount = 0;
+  uint64_t MismatchCount = 0;
+  // Indices of the first mismatching values, in order.
+  llvm::SmallVector<uint64_t, 8> FirstMismatches;
+  // Largest error seen, in ULPs for ULP tolerances and as an absolute
+  // difference otherwise. Infinite if exactly one side is NaN.
+  double MaxError = 0.0;
+  uint64_t MaxErrorIndex = 0;
+  // Set if the actual and expected data are not the same size.
+  bool SizeMismatch = false;
+
+  bool passed() const { return !SizeMismatch && MismatchCount == 0; }
+};
+
+// Compares Actual to Expected as arrays of Format values. At most MaxReported
+// mismatch indices are recorded.
+MismatchSummary compareData(DataFormat Format, llvm::ArrayRef<char> Actual,
+                            llvm::ArrayRef<char> Expected, const Tolerance &Tol,
+                            unsigned MaxReported = 8);
+
+// Compares a resource's data to its Expected block.
+MismatchSummary verifyResource(const Resource &R, unsigned MaxReported = 8);
+
+// Reads the files referenced by Expected blocks that don't have data loaded
+// yet, in any format readResourceFile accepts. Relative paths are resolved
+// against BaseDir.
+llvm::Error loadExpectedData(Pipeline &P, llvm::StringRef BaseDir);
+
+void printMismatchSummary(llvm::raw_ostream &OS, const MismatchSummary &S,
+                          const Tolerance &Tol);
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_SUPPORT_VERIFICATION_H
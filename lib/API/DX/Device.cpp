@@ -27,6 +27,7 @@
 #include "Support/Pipeline.h"
 #include "Support/WinError.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Error.h"
 
@@ -74,6 +75,24 @@ private:
   CComPtr<ID3D12Device> Device;
   Capabilities Caps;
 
+  // The command structures live as long as the device and are created on
+  // first use.
+  CComPtr<ID3D12CommandQueue> Queue;
+  CComPtr<ID3D12CommandAllocator> Allocator;
+  CComPtr<ID3D12GraphicsCommandList> CmdList;
+  CComPtr<ID3D12Fence> Fence;
+  HANDLE Event = nullptr;
+  uint64_t FenceValue = 0;
+  CComPtr<ID3D12QueryHeap> TimestampHeap;
+  CComPtr<ID3D12Resource> TimestampReadback;
+
+  struct CompiledPipeline {
+    CComPtr<ID3D12RootSignature> RootSig;
+    CComPtr<ID3D12PipelineState> PSO;
+  };
+  // Compiled pipelines keyed by Device::getPipelineKey.
+  llvm::DenseMap<uint64_t, CompiledPipeline> Pipelines;
+
   struct UAVResourceSet {
     CComPtr<ID3D12Resource> Upload;
     CComPtr<ID3D12Resource> Buffer;
@@ -98,15 +117,32 @@ public:
       : Adapter(A), Device(D) {
     uint64_t StrSz = wcsnlen(Desc.Description, 128);
     Description = StringFromWString(std::wstring(Desc.Description, StrSz));
+    DriverVersion = std::to_string(Desc.VendorId) + ":" +
+                    std::to_string(Desc.DeviceId) + ":" +
+                    std::to_string(Desc.Revision);
+    // The user mode driver version, as shown in the device manager.
+    LARGE_INTEGER UMDVersion;
+    if (SUCCEEDED(A->CheckInterfaceSupport(__uuidof(IDXGIDevice),
+                                           &UMDVersion)))
+      DriverVersion += ":" + std::to_string(HIWORD(UMDVersion.HighPart)) +
+                       "." + std::to_string(LOWORD(UMDVersion.HighPart)) +
+                       "." + std::to_string(HIWORD(UMDVersion.LowPart)) +
+                       "." + std::to_string(LOWORD(UMDVersion.LowPart));
   }
-  DXDevice(const DXDevice &) = default;
+  // The device owns Event, which the destructor closes.
+  DXDevice(const DXDevice &) = delete;
+  DXDevice &operator=(const DXDevice &) = delete;
 
-  ~DXDevice() override = default;
+  ~DXDevice() override {
+    if (Event)
+      CloseHandle(Event);
+  }
 
   llvm::StringRef getAPIName() const override { return "DirectX"; }
   GPUAPI getAPI() const override { return GPUAPI::DirectX; }
 
-  static llvm::Expected<DXDevice> Create(CComPtr<IDXGIAdapter1> Adapter) {
+  static llvm::Expected<std::shared_ptr<DXDevice>>
+  Create(CComPtr<IDXGIAdapter1> Adapter) {
     CComPtr<ID3D12Device> Device;
     if (auto Err =
             HR::toError(D3D12CreateDevice(Adapter, D3D_FEATURE_LEVEL_11_0,
@@ -119,7 +155,7 @@ public:
       return Err;
     if (auto Err = configureInfoQueue(Device))
       return Err;
-    return DXDevice(Adapter, Device, Desc);
+    return std::make_shared<DXDevice>(Adapter, Device, Desc);
   }
 
   const Capabilities &getCapabilities() override {
@@ -257,27 +293,103 @@ public:
     return llvm::Error::success();
   }
 
-  llvm::Error createCommandStructures(InvocationState &IS) {
-    const D3D12_COMMAND_QUEUE_DESC Desc = {D3D12_COMMAND_LIST_TYPE_DIRECT, 0,
-                                           D3D12_COMMAND_QUEUE_FLAG_NONE, 0};
-    if (auto Err = HR::toError(
-            Device->CreateCommandQueue(&Desc, IID_PPV_ARGS(&IS.Queue)),
-            "Failed to create command queue."))
-      return Err;
-    if (auto Err = HR::toError(
-            Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                           IID_PPV_ARGS(&IS.Allocator)),
-            "Failed to create command allocator."))
+  // Uses the compiled pipeline for this program and layout if there is one,
+  // otherwise compiles and caches it.
+  llvm::Error getOrCreatePipeline(Pipeline &P, llvm::StringRef DXIL,
+                                  InvocationState &State) {
+    uint64_t Key = getPipelineKey(DXIL, P);
+    auto It = Pipelines.find(Key);
+    if (It != Pipelines.end()) {
+      State.RootSig = It->second.RootSig;
+      State.PSO = It->second.PSO;
+      progress() << "Reusing compiled pipeline.\n";
+      return llvm::Error::success();
+    }
+    if (auto Err = createRootSignature(P, State))
       return Err;
-    if (auto Err =
-            HR::toError(Device->CreateCommandList(
-                            0, D3D12_COMMAND_LIST_TYPE_DIRECT, IS.Allocator,
-                            nullptr, IID_PPV_ARGS(&IS.CmdList)),
-                        "Failed to create command list."))
+    progress() << "RootSignature created.\n";
+    if (auto Err = createPSO(P, DXIL, State))
       return Err;
+    progress() << "PSO created.\n";
+    Pipelines[Key] = CompiledPipeline{State.RootSig, State.PSO};
+    return llvm::Error::success();
+  }
+
+  llvm::Error createCommandStructures(InvocationState &IS) {
+    if (Queue) {
+      if (auto Err = HR::toError(Allocator->Reset(),
+                                 "Failed to reset command allocator."))
+        return Err;
+      if (auto Err = HR::toError(CmdList->Reset(Allocator, nullptr),
+                                 "Failed to reset command list."))
+        return Err;
+    } else {
+      const D3D12_COMMAND_QUEUE_DESC Desc = {D3D12_COMMAND_LIST_TYPE_DIRECT, 0,
+                                             D3D12_COMMAND_QUEUE_FLAG_NONE, 0};
+      if (auto Err = HR::toError(
+              Device->CreateCommandQueue(&Desc, IID_PPV_ARGS(&Queue)),
+              "Failed to create command queue."))
+        return Err;
+      if (auto Err = HR::toError(
+              Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                             IID_PPV_ARGS(&Allocator)),
+              "Failed to create command allocator."))
+        return Err;
+      if (auto Err =
+              HR::toError(Device->CreateCommandList(
+                              0, D3D12_COMMAND_LIST_TYPE_DIRECT, Allocator,
+                              nullptr, IID_PPV_ARGS(&CmdList)),
+                          "Failed to create command list."))
+        return Err;
+      if (auto Err = createEvent())
+        return Err;
+      createTimestampQueries();
+    }
+    IS.Queue = Queue;
+    IS.Allocator = Allocator;
+    IS.CmdList = CmdList;
+    IS.Fence = Fence;
+    IS.Event = Event;
     return llvm::Error::success();
   }
 
+  // Timing is best effort, a device that can't create the query heap just
+  // doesn't report GPU times.
+  void createTimestampQueries() {
+    const D3D12_QUERY_HEAP_DESC QueryDesc = {D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+                                             2, 0};
+    if (FAILED(Device->CreateQueryHeap(&QueryDesc,
+                                       IID_PPV_ARGS(&TimestampHeap))))
+      return;
+    const D3D12_HEAP_PROPERTIES HeapProp =
+        CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    const D3D12_RESOURCE_DESC ResDesc =
+        CD3DX12_RESOURCE_DESC::Buffer(2 * sizeof(uint64_t));
+    if (FAILED(Device->CreateCommittedResource(
+            &HeapProp, D3D12_HEAP_FLAG_NONE, &ResDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            IID_PPV_ARGS(&TimestampReadback))))
+      TimestampHeap = nullptr;
+  }
+
+  void readTimestamps(InvocationState &IS, ExecutionTimes &Times) {
+    if (!TimestampHeap)
+      return;
+    uint64_t Frequency;
+    if (FAILED(IS.Queue->GetTimestampFrequency(&Frequency)) || !Frequency)
+      return;
+    const D3D12_RANGE ReadRange = {0, 2 * sizeof(uint64_t)};
+    void *DataPtr;
+    if (FAILED(TimestampReadback->Map(0, &ReadRange, &DataPtr)))
+      return;
+    uint64_t Ticks[2];
+    memcpy(Ticks, DataPtr, sizeof(Ticks));
+    const D3D12_RANGE WriteRange = {0, 0};
+    TimestampReadback->Unmap(0, &WriteRange);
+    Times.GPUMilliseconds =
+        static_cast<double>(Ticks[1] - Ticks[0]) * 1000.0 / Frequency;
+  }
+
   void addResourceUploadCommands(Resource &R, InvocationState &IS,
                                  CComPtr<ID3D12Resource> Destination,
                                  CComPtr<ID3D12Resource> Source) {
@@ -294,9 +406,9 @@ public:
 
   llvm::Error createUAV(Resource &R, InvocationState &IS,
                         const uint32_t HeapIdx) {
-    llvm::outs() << "Creating UAV: { Size = " << R.Size << ", Register = u"
-                 << R.DXBinding.Register << ", Space = " << R.DXBinding.Space
-                 << " }\n";
+    progress() << "Creating UAV: { Size = " << R.Size << ", Register = u"
+               << R.DXBinding.Register << ", Space = " << R.DXBinding.Space
+               << " }\n";
     CComPtr<ID3D12Resource> Buffer;
     CComPtr<ID3D12Resource> UploadBuffer;
     CComPtr<ID3D12Resource> ReadBackBuffer;
@@ -362,7 +474,7 @@ public:
     if (auto Err = HR::toError(UploadBuffer->Map(0, nullptr, &ResDataPtr),
                                "Failed to acquire UAV data pointer."))
       return Err;
-    memcpy(ResDataPtr, R.Data.get(), R.Size);
+    memcpy(ResDataPtr, R.Data.data(), R.Size);
     UploadBuffer->Unmap(0, nullptr);
 
     addResourceUploadCommands(R, IS, Buffer, UploadBuffer);
@@ -377,8 +489,8 @@ public:
         {D3D12_BUFFER_UAV{0, NumElts, static_cast<uint32_t>(R.RawSize), 0,
                           D3D12_BUFFER_UAV_FLAG_NONE}}};
 
-    llvm::outs() << "UAV: HeapIdx = " << HeapIdx << " EltSize = " << EltSize
-                 << " NumElts = " << NumElts << "\n";
+    progress() << "UAV: HeapIdx = " << HeapIdx << " EltSize = " << EltSize
+               << " NumElts = " << NumElts << "\n";
     D3D12_CPU_DESCRIPTOR_HANDLE UAVHandle =
         IS.DescHeap->GetCPUDescriptorHandleForHeapStart();
     UAVHandle.ptr += HeapIdx * Device->GetDescriptorHandleIncrementSize(
@@ -457,22 +569,22 @@ public:
     IS.CmdList->ResourceBarrier(1, &Barrier);
   }
 
-  llvm::Error createEvent(InvocationState &IS) {
+  llvm::Error createEvent() {
     if (auto Err = HR::toError(Device->CreateFence(0, D3D12_FENCE_FLAG_NONE,
-                                                   IID_PPV_ARGS(&IS.Fence)),
+                                                   IID_PPV_ARGS(&Fence)),
                                "Failed to create fence."))
       return Err;
-    IS.Event = CreateEventA(nullptr, false, false, nullptr);
-    if (!IS.Event)
+    Event = CreateEventA(nullptr, false, false, nullptr);
+    if (!Event)
       return llvm::createStringError(std::errc::device_or_resource_busy,
                                      "Failed to create event.");
     return llvm::Error::success();
   }
 
   llvm::Error waitForSignal(InvocationState &IS) {
-    // This is a hack but it works since this is all single threaded code.
-    static uint64_t FenceCounter = 0;
-    uint64_t CurrentCounter = FenceCounter + 1;
+    // The fence is shared by every invocation on this device, so each signal
+    // needs a new value.
+    uint64_t CurrentCounter = FenceValue + 1;
 
     if (auto Err = HR::toError(IS.Queue->Signal(IS.Fence, CurrentCounter),
                                "Failed to add signal."))
@@ -485,7 +597,7 @@ public:
         return Err;
       WaitForSingleObject(IS.Event, INFINITE);
     }
-    FenceCounter = CurrentCounter;
+    FenceValue = CurrentCounter;
     return llvm::Error::success();
   }
 
@@ -516,8 +628,15 @@ public:
       Handle.Offset(P.Sets[Idx].Resources.size(), Inc);
     }
 
+    if (TimestampHeap)
+      IS.CmdList->EndQuery(TimestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
     IS.CmdList->Dispatch(P.DispatchSize[0], P.DispatchSize[1],
                          P.DispatchSize[2]);
+    if (TimestampHeap) {
+      IS.CmdList->EndQuery(TimestampHeap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+      IS.CmdList->ResolveQueryData(TimestampHeap, D3D12_QUERY_TYPE_TIMESTAMP,
+                                   0, 2, TimestampReadback, 0);
+    }
 
     for (auto &Out : IS.Resources) {
       addReadbackBeginBarrier(IS, Out.Buffer);
@@ -540,7 +659,7 @@ public:
                   ResourcesIterator->Readback->Map(0, nullptr, &DataPtr),
                   "Failed to map result."))
             return Err;
-          memcpy(R.Data.get(), DataPtr, R.Size);
+          memcpy(R.Data.data(), DataPtr, R.Size);
           ResourcesIterator->Readback->Unmap(0, nullptr);
         }
         ++ResourcesIterator;
@@ -549,35 +668,30 @@ public:
     return llvm::Error::success();
   }
 
-  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P) override {
+  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P,
+                             ExecutionTimes &Times) override {
     InvocationState State;
-    llvm::outs() << "Configuring execution on device: " << Description << "\n";
-    if (auto Err = createRootSignature(P, State))
+    progress() << "Configuring execution on device: " << Description << "\n";
+    if (auto Err = getOrCreatePipeline(P, Program, State))
       return Err;
-    llvm::outs() << "RootSignature created.\n";
     if (auto Err = createDescriptorHeap(P, State))
       return Err;
-    llvm::outs() << "Descriptor heap created.\n";
-    if (auto Err = createPSO(P, Program, State))
-      return Err;
-    llvm::outs() << "PSO created.\n";
+    progress() << "Descriptor heap created.\n";
     if (auto Err = createCommandStructures(State))
       return Err;
-    llvm::outs() << "Command structures created.\n";
+    progress() << "Command structures ready.\n";
     if (auto Err = createBuffers(P, State))
       return Err;
-    llvm::outs() << "Buffers created.\n";
-    if (auto Err = createEvent(State))
-      return Err;
-    llvm::outs() << "Event prepared.\n";
+    progress() << "Buffers created.\n";
     createComputeCommands(P, State);
-    llvm::outs() << "Compute command list created.\n";
+    progress() << "Compute command list created.\n";
     if (auto Err = executeCommandList(State))
       return Err;
-    llvm::outs() << "Compute commands executed.\n";
+    progress() << "Compute commands executed.\n";
+    readTimestamps(State, Times);
     if (auto Err = readBack(P, State))
       return Err;
-    llvm::outs() << "Read data back.\n";
+    progress() << "Read data back.\n";
 
     return llvm::Error::success();
   }
@@ -614,8 +728,7 @@ llvm::Error InitializeDXDevices() {
     auto ExDevice = DXDevice::Create(Adapter);
     if (!ExDevice)
       return ExDevice.takeError();
-    auto ShPtr = std::make_shared<DXDevice>(*ExDevice);
-    Device::registerDevice(std::static_pointer_cast<Device>(ShPtr));
+    Device::registerDevice(std::static_pointer_cast<Device>(*ExDevice));
   }
   return llvm::Error::success();
 }
@@ -11,7 +11,11 @@
 
 #include "API/Device.h"
 #include "Config.h"
+#include "Support/Pipeline.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
 
 using namespace offloadtest;
 
@@ -35,6 +39,7 @@ public:
 
 private:
   DeviceArray Devices;
+  std::atomic<bool> ShowProgress = true;
 
   DeviceContext() = default;
   ~DeviceContext() = default;
@@ -48,6 +53,11 @@ public:
 
   void registerDevice(std::shared_ptr<Device> D) { Devices.push_back(D); }
 
+  void setShowProgress(bool Show) { ShowProgress = Show; }
+  llvm::raw_ostream &progress() {
+    return ShowProgress ? llvm::outs() : llvm::nulls();
+  }
+
   DeviceIterator begin() { return Devices.begin(); }
 
   DeviceIterator end() { return Devices.end(); }
@@ -56,6 +66,18 @@ public:
 
 Device::~Device() {}
 
+uint64_t Device::getPipelineKey(llvm::StringRef Program, const Pipeline &P) {
+  return llvm::hash_combine(llvm::hash_value(Program), P.getLayoutHash());
+}
+
+llvm::raw_ostream &Device::progress() {
+  return DeviceContext::Instance().progress();
+}
+
+void Device::setShowProgress(bool Show) {
+  DeviceContext::Instance().setShowProgress(Show);
+}
+
 void Device::registerDevice(std::shared_ptr<Device> D) {
   DeviceContext::Instance().registerDevice(D);
 }
@@ -81,3 +103,19 @@ Device::DeviceIterator Device::begin() {
 }
 
 Device::DeviceIterator Device::end() { return DeviceContext::Instance().end(); }
+
+Device *Device::findDevice(llvm::StringRef API, llvm::StringRef Description,
+                           bool Warp) {
+  Device *Found = nullptr;
+  for (const auto &D : devices()) {
+    if (D->getAPIName() != API)
+      continue;
+    if (Warp && D->getDescription() != "Microsoft Basic Render Driver")
+      continue;
+    if (D->getDescription() == Description)
+      return D.get();
+    if (!Found)
+      Found = D.get();
+  }
+  return Found;
+}
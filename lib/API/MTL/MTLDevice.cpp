@@ -12,6 +12,7 @@
 #include "API/Device.h"
 #include "Support/Pipeline.h"
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
@@ -54,7 +55,19 @@ namespace {
 class MTLDevice : public offloadtest::Device {
   Capabilities Caps;
   MTL::Device *Device;
+  // Created on first use and kept for the lifetime of the device.
+  MTL::CommandQueue *Queue = nullptr;
 
+  struct CompiledPipeline {
+    MTL::Library *Lib;
+    MTL::Function *Fn;
+    MTL::ComputePipelineState *PipelineState;
+  };
+  // Compiled pipelines keyed by Device::getPipelineKey.
+  llvm::DenseMap<uint64_t, CompiledPipeline> Pipelines;
+
+  // The queue and compiled pipeline are owned by the device, everything else
+  // is released with the invocation.
   struct InvocationState {
     InvocationState() { Pool = NS::AutoreleasePool::alloc()->init(); }
     ~InvocationState() {
@@ -62,14 +75,6 @@ class MTLDevice : public offloadtest::Device {
         T->release();
       for (auto B : Buffers)
         B->release();
-      if (Fn)
-        Fn->release();
-      if (Lib)
-        Lib->release();
-      if (PipelineState)
-        PipelineState->release();
-      if (Queue)
-        Queue->release();
 
       Pool->release();
     }
@@ -84,7 +89,17 @@ class MTLDevice : public offloadtest::Device {
     llvm::SmallVector<MTL::Buffer *> Buffers;
   };
 
-  llvm::Error loadShaders(InvocationState &IS, llvm::StringRef Program) {
+  llvm::Error loadShaders(InvocationState &IS, llvm::StringRef Program,
+                          const Pipeline &P) {
+    uint64_t Key = getPipelineKey(Program, P);
+    auto It = Pipelines.find(Key);
+    if (It != Pipelines.end()) {
+      IS.Lib = It->second.Lib;
+      IS.Fn = It->second.Fn;
+      IS.PipelineState = It->second.PipelineState;
+      return llvm::Error::success();
+    }
+
     NS::Error *Error = nullptr;
     dispatch_data_t data = dispatch_data_create(Program.data(), Program.size(),
                                                 dispatch_get_main_queue(),
@@ -100,6 +115,7 @@ class MTLDevice : public offloadtest::Device {
     if (Error)
       return toError(Error);
 
+    Pipelines[Key] = CompiledPipeline{IS.Lib, IS.Fn, IS.PipelineState};
     return llvm::Error::success();
   }
 
@@ -109,7 +125,7 @@ class MTLDevice : public offloadtest::Device {
 
     if (R.isRaw()) {
       MTL::Buffer *Buf =
-          Device->newBuffer(R.Data.get(), R.Size, MTL::StorageModeManaged);
+          Device->newBuffer(R.Data.data(), R.Size, MTL::StorageModeManaged);
       IRBufferView View = {};
       View.buffer = Buf;
       View.bufferSize = R.Size;
@@ -125,7 +141,7 @@ class MTLDevice : public offloadtest::Device {
               MTL::ResourceUsageRead | MTL::ResourceUsageWrite);
 
       MTL::Texture *NewTex = Device->newTexture(Desc);
-      NewTex->replaceRegion(MTL::Region(0, 0, Width, 1), 0, R.Data.get(), 0);
+      NewTex->replaceRegion(MTL::Region(0, 0, Width, 1), 0, R.Data.data(), 0);
 
       IS.Textures.push_back(NewTex);
 
@@ -175,7 +191,8 @@ class MTLDevice : public offloadtest::Device {
     return llvm::Error::success();
   }
 
-  llvm::Error executeCommands(Pipeline &P, InvocationState &IS) {
+  llvm::Error executeCommands(Pipeline &P, InvocationState &IS,
+                              ExecutionTimes &Times) {
     MTL::CommandBuffer *CmdBuffer = IS.Queue->commandBuffer();
 
     MTL::ComputeCommandEncoder *CmdEncoder = CmdBuffer->computeCommandEncoder();
@@ -202,6 +219,12 @@ class MTLDevice : public offloadtest::Device {
     CmdBuffer->commit();
     CmdBuffer->waitUntilCompleted();
 
+    // GPU start and end times are in seconds, and are zero if the device
+    // didn't record them.
+    if (CmdBuffer->GPUEndTime() > 0.0)
+      Times.GPUMilliseconds =
+          (CmdBuffer->GPUEndTime() - CmdBuffer->GPUStartTime()) * 1000.0;
+
     return llvm::Error::success();
   }
 
@@ -214,11 +237,12 @@ class MTLDevice : public offloadtest::Device {
 
         case DataAccess::ReadWrite: {
           if (R.isRaw()) {
-            memcpy(R.Data.get(), IS.Buffers[BufferIndex++]->contents(), R.Size);
+            memcpy(R.Data.data(), IS.Buffers[BufferIndex++]->contents(),
+                   R.Size);
           } else {
             uint64_t Width = R.Size / R.getElementSize();
             IS.Textures[TextureIndex++]->getBytes(
-                R.Data.get(), 0, MTL::Region(0, 0, Width, 1), 0);
+                R.Data.data(), 0, MTL::Region(0, 0, Width, 1), 0);
           }
           break;
         }
@@ -235,6 +259,10 @@ class MTLDevice : public offloadtest::Device {
 public:
   MTLDevice(MTL::Device *D) : Device(D) {
     Description = Device->name()->utf8String();
+    // Metal drivers ship with the OS, so its build identifies the driver.
+    DriverVersion = NS::ProcessInfo::processInfo()
+                        ->operatingSystemVersionString()
+                        ->utf8String();
   }
   const Capabilities &getCapabilities() override {
     if (Caps.empty())
@@ -245,16 +273,19 @@ public:
   llvm::StringRef getAPIName() const override { return "Metal"; };
   GPUAPI getAPI() const override { return GPUAPI::Metal; };
 
-  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P) override {
+  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P,
+                             ExecutionTimes &Times) override {
     InvocationState IS;
-    IS.Queue = Device->newCommandQueue();
-    if (auto Err = loadShaders(IS, Program))
+    if (!Queue)
+      Queue = Device->newCommandQueue();
+    IS.Queue = Queue;
+    if (auto Err = loadShaders(IS, Program, P))
       return Err;
 
     if (auto Err = createBuffers(P, IS))
       return Err;
 
-    if (auto Err = executeCommands(P, IS))
+    if (auto Err = executeCommands(P, IS, Times))
       return Err;
 
     if (auto Err = copyBack(P, IS))
@@ -262,7 +293,15 @@ public:
     return llvm::Error::success();
   }
 
-  virtual ~MTLDevice() {};
+  virtual ~MTLDevice() {
+    for (auto &Entry : Pipelines) {
+      Entry.second.PipelineState->release();
+      Entry.second.Fn->release();
+      Entry.second.Lib->release();
+    }
+    if (Queue)
+      Queue->release();
+  };
 
 private:
   void queryCapabilities() {}
@@ -11,9 +11,14 @@
 
 #include "API/Device.h"
 #include "Support/Pipeline.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/Support/Error.h"
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <vulkan/vulkan.h>
 
 using namespace offloadtest;
@@ -60,14 +65,57 @@ private:
     uint64_t Size;
   };
 
+  // A queue of the compute family. Vulkan requires submissions to a queue to
+  // be externally synchronized.
+  struct QueueRef {
+    VkQueue Queue;
+    std::unique_ptr<std::mutex> Mutex;
+  };
+
+  // The objects an execution records and submits commands with. Command pools
+  // and query pools must not be used by two threads at once, so concurrent
+  // executions each take a context of their own. Contexts share a queue only
+  // when there are more of them than the family has queues.
+  struct QueueContext {
+    QueueRef *Queue;
+    VkCommandPool CmdPool = VK_NULL_HANDLE;
+    VkQueryPool TimestampPool = VK_NULL_HANDLE;
+  };
+
+  // Guards the logical device creation, the contexts and the compiled
+  // pipelines below.
+  std::mutex Mutex;
+
+  // The logical device and the objects below live as long as the VKDevice and
+  // are created on first use.
+  VkDevice LogicalDevice = VK_NULL_HANDLE;
+  uint32_t QueueFamily = 0;
+  llvm::SmallVector<QueueRef> Queues;
+  llvm::SmallVector<std::unique_ptr<QueueContext>> Contexts;
+  // Contexts not in use by an execution.
+  llvm::SmallVector<QueueContext *> FreeContexts;
+  VkPipelineCache PipelineCache = VK_NULL_HANDLE;
+  uint32_t TimestampValidBits = 0;
+
+  struct CompiledPipeline {
+    VkShaderModule Shader;
+    llvm::SmallVector<VkDescriptorSetLayout> DescriptorSetLayouts;
+    VkPipelineLayout PipelineLayout;
+    VkPipeline Pipeline;
+  };
+  // Compiled pipelines keyed by Device::getPipelineKey.
+  llvm::DenseMap<uint64_t, CompiledPipeline> Pipelines;
+
   struct InvocationState {
     VkDevice Device;
-    VkQueue Queue;
+    QueueContext *Context = nullptr;
+    QueueRef *Queue;
     VkCommandPool CmdPool;
     VkCommandBuffer CmdBuffer;
     VkPipelineLayout PipelineLayout;
     VkDescriptorPool Pool;
     VkPipelineCache PipelineCache;
+    VkQueryPool TimestampPool;
     VkShaderModule Shader;
     VkPipeline Pipeline;
 
@@ -83,13 +131,17 @@ public:
     uint64_t StrSz =
         strnlen(Props.deviceName, VK_MAX_PHYSICAL_DEVICE_NAME_SIZE);
     Description = std::string(Props.deviceName, StrSz);
+    // The encoding of driverVersion is vendor specific, so it is kept as an
+    // opaque number alongside the IDs it is relative to.
+    DriverVersion = std::to_string(Props.vendorID) + ":" +
+                    std::to_string(Props.deviceID) + ":" +
+                    std::to_string(Props.driverVersion);
   }
-  VKDevice(const VKDevice &) = default;
-
   ~VKDevice() override = default;
 
   llvm::StringRef getAPIName() const override { return "Vulkan"; }
   GPUAPI getAPI() const override { return GPUAPI::Vulkan; }
+  bool supportsConcurrentExecution() const override { return true; }
 
   const Capabilities &getCapabilities() override {
     if (Caps.empty())
@@ -156,9 +208,79 @@ private:
     vkEnumerateInstanceLayerProperties(&LayerCount, Layers.data());
   }
 
+  // Locks M, adding the time spent waiting for another execution to hold it
+  // to Times.
+  static std::unique_lock<std::mutex> lockAndTime(std::mutex &M,
+                                                  ExecutionTimes &Times) {
+    std::unique_lock<std::mutex> Lock(M, std::try_to_lock);
+    if (Lock.owns_lock())
+      return Lock;
+    auto Start = std::chrono::steady_clock::now();
+    Lock.lock();
+    std::chrono::duration<double, std::milli> Waited =
+        std::chrono::steady_clock::now() - Start;
+    Times.WaitMilliseconds += Waited.count();
+    return Lock;
+  }
+
 public:
-  llvm::Error createDevice(InvocationState &IS) {
+  // Takes a free context for the execution in IS, creating the logical device
+  // and the context if needed.
+  llvm::Error createDevice(InvocationState &IS, ExecutionTimes &Times) {
+    std::unique_lock<std::mutex> Lock = lockAndTime(Mutex, Times);
+    if (!LogicalDevice)
+      if (auto Err = createLogicalDevice())
+        return Err;
+    if (FreeContexts.empty())
+      if (auto Err = createContext())
+        return Err;
+    IS.Context = FreeContexts.pop_back_val();
+    IS.Device = LogicalDevice;
+    IS.Queue = IS.Context->Queue;
+    IS.CmdPool = IS.Context->CmdPool;
+    IS.PipelineCache = PipelineCache;
+    IS.TimestampPool = IS.Context->TimestampPool;
+    return llvm::Error::success();
+  }
+
+  // Returns the context taken by createDevice for later executions.
+  void releaseContext(InvocationState &IS) {
+    if (!IS.Context)
+      return;
+    std::lock_guard<std::mutex> Lock(Mutex);
+    FreeContexts.push_back(IS.Context);
+  }
 
+  llvm::Error createContext() {
+    auto Ctx = std::make_unique<QueueContext>();
+    Ctx->Queue = &Queues[Contexts.size() % Queues.size()];
+
+    VkCommandPoolCreateInfo CmdPoolInfo = {};
+    CmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    CmdPoolInfo.queueFamilyIndex = QueueFamily;
+    CmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(LogicalDevice, &CmdPoolInfo, nullptr,
+                            &Ctx->CmdPool))
+      return llvm::createStringError(std::errc::device_or_resource_busy,
+                                     "Could not create command pool.");
+
+    // Timing is best effort, a queue without timestamp support just doesn't
+    // report GPU times.
+    if (TimestampValidBits > 0) {
+      VkQueryPoolCreateInfo QueryPoolInfo = {};
+      QueryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      QueryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      QueryPoolInfo.queryCount = 2;
+      if (vkCreateQueryPool(LogicalDevice, &QueryPoolInfo, nullptr,
+                            &Ctx->TimestampPool))
+        Ctx->TimestampPool = VK_NULL_HANDLE;
+    }
+    FreeContexts.push_back(Ctx.get());
+    Contexts.push_back(std::move(Ctx));
+    return llvm::Error::success();
+  }
+
+  llvm::Error createLogicalDevice() {
     // Find a queue that supports compute
     uint32_t QueueCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(Device, &QueueCount, 0);
@@ -175,34 +297,71 @@ public:
       return llvm::createStringError(std::errc::no_such_device,
                                      "No compute queue found.");
 
+    // Every queue of the family is created, so concurrent executions can
+    // submit without waiting for each other.
+    uint32_t FamilyQueueCount =
+        std::max(QueueFamilyProps.get()[QueueIdx].queueCount, 1u);
+    llvm::SmallVector<float> QueuePriorities(FamilyQueueCount, 0.0f);
     VkDeviceQueueCreateInfo QueueInfo = {};
-    float QueuePriority = 0.0f;
     QueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     QueueInfo.queueFamilyIndex = QueueIdx;
-    QueueInfo.queueCount = 1;
-    QueueInfo.pQueuePriorities = &QueuePriority;
+    QueueInfo.queueCount = FamilyQueueCount;
+    QueueInfo.pQueuePriorities = QueuePriorities.data();
 
     VkDeviceCreateInfo DeviceInfo = {};
     DeviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     DeviceInfo.queueCreateInfoCount = 1;
     DeviceInfo.pQueueCreateInfos = &QueueInfo;
 
-    if (vkCreateDevice(Device, &DeviceInfo, nullptr, &IS.Device))
+    if (vkCreateDevice(Device, &DeviceInfo, nullptr, &LogicalDevice))
       return llvm::createStringError(std::errc::no_such_device,
                                      "Could not create Vulkan logical device.");
-    vkGetDeviceQueue(IS.Device, QueueIdx, 0, &IS.Queue);
-
-    VkCommandPoolCreateInfo CmdPoolInfo = {};
-    CmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    CmdPoolInfo.queueFamilyIndex = QueueIdx;
-    CmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    QueueFamily = QueueIdx;
+    for (uint32_t I = 0; I < FamilyQueueCount; ++I) {
+      QueueRef &Q = Queues.emplace_back();
+      vkGetDeviceQueue(LogicalDevice, QueueIdx, I, &Q.Queue);
+      Q.Mutex = std::make_unique<std::mutex>();
+    }
 
-    if (vkCreateCommandPool(IS.Device, &CmdPoolInfo, nullptr, &IS.CmdPool))
+    VkPipelineCacheCreateInfo CacheCreateInfo = {};
+    CacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(LogicalDevice, &CacheCreateInfo, nullptr,
+                              &PipelineCache))
       return llvm::createStringError(std::errc::device_or_resource_busy,
-                                     "Could not create command pool.");
+                                     "Failed to create pipeline cache.");
+
+    TimestampValidBits = QueueFamilyProps.get()[QueueIdx].timestampValidBits;
     return llvm::Error::success();
   }
 
+  // Destroys the logical device and everything cached on it. This must run
+  // before the instance is destroyed, once no execution is running.
+  void releaseDevice() {
+    if (!LogicalDevice)
+      return;
+    vkDeviceWaitIdle(LogicalDevice);
+    for (auto &Entry : Pipelines) {
+      CompiledPipeline &CP = Entry.second;
+      vkDestroyPipeline(LogicalDevice, CP.Pipeline, nullptr);
+      vkDestroyShaderModule(LogicalDevice, CP.Shader, nullptr);
+      vkDestroyPipelineLayout(LogicalDevice, CP.PipelineLayout, nullptr);
+      for (auto &L : CP.DescriptorSetLayouts)
+        vkDestroyDescriptorSetLayout(LogicalDevice, L, nullptr);
+    }
+    Pipelines.clear();
+    for (auto &Ctx : Contexts) {
+      if (Ctx->TimestampPool)
+        vkDestroyQueryPool(LogicalDevice, Ctx->TimestampPool, nullptr);
+      vkDestroyCommandPool(LogicalDevice, Ctx->CmdPool, nullptr);
+    }
+    FreeContexts.clear();
+    Contexts.clear();
+    Queues.clear();
+    vkDestroyPipelineCache(LogicalDevice, PipelineCache, nullptr);
+    vkDestroyDevice(LogicalDevice, nullptr);
+    LogicalDevice = VK_NULL_HANDLE;
+  }
+
   llvm::Error createCommandBuffer(InvocationState &IS) {
     VkCommandBufferAllocateInfo CBufAllocInfo = {};
     CBufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -290,7 +449,7 @@ public:
                         const uint32_t HeapIdx) {
     auto ExHostBuf = createBuffer(
         IS, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, R.Size, R.Data.get());
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, R.Size, R.Data.data());
     if (!ExHostBuf)
       return ExHostBuf.takeError();
 
@@ -348,7 +507,7 @@ public:
     return llvm::Error::success();
   }
 
-  llvm::Error executeCommandBuffer(InvocationState &IS,
+  llvm::Error executeCommandBuffer(InvocationState &IS, ExecutionTimes &Times,
                                    VkPipelineStageFlags WaitMask = 0) {
     if (vkEndCommandBuffer(IS.CmdBuffer))
       return llvm::createStringError(std::errc::device_or_resource_busy,
@@ -366,10 +525,14 @@ public:
       return llvm::createStringError(std::errc::device_or_resource_busy,
                                      "Could not create fence.");
 
-    // Submit to the queue
-    if (vkQueueSubmit(IS.Queue, 1, &SubmitInfo, Fence))
-      return llvm::createStringError(std::errc::device_or_resource_busy,
-                                     "Failed to submit to queue.");
+    // Submit to the queue. Only the submission holds the queue, the wait for
+    // the fence doesn't keep other executions from submitting.
+    {
+      std::unique_lock<std::mutex> Lock = lockAndTime(*IS.Queue->Mutex, Times);
+      if (vkQueueSubmit(IS.Queue->Queue, 1, &SubmitInfo, Fence))
+        return llvm::createStringError(std::errc::device_or_resource_busy,
+                                       "Failed to submit to queue.");
+    }
     if (vkWaitForFences(IS.Device, 1, &Fence, VK_TRUE, UINT64_MAX))
       return llvm::createStringError(std::errc::device_or_resource_busy,
                                      "Failed waiting for fence.");
@@ -420,7 +583,7 @@ public:
     return llvm::Error::success();
   }
 
-  llvm::Error createDescriptorSets(Pipeline &P, InvocationState &IS) {
+  llvm::Error createPipelineLayout(Pipeline &P, InvocationState &IS) {
     for (const auto &S : P.Sets) {
       std::vector<VkDescriptorSetLayoutBinding> Bindings;
       uint32_t BindingIdx = 0;
@@ -440,7 +603,7 @@ public:
           VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
       LayoutCreateInfo.bindingCount = Bindings.size();
       LayoutCreateInfo.pBindings = Bindings.data();
-      llvm::outs() << "Binding " << Bindings.size() << " descriptors.\n";
+      progress() << "Binding " << Bindings.size() << " descriptors.\n";
       VkDescriptorSetLayout Layout;
       if (vkCreateDescriptorSetLayout(IS.Device, &LayoutCreateInfo, nullptr,
                                       &Layout))
@@ -458,7 +621,10 @@ public:
                                &IS.PipelineLayout))
       return llvm::createStringError(std::errc::device_or_resource_busy,
                                      "Failed to create pipeline layout.");
+    return llvm::Error::success();
+  }
 
+  llvm::Error createDescriptorSets(Pipeline &P, InvocationState &IS) {
     VkDescriptorSetAllocateInfo DSAllocInfo = {};
     DSAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     DSAllocInfo.descriptorPool = IS.Pool;
@@ -467,8 +633,8 @@ public:
     assert(IS.DescriptorSets.empty());
     IS.DescriptorSets.insert(IS.DescriptorSets.begin(),
                              IS.DescriptorSetLayouts.size(), VkDescriptorSet());
-    llvm::outs() << "Num Descriptor sets: " << IS.DescriptorSetLayouts.size()
-                 << "\n";
+    progress() << "Num Descriptor sets: " << IS.DescriptorSetLayouts.size()
+               << "\n";
     if (vkAllocateDescriptorSets(IS.Device, &DSAllocInfo,
                                  IS.DescriptorSets.data()))
       return llvm::createStringError(std::errc::device_or_resource_busy,
@@ -515,12 +681,12 @@ public:
           WDS.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
           WDS.pTexelBufferView = &IS.BufferViews.back();
         }
-        llvm::outs() << "Updating Descriptor [" << UAVIdx << "] { " << SetIdx
-                     << ", " << RIdx << " }\n";
+        progress() << "Updating Descriptor [" << UAVIdx << "] { " << SetIdx
+                   << ", " << RIdx << " }\n";
         WriteDescriptors.push_back(WDS);
       }
     }
-    llvm::outs() << "WriteDescriptors: " << WriteDescriptors.size() << "\n";
+    progress() << "WriteDescriptors: " << WriteDescriptors.size() << "\n";
     vkUpdateDescriptorSets(IS.Device, WriteDescriptors.size(),
                            WriteDescriptors.data(), 0, nullptr);
     return llvm::Error::success();
@@ -538,13 +704,6 @@ public:
   }
 
   llvm::Error createPipeline(Pipeline &P, InvocationState &IS) {
-    VkPipelineCacheCreateInfo CacheCreateInfo = {};
-    CacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    if (vkCreatePipelineCache(IS.Device, &CacheCreateInfo, nullptr,
-                              &IS.PipelineCache))
-      return llvm::createStringError(std::errc::device_or_resource_busy,
-                                     "Failed to create pipeline cache.");
-
     VkPipelineShaderStageCreateInfo StageInfo = {};
     StageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     StageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
@@ -563,7 +722,39 @@ public:
     return llvm::Error::success();
   }
 
+  // Uses the compiled pipeline for this program and layout if there is one,
+  // otherwise compiles and caches it.
+  llvm::Error getOrCreatePipeline(llvm::StringRef Program, Pipeline &P,
+                                  InvocationState &IS, ExecutionTimes &Times) {
+    uint64_t Key = getPipelineKey(Program, P);
+    std::unique_lock<std::mutex> Lock = lockAndTime(Mutex, Times);
+    auto It = Pipelines.find(Key);
+    if (It != Pipelines.end()) {
+      IS.Shader = It->second.Shader;
+      IS.DescriptorSetLayouts = It->second.DescriptorSetLayouts;
+      IS.PipelineLayout = It->second.PipelineLayout;
+      IS.Pipeline = It->second.Pipeline;
+      progress() << "Reusing compiled pipeline.\n";
+      return llvm::Error::success();
+    }
+
+    if (auto Err = createPipelineLayout(P, IS))
+      return Err;
+    progress() << "Pipeline layout created.\n";
+    if (auto Err = createShaderModule(Program, IS))
+      return Err;
+    progress() << "Shader module created.\n";
+    if (auto Err = createPipeline(P, IS))
+      return Err;
+    progress() << "Compute pipeline created.\n";
+    Pipelines[Key] = CompiledPipeline{IS.Shader, IS.DescriptorSetLayouts,
+                                      IS.PipelineLayout, IS.Pipeline};
+    return llvm::Error::success();
+  }
+
   llvm::Error createComputeCommands(Pipeline &P, InvocationState &IS) {
+    if (IS.TimestampPool)
+      vkCmdResetQueryPool(IS.CmdBuffer, IS.TimestampPool, 0, 2);
     for (auto &UAV : IS.UAVs) {
       VkBufferMemoryBarrier Barrier = {};
       Barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
@@ -583,8 +774,14 @@ public:
     vkCmdBindDescriptorSets(IS.CmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
                             IS.PipelineLayout, 0, IS.DescriptorSets.size(),
                             IS.DescriptorSets.data(), 0, 0);
+    if (IS.TimestampPool)
+      vkCmdWriteTimestamp(IS.CmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                          IS.TimestampPool, 0);
     vkCmdDispatch(IS.CmdBuffer, P.DispatchSize[0], P.DispatchSize[1],
                   P.DispatchSize[2]);
+    if (IS.TimestampPool)
+      vkCmdWriteTimestamp(IS.CmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                          IS.TimestampPool, 1);
 
     for (auto &UAV : IS.UAVs) {
       VkBufferMemoryBarrier Barrier = {};
@@ -632,7 +829,7 @@ public:
         Range.offset = 0;
         Range.size = VK_WHOLE_SIZE;
         vkInvalidateMappedMemoryRanges(IS.Device, 1, &Range);
-        memcpy(R.Data.get(), Mapped, R.Size);
+        memcpy(R.Data.data(), Mapped, R.Size);
         vkUnmapMemory(IS.Device, IS.UAVs[UAVIdx].Host.Memory);
         UAVIdx++;
       }
@@ -640,8 +837,28 @@ public:
     return llvm::Error::success();
   }
 
+  void readTimestamps(InvocationState &IS, ExecutionTimes &Times) {
+    if (!IS.TimestampPool)
+      return;
+    uint64_t Ticks[2];
+    if (vkGetQueryPoolResults(IS.Device, IS.TimestampPool, 0, 2, sizeof(Ticks),
+                              Ticks, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT |
+                                  VK_QUERY_RESULT_WAIT_BIT))
+      return;
+    uint64_t Mask = TimestampValidBits >= 64
+                        ? ~uint64_t(0)
+                        : (uint64_t(1) << TimestampValidBits) - 1;
+    uint64_t Elapsed = (Ticks[1] - Ticks[0]) & Mask;
+    // timestampPeriod is the number of nanoseconds per tick.
+    Times.GPUMilliseconds =
+        static_cast<double>(Elapsed) * Props.limits.timestampPeriod / 1e6;
+  }
+
+  // Releases the objects created for a single invocation. The device and
+  // compiled pipeline are kept for later invocations. The invocation's
+  // submissions have completed, as executeCommandBuffer waits for them.
   llvm::Error cleanup(InvocationState &IS) {
-    vkQueueWaitIdle(IS.Queue);
     for (auto &V : IS.BufferViews)
       vkDestroyBufferView(IS.Device, V, nullptr);
 
@@ -652,66 +869,52 @@ public:
       vkFreeMemory(IS.Device, R.Host.Memory, nullptr);
     }
 
-    vkDestroyPipeline(IS.Device, IS.Pipeline, nullptr);
-
-    vkDestroyShaderModule(IS.Device, IS.Shader, nullptr);
-
-    vkDestroyPipelineCache(IS.Device, IS.PipelineCache, nullptr);
-
-    vkDestroyPipelineLayout(IS.Device, IS.PipelineLayout, nullptr);
-
-    for (auto &L : IS.DescriptorSetLayouts)
-      vkDestroyDescriptorSetLayout(IS.Device, L, nullptr);
-
     vkDestroyDescriptorPool(IS.Device, IS.Pool, nullptr);
-
-    vkDestroyCommandPool(IS.Device, IS.CmdPool, nullptr);
-    vkDestroyDevice(IS.Device, nullptr);
     return llvm::Error::success();
   }
 
-  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P) override {
+  llvm::Error executeProgram(llvm::StringRef Program, Pipeline &P,
+                             ExecutionTimes &Times) override {
     InvocationState State;
-    if (auto Err = createDevice(State))
+    auto Release = llvm::make_scope_exit([&] { releaseContext(State); });
+    if (auto Err = createDevice(State, Times))
       return Err;
-    llvm::outs() << "Physical device created.\n";
+    progress() << "Logical device ready.\n";
     if (auto Err = createCommandBuffer(State))
       return Err;
-    llvm::outs() << "Copy command buffer created.\n";
+    progress() << "Copy command buffer created.\n";
     if (auto Err = createBuffers(P, State))
       return Err;
-    llvm::outs() << "Memory buffers created.\n";
-    if (auto Err = executeCommandBuffer(State))
+    progress() << "Memory buffers created.\n";
+    if (auto Err = executeCommandBuffer(State, Times))
       return Err;
-    llvm::outs() << "Executed copy command buffer.\n";
+    progress() << "Executed copy command buffer.\n";
     if (auto Err = createCommandBuffer(State))
       return Err;
-    llvm::outs() << "Execute command buffer created.\n";
+    progress() << "Execute command buffer created.\n";
     if (auto Err = createDescriptorPool(P, State))
       return Err;
-    llvm::outs() << "Descriptor pool created.\n";
-    if (auto Err = createDescriptorSets(P, State))
-      return Err;
-    llvm::outs() << "Descriptor sets created.\n";
-    if (auto Err = createShaderModule(Program, State))
+    progress() << "Descriptor pool created.\n";
+    if (auto Err = getOrCreatePipeline(Program, P, State, Times))
       return Err;
-    llvm::outs() << "Shader module created.\n";
-    if (auto Err = createPipeline(P, State))
+    if (auto Err = createDescriptorSets(P, State))
       return Err;
-    llvm::outs() << "Compute pipeline created.\n";
+    progress() << "Descriptor sets created.\n";
     if (auto Err = createComputeCommands(P, State))
       return Err;
-    llvm::outs() << "Compute commands created.\n";
-    if (auto Err = executeCommandBuffer(State, VK_PIPELINE_STAGE_TRANSFER_BIT))
+    progress() << "Compute commands created.\n";
+    if (auto Err = executeCommandBuffer(State, Times,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT))
       return Err;
-    llvm::outs() << "Executed compute command buffer.\n";
+    progress() << "Executed compute command buffer.\n";
+    readTimestamps(State, Times);
     if (auto Err = readBackData(P, State))
       return Err;
-    llvm::outs() << "Compute pipeline created.\n";
+    progress() << "Compute pipeline created.\n";
 
     if (auto Err = cleanup(State))
       return Err;
-    llvm::outs() << "Cleanup complete.\n";
+    progress() << "Cleanup complete.\n";
     return llvm::Error::success();
   }
 };
@@ -722,7 +925,11 @@ private:
   llvm::SmallVector<std::shared_ptr<VKDevice>> Devices;
 
   VKContext() = default;
-  ~VKContext() { vkDestroyInstance(Instance, NULL); }
+  ~VKContext() {
+    for (auto &D : Devices)
+      D->releaseDevice();
+    vkDestroyInstance(Instance, NULL);
+  }
   VKContext(const VKContext &) = delete;
 
 public:
@@ -0,0 +1,164 @@
+//===- Compiler.cpp - In-Process HLSL Compilation -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Compiler/Compiler.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticIDs.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Driver/Compilation.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Driver/Job.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/TargetParser/Host.h"
+
+using namespace offloadtest;
+
+ShaderCompiler::ShaderCompiler(std::string ClangPath, llvm::raw_ostream &DiagOS)
+    : ClangPath(std::move(ClangPath)), DiagOS(DiagOS) {
+  // DXIL and SPIR-V are emitted by the DirectX and SPIR-V backends.
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+}
+
+std::string ShaderCompiler::getClangPathForTool(llvm::StringRef ToolPath) {
+  llvm::SmallString<256> Path(llvm::sys::path::parent_path(ToolPath));
+  llvm::sys::path::append(Path, "clang");
+  return std::string(Path);
+}
+
+llvm::Expected<llvm::StringRef>
+ShaderCompiler::compile(llvm::StringRef Path,
+                        llvm::ArrayRef<std::string> Args) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Source =
+      llvm::MemoryBuffer::getFile(Path);
+  if (!Source)
+    return llvm::createFileError(Path, Source.getError());
+  llvm::SmallString<256> Key;
+  llvm::raw_svector_ostream OS(Key);
+  OS << llvm::xxHash64((*Source)->getBuffer()) << '\0' << Path << '\0';
+  for (const std::string &A : Args)
+    OS << A << '\0';
+  uint64_t Hash = llvm::xxHash64(Key);
+
+  auto It = Cache.find(Hash);
+  if (It != Cache.end())
+    return It->second->getBuffer();
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> Object =
+      compileUncached(Path, Args);
+  if (!Object)
+    return Object.takeError();
+  llvm::StringRef Result = (*Object)->getBuffer();
+  Cache[Hash] = std::move(*Object);
+  return Result;
+}
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+ShaderCompiler::compileUncached(llvm::StringRef Path,
+                                llvm::ArrayRef<std::string> Args) {
+  // The driver writes the final output to a file when a step after the
+  // frontend, such as validation, runs as a separate tool.
+  llvm::SmallString<128> OutputPath;
+  if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+          "offloadtest-shader", "o", OutputPath))
+    return llvm::errorCodeToError(EC);
+  llvm::FileRemover RemoveOutput(OutputPath);
+
+  llvm::SmallVector<const char *> Argv = {ClangPath.c_str(),
+                                          "--driver-mode=dxc"};
+  for (const std::string &A : Args)
+    Argv.push_back(A.c_str());
+  std::string PathStr = Path.str();
+  Argv.append({"-Fo", OutputPath.c_str(), PathStr.c_str()});
+
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts =
+      new clang::DiagnosticOptions();
+  clang::TextDiagnosticPrinter DiagPrinter(DiagOS, &*DiagOpts);
+  clang::DiagnosticsEngine Diags(new clang::DiagnosticIDs(), &*DiagOpts,
+                                 &DiagPrinter, /*ShouldOwnClient=*/false);
+
+  clang::driver::Driver D(ClangPath, llvm::sys::getDefaultTargetTriple(),
+                          Diags, "HLSL compiler");
+  std::unique_ptr<clang::driver::Compilation> C(D.BuildCompilation(Argv));
+  if (!C || C->containsError() || Diags.hasErrorOccurred())
+    return llvm::createStringError(std::errc::invalid_argument,
+                                   "Invalid HLSL compiler arguments for %s",
+                                   PathStr.c_str());
+  auto CleanupTempFiles =
+      llvm::make_scope_exit([&C] { C->CleanupFileList(C->getTempFiles()); });
+
+  llvm::SmallVector<char, 0> Object;
+  bool InMemory = false;
+  const clang::driver::JobList &Jobs = C->getJobs();
+  for (auto JobIt = Jobs.begin(); JobIt != Jobs.end(); ++JobIt) {
+    const clang::driver::Command &Job = *JobIt;
+    const llvm::opt::ArgStringList &JobArgs = Job.getArguments();
+    if (JobArgs.empty() || llvm::StringRef(JobArgs[0]) != "-cc1") {
+      std::string ErrMsg;
+      bool ExecutionFailed = false;
+      if (Job.Execute({}, &ErrMsg, &ExecutionFailed) != 0 || ExecutionFailed)
+        return llvm::createStringError(
+            std::errc::executable_format_error, "%s failed for %s%s%s",
+            Job.getCreator().getName(), PathStr.c_str(),
+            ErrMsg.empty() ? "" : ": ", ErrMsg.c_str());
+      continue;
+    }
+
+    auto Invocation = std::make_shared<clang::CompilerInvocation>();
+    if (!clang::CompilerInvocation::CreateFromArgs(
+            *Invocation, llvm::ArrayRef(JobArgs).drop_front(), Diags,
+            ClangPath.c_str()))
+      return llvm::createStringError(std::errc::invalid_argument,
+                                     "Invalid HLSL compiler arguments for %s",
+                                     PathStr.c_str());
+    clang::CompilerInstance CI;
+    CI.setInvocation(std::move(Invocation));
+    CI.createDiagnostics(*llvm::vfs::getRealFileSystem(), &DiagPrinter,
+                         /*ShouldOwnClient=*/false);
+    // The output of the last step is kept in memory rather than written out
+    // and read back.
+    if (std::next(JobIt) == Jobs.end()) {
+      CI.setOutputStream(std::make_unique<llvm::raw_svector_ostream>(Object));
+      InMemory = true;
+    }
+    clang::EmitObjAction Act;
+    if (!CI.ExecuteAction(Act))
+      return llvm::createStringError(std::errc::executable_format_error,
+                                     "Failed to compile %s", PathStr.c_str());
+  }
+
+  if (InMemory)
+    return std::make_unique<llvm::SmallVectorMemoryBuffer>(
+        std::move(Object), PathStr, /*RequiresNullTerminator=*/false);
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Output =
+      llvm::MemoryBuffer::getFile(OutputPath, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!Output)
+    return llvm::createFileError(OutputPath, Output.getError());
+  return std::move(*Output);
+}
@@ -12,34 +12,66 @@
 #include "Image/Image.h"
 #include "Image/Color.h"
 
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/SwapByteOrder.h"
 
 #include <png.h>
 
 #include <algorithm>
+#include <cstring>
 #include <limits.h>
 #include <stdio.h>
+#include <vector>
 
 using namespace offloadtest;
 
+// Pixels compareImages gives each parallel task. Tiles are fixed so results,
+// including the rounding of the comparators' sums, don't depend on the number
+// of threads.
+static constexpr uint64_t CompareTilePixels = 1u << 16;
+
+// Shortest run of identical pixels compareImages skips converting when it is
+// surrounded by differing pixels.
+static constexpr size_t MinIdenticalRun = 16;
+
+// Bytes of 16-bit rows writePNG converts at a time, so it doesn't need a
+// converted copy of the whole image.
+static constexpr uint64_t WriteChunkBytes = 1u << 20;
+
+// Converts Rows rows of Src, starting at SrcRow, to the first rows of Dst.
 template <typename DstType, typename SrcType>
-void TranslatePixelData(Image &Dst, ImageRef Src, bool ForWrite) {
-  uint64_t Pixels = Dst.getHeight() * Dst.getWidth();
+void TranslatePixelData(Image &Dst, ImageRef Src, bool ForWrite,
+                        uint32_t SrcRow, uint32_t Rows) {
+  uint64_t Pixels = static_cast<uint64_t>(Rows) * Src.getWidth();
   uint32_t CopiedChannels = std::min(Dst.getChannels(), Src.getChannels());
   DstType *DstPtr = reinterpret_cast<DstType *>(Dst.data());
-  const SrcType *SrcPtr = reinterpret_cast<const SrcType *>(Src.data());
+  const SrcType *SrcPtr = reinterpret_cast<const SrcType *>(Src.data()) +
+                          static_cast<uint64_t>(SrcRow) * Src.getWidth() *
+                              Src.getChannels();
+  // 8- and 16-bit values are converted to float through a table.
+  constexpr bool UseTable = std::is_same_v<DstType, float> &&
+                            (std::is_same_v<SrcType, uint8_t> ||
+                             std::is_same_v<SrcType, uint16_t>);
+  const float *Table = nullptr;
+  if constexpr (UseTable)
+    Table = ColorUtils::getFloatTable<SrcType>();
   for (uint64_t I = 0; I < Pixels; ++I) {
     for (uint32_t J = 0; J < CopiedChannels; ++J, ++SrcPtr, ++DstPtr) {
-      *DstPtr = ColorUtils::convertColor<DstType>(*SrcPtr);
+      if constexpr (UseTable)
+        *DstPtr = Table[*SrcPtr];
+      else
+        *DstPtr = ColorUtils::convertColor<DstType>(*SrcPtr);
 
       if (ForWrite && sizeof(DstType) > 1 && !llvm::sys::IsBigEndianHost)
         llvm::sys::swapByteOrder(*DstPtr);
     }
     // If the destination has more channels fill it with saturated values.
-    for (uint32_t J = 0; J < CopiedChannels - Dst.getChannels();
+    for (uint32_t J = 0; J < Dst.getChannels() - CopiedChannels;
          ++J, ++DstPtr) {
       if constexpr (std::is_floating_point<DstType>())
         *DstPtr = 1.0;
@@ -47,61 +79,62 @@ void TranslatePixelData(Image &Dst, ImageRef Src, bool ForWrite) {
         *DstPtr = std::numeric_limits<DstType>::max();
     }
     // If the source has more channels skip them.
-    for (uint32_t J = 0; J < CopiedChannels - Src.getChannels(); ++J, ++SrcPtr)
-      ;
+    SrcPtr += Src.getChannels() - CopiedChannels;
   }
 }
 
 template <typename SrcType>
-void translatePixelSrc(Image &Dst, ImageRef Src, bool ForWrite) {
+void translatePixelSrc(Image &Dst, ImageRef Src, bool ForWrite,
+                       uint32_t SrcRow, uint32_t Rows) {
 
   switch (Dst.getDepth()) {
   case 1:
     assert(!Dst.isFloat() && "No float8 support!");
-    TranslatePixelData<uint8_t, SrcType>(Dst, Src, ForWrite);
+    TranslatePixelData<uint8_t, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 2:
     assert(!Dst.isFloat() && "No float16 support!");
-    TranslatePixelData<uint16_t, SrcType>(Dst, Src, ForWrite);
+    TranslatePixelData<uint16_t, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 4:
     if (Dst.isFloat())
-      TranslatePixelData<float, SrcType>(Dst, Src, ForWrite);
+      TranslatePixelData<float, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     else
-      TranslatePixelData<uint32_t, SrcType>(Dst, Src, ForWrite);
+      TranslatePixelData<uint32_t, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 8:
     if (Dst.isFloat())
-      TranslatePixelData<double, SrcType>(Dst, Src, ForWrite);
+      TranslatePixelData<double, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     else
-      TranslatePixelData<uint64_t, SrcType>(Dst, Src, ForWrite);
+      TranslatePixelData<uint64_t, SrcType>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   default:
     llvm_unreachable("Destination depth out of expected range.");
   }
 }
 
-void translatePixels(Image &Dst, ImageRef Src, bool ForWrite = false) {
+void translatePixels(Image &Dst, ImageRef Src, bool ForWrite, uint32_t SrcRow,
+                     uint32_t Rows) {
   switch (Src.getDepth()) {
   case 1:
     assert(!Src.isFloat() && "No float8 support!");
-    translatePixelSrc<uint8_t>(Dst, Src, ForWrite);
+    translatePixelSrc<uint8_t>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 2:
     assert(!Src.isFloat() && "No float16 support!");
-    translatePixelSrc<uint16_t>(Dst, Src, ForWrite);
+    translatePixelSrc<uint16_t>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 4:
     if (Src.isFloat())
-      translatePixelSrc<float>(Dst, Src, ForWrite);
+      translatePixelSrc<float>(Dst, Src, ForWrite, SrcRow, Rows);
     else
-      translatePixelSrc<uint32_t>(Dst, Src, ForWrite);
+      translatePixelSrc<uint32_t>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   case 8:
     if (Src.isFloat())
-      translatePixelSrc<double>(Dst, Src, ForWrite);
+      translatePixelSrc<double>(Dst, Src, ForWrite, SrcRow, Rows);
     else
-      translatePixelSrc<uint64_t>(Dst, Src, ForWrite);
+      translatePixelSrc<uint64_t>(Dst, Src, ForWrite, SrcRow, Rows);
     break;
   default:
     llvm_unreachable("Source depth out of expected range.");
@@ -112,11 +145,16 @@ Image Image::translateImage(ImageRef Src, uint8_t Depth, uint8_t Channels,
                             bool Float) {
   Image NewImage =
       Image(Src.getHeight(), Src.getWidth(), Depth, Channels, Float);
-  translatePixels(NewImage, Src);
+  translatePixels(NewImage, Src, /*ForWrite=*/false, 0, Src.getHeight());
   return NewImage;
 }
 
-llvm::Error writePNGImpl(ImageRef Img, llvm::StringRef OutputPath) {
+// Writes Img as a PNG with Depth bytes per channel. GetRow returns the data
+// of a row in PNG's format; it is called for each row from the last to the
+// first.
+llvm::Error
+writePNGImpl(ImageRef Img, uint8_t Depth, llvm::StringRef OutputPath,
+             llvm::function_ref<const char *(uint32_t Row)> GetRow) {
   png_structp PNG =
       png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   if (!PNG)
@@ -141,7 +179,7 @@ llvm::Error writePNGImpl(ImageRef Img, llvm::StringRef OutputPath) {
   assert((Img.getChannels() == 3 || Img.getChannels() == 4) &&
          "Only support RGB and RGBA images.");
   png_init_io(PNG, F);
-  png_set_IHDR(PNG, PNGInfo, Img.getWidth(), Img.getHeight(), Img.getBitDepth(),
+  png_set_IHDR(PNG, PNGInfo, Img.getWidth(), Img.getHeight(), Depth * 8,
                ImgFormat, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
                PNG_FILTER_TYPE_BASE);
   png_colorp ColorP =
@@ -153,33 +191,41 @@ llvm::Error writePNGImpl(ImageRef Img, llvm::StringRef OutputPath) {
   png_write_info(PNG, PNGInfo);
   png_set_packing(PNG);
 
-  png_bytepp Rows =
-      (png_bytepp)png_malloc(PNG, Img.getHeight() * sizeof(png_bytep));
-  uint64_t RowSize = Img.getWidth() * Img.getChannels() * Img.getDepth();
-  // Step one row back from the end
-  const uint8_t *Row = reinterpret_cast<const uint8_t *>(Img.data()) +
-                       (RowSize * Img.getHeight()) - RowSize;
-  for (uint32_t I = 0; I < Img.getHeight(); ++I, Row -= RowSize)
-    Rows[I] = const_cast<png_bytep>(Row);
-
-  png_write_image(PNG, Rows);
+  for (uint32_t Row = Img.getHeight(); Row > 0; --Row)
+    png_write_row(PNG, reinterpret_cast<png_const_bytep>(GetRow(Row - 1)));
   png_write_end(PNG, PNGInfo);
   png_free(PNG, ColorP);
   return llvm::Error::success();
 }
 
 llvm::Error Image::writePNG(ImageRef Img, llvm::StringRef Path) {
-  uint32_t NewDepth = std::min(static_cast<uint32_t>(Img.getDepth()), 2u);
+  uint64_t RowSize =
+      static_cast<uint64_t>(Img.getWidth()) * Img.getChannels() *
+      Img.getDepth();
+  if (Img.getDepth() == 1)
+    return writePNGImpl(Img, 1, Path, [&](uint32_t Row) {
+      return Img.data() + Row * RowSize;
+    });
 
   // If the image depth is > 1, we need to translate it to get the right
-  // endianness.
-  if (Img.getDepth() > 1) {
-    Image Translated = Image(Img.getHeight(), Img.getWidth(), NewDepth,
-                             Img.getChannels(), false);
-    translatePixels(Translated, Img, /* ForWrite */ true);
-    return writePNGImpl(Translated, Path);
-  }
-  return writePNGImpl(Img, Path);
+  // endianness. Rows are translated a chunk at a time as they are written.
+  uint64_t ChunkRowSize =
+      static_cast<uint64_t>(Img.getWidth()) * Img.getChannels() * 2;
+  uint64_t RowsPerChunk = std::max<uint64_t>(
+      1, WriteChunkBytes / std::max<uint64_t>(ChunkRowSize, 1));
+  uint32_t ChunkRows = static_cast<uint32_t>(
+      std::min<uint64_t>(RowsPerChunk, Img.getHeight()));
+  Image Chunk(ChunkRows, Img.getWidth(), 2, Img.getChannels(), false);
+  // The chunk holds rows ChunkBegin to ChunkBegin + ChunkRows.
+  uint32_t ChunkBegin = Img.getHeight();
+  return writePNGImpl(Img, 2, Path, [&](uint32_t Row) {
+    if (Row < ChunkBegin) {
+      uint32_t Rows = std::min(ChunkRows, Row + 1);
+      ChunkBegin = Row + 1 - Rows;
+      translatePixels(Chunk, Img, /*ForWrite=*/true, ChunkBegin, Rows);
+    }
+    return Chunk.data() + (Row - ChunkBegin) * ChunkRowSize;
+  });
 }
 
 llvm::Expected<Image> Image::loadPNG(llvm::StringRef Path) {
@@ -195,15 +241,16 @@ llvm::Expected<Image> Image::loadPNG(llvm::StringRef Path) {
 
   PNG.format = PNG_FORMAT_RGB;
   size_t Size = PNG_IMAGE_SIZE(PNG);
-  std::unique_ptr<char[]> Buffer = std::make_unique<char[]>(Size);
+  // Left uninitialized, as libpng writes every byte.
+  std::unique_ptr<char[]> Buffer(new char[Size]);
 
   if (png_image_finish_read(&PNG, NULL /*background*/,
                             reinterpret_cast<png_bytep>(Buffer.get()),
                             0 /*row_stride*/, NULL /*colormap*/) == 0)
     return llvm::createStringError(std::errc::io_error,
                                    "Failed reading PNG data from file");
-  uint32_t BytesPerPixel =
-      static_cast<uint32_t>(Size / (PNG.height * PNG.width));
+  uint32_t BytesPerPixel = static_cast<uint32_t>(
+      Size / (static_cast<uint64_t>(PNG.height) * PNG.width));
   uint32_t Channels = 3;
   Image Result =
       Image(PNG.height, PNG.width, /*Depth*/ BytesPerPixel / Channels, Channels,
@@ -211,9 +258,85 @@ llvm::Expected<Image> Image::loadPNG(llvm::StringRef Path) {
   return Result;
 }
 
+// Converts Count pixels of type T at Src, of an image with Channels channels,
+// to planar float RGB.
+template <typename T>
+static void loadPlanarTyped(const char *Src, uint8_t Channels, size_t Count,
+                            float *const Out[3]) {
+  const T *Ptr = reinterpret_cast<const T *>(Src);
+  if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>) {
+    const float *Table = ColorUtils::getFloatTable<T>();
+    for (size_t I = 0; I < Count; ++I, Ptr += Channels)
+      for (size_t C = 0; C < 3; ++C)
+        Out[C][I] = Table[Ptr[C]];
+  } else {
+    for (size_t I = 0; I < Count; ++I, Ptr += Channels)
+      for (size_t C = 0; C < 3; ++C)
+        Out[C][I] = ColorUtils::convertColor<float>(Ptr[C]);
+  }
+}
+
+void Image::loadPlanar(ImageRef Img, const char *Src, size_t Count,
+                       float *const Out[3]) {
+  uint8_t Channels = Img.getChannels();
+  switch (Img.getDepth()) {
+  case 1:
+    assert(!Img.isFloat() && "No float8 support!");
+    loadPlanarTyped<uint8_t>(Src, Channels, Count, Out);
+    break;
+  case 2:
+    assert(!Img.isFloat() && "No float16 support!");
+    loadPlanarTyped<uint16_t>(Src, Channels, Count, Out);
+    break;
+  case 4:
+    if (Img.isFloat())
+      loadPlanarTyped<float>(Src, Channels, Count, Out);
+    else
+      loadPlanarTyped<uint32_t>(Src, Channels, Count, Out);
+    break;
+  case 8:
+    if (Img.isFloat())
+      loadPlanarTyped<double>(Src, Channels, Count, Out);
+    else
+      loadPlanarTyped<uint64_t>(Src, Channels, Count, Out);
+    break;
+  default:
+    llvm_unreachable("Source depth out of expected range.");
+  }
+}
+
+// Returns how many of the Count pixels of PixelSize bytes at L and R are
+// identical before the first that differs. Blocks of pixels are compared
+// first, so memcmp's vectorized implementation does most of the work.
+static size_t countIdenticalPixels(const char *L, const char *R,
+                                   size_t PixelSize, size_t Count) {
+  constexpr size_t BlockPixels = 64;
+  size_t I = 0;
+  while (Count - I >= BlockPixels &&
+         memcmp(L + I * PixelSize, R + I * PixelSize,
+                BlockPixels * PixelSize) == 0)
+    I += BlockPixels;
+  while (I < Count &&
+         memcmp(L + I * PixelSize, R + I * PixelSize, PixelSize) == 0)
+    ++I;
+  return I;
+}
+
+// Returns how many of the Count pixels of PixelSize bytes at L and R differ
+// before the first that is identical.
+static size_t countDifferentPixels(const char *L, const char *R,
+                                   size_t PixelSize, size_t Count) {
+  size_t I = 0;
+  while (I < Count &&
+         memcmp(L + I * PixelSize, R + I * PixelSize, PixelSize) != 0)
+    ++I;
+  return I;
+}
+
 llvm::Error
 Image::compareImages(ImageRef LHS, ImageRef RHS,
-                     llvm::MutableArrayRef<ImageComparatorRef> Comparators) {
+                     llvm::MutableArrayRef<ImageComparatorRef> Comparators,
+                     const float *const LHSLAB[3]) {
   if (LHS.getHeight() != RHS.getHeight() || LHS.getWidth() != RHS.getWidth())
     return llvm::createStringError(
         std::errc::not_supported,
@@ -222,23 +345,137 @@ Image::compareImages(ImageRef LHS, ImageRef RHS,
          "Cannot operate on images with less than 3 channels.");
   assert(RHS.getChannels() >= 3 &&
          "Cannot operate on images with less than 3 channels.");
-  uint32_t CmpDepth = 4;
-  uint32_t CmpChannels = 3u;
-
-  Image L = Image::translateImage(LHS, CmpDepth, CmpChannels, true);
-  Image R = Image::translateImage(RHS, CmpDepth, CmpChannels, true);
-
-  const float *LPtr = reinterpret_cast<const float *>(L.data());
-  const float *RPtr = reinterpret_cast<const float *>(R.data());
-
-  uint64_t PixelCt = static_cast<uint64_t>(LHS.getHeight()) *
-                     static_cast<uint64_t>(LHS.getWidth());
-  for (uint64_t I = 0; I < PixelCt; ++I, LPtr += 3, RPtr += 3) {
-    Color L = Color(LPtr[0], LPtr[1], LPtr[2]);
-    Color R = Color(RPtr[0], RPtr[1], RPtr[2]);
-    for (auto &Cmp : Comparators)
-      Cmp.processPixel(L, R);
+  uint32_t Height = LHS.getHeight();
+  uint32_t Width = LHS.getWidth();
+  size_t LPixelSize = LHS.getDepth() * LHS.getChannels();
+  size_t RPixelSize = RHS.getDepth() * RHS.getChannels();
+  // Pixels can only be compared byte for byte if both images store them the
+  // same way.
+  bool SameFormat = LHS.getDepth() == RHS.getDepth() &&
+                    LHS.getChannels() == RHS.getChannels() &&
+                    LHS.isFloat() == RHS.isFloat();
+
+  // Pixels that are byte-identical in both images are handed to the
+  // comparators' processIdentical without being converted. The others are
+  // converted to planar float channels for processSpan.
+  auto CompareRows = [&](llvm::MutableArrayRef<ImageComparatorRef> Cmps,
+                         uint32_t Begin, uint32_t End) {
+    std::vector<float> Planes(6 * static_cast<size_t>(Width));
+    float *Plane[6];
+    for (size_t P = 0; P < 6; ++P)
+      Plane[P] = Planes.data() + P * Width;
+    float *const LPlanes[] = {Plane[0], Plane[1], Plane[2]};
+    float *const RPlanes[] = {Plane[3], Plane[4], Plane[5]};
+    const float *const LRow[] = {Plane[0], Plane[1], Plane[2]};
+    const float *const RRow[] = {Plane[3], Plane[4], Plane[5]};
+
+    // Index is the position of the span's first pixel in the image.
+    auto CompareSpan = [&](const char *LPtr, const char *RPtr, size_t Count,
+                           uint64_t Index) {
+      loadPlanar(LHS, LPtr, Count, LPlanes);
+      loadPlanar(RHS, RPtr, Count, RPlanes);
+      if (!LHSLAB) {
+        for (auto &Cmp : Cmps)
+          Cmp.processSpan(LRow, RRow, Count);
+        return;
+      }
+      const float *const LLAB[] = {LHSLAB[0] + Index, LHSLAB[1] + Index,
+                                   LHSLAB[2] + Index};
+      for (auto &Cmp : Cmps)
+        Cmp.processSpanLAB(LRow, LLAB, RRow, Count);
+    };
+    auto SkipIdentical = [&](const char *Ptr, size_t Count) {
+      bool Loaded = false;
+      for (auto &Cmp : Cmps) {
+        if (Cmp.processIdentical(Count))
+          continue;
+        if (!Loaded)
+          loadPlanar(LHS, Ptr, Count, LPlanes);
+        Loaded = true;
+        Cmp.processSpan(LRow, LRow, Count);
+      }
+    };
+
+    for (auto &Cmp : Cmps)
+      Cmp.setRow(Begin);
+    for (uint32_t Row = Begin; Row < End; ++Row) {
+      const char *LPtr =
+          LHS.data() + static_cast<uint64_t>(Row) * Width * LPixelSize;
+      const char *RPtr =
+          RHS.data() + static_cast<uint64_t>(Row) * Width * RPixelSize;
+      uint64_t RowIndex = static_cast<uint64_t>(Row) * Width;
+      if (!SameFormat) {
+        CompareSpan(LPtr, RPtr, Width, RowIndex);
+        continue;
+      }
+      for (size_t X = 0; X < Width;) {
+        size_t Offset = X * LPixelSize;
+        size_t Same = countIdenticalPixels(LPtr + Offset, RPtr + Offset,
+                                           LPixelSize, Width - X);
+        if (Same)
+          SkipIdentical(LPtr + Offset, Same);
+        X += Same;
+        // Identical runs shorter than MinIdenticalRun between differing
+        // pixels are compared along with them, as splitting the span costs
+        // more than converting them.
+        size_t SpanEnd = X;
+        while (SpanEnd < Width) {
+          Offset = SpanEnd * LPixelSize;
+          SpanEnd += countDifferentPixels(LPtr + Offset, RPtr + Offset,
+                                          LPixelSize, Width - SpanEnd);
+          Offset = SpanEnd * LPixelSize;
+          size_t Gap = countIdenticalPixels(
+              LPtr + Offset, RPtr + Offset, LPixelSize,
+              std::min<size_t>(MinIdenticalRun, Width - SpanEnd));
+          if (Gap == MinIdenticalRun || SpanEnd + Gap == Width)
+            break;
+          SpanEnd += Gap;
+        }
+        if (SpanEnd > X)
+          CompareSpan(LPtr + X * LPixelSize, RPtr + X * RPixelSize,
+                      SpanEnd - X, RowIndex + X);
+        X = SpanEnd;
+      }
+    }
+  };
+
+  uint32_t TileRows = static_cast<uint32_t>(
+      std::max<uint64_t>(1, CompareTilePixels / std::max(Width, 1u)));
+  uint32_t NumTiles = llvm::divideCeil(Height, TileRows);
+
+  // The comparators process the first tile themselves and clones of them
+  // process the others, then the clones are merged back in order.
+  std::vector<std::vector<ImageComparatorRef>> Clones;
+  for (uint32_t Tile = 1; Tile < NumTiles; ++Tile) {
+    std::vector<ImageComparatorRef> &TileCmps = Clones.emplace_back();
+    for (auto &Cmp : Comparators) {
+      ImageComparatorRef Clone = Cmp.clone();
+      if (!Clone)
+        break;
+      TileCmps.push_back(std::move(Clone));
+    }
+    if (TileCmps.size() != Comparators.size()) {
+      Clones.clear();
+      break;
+    }
+  }
+  if (Clones.empty()) {
+    CompareRows(Comparators, 0, Height);
+    return llvm::Error::success();
   }
 
+  llvm::parallelFor(0, NumTiles, [&](size_t Tile) {
+    uint32_t Begin = Tile * TileRows;
+    uint32_t End = static_cast<uint32_t>(
+        std::min<uint64_t>(Height, static_cast<uint64_t>(Begin) + TileRows));
+    if (Tile == 0)
+      CompareRows(Comparators, Begin, End);
+    else
+      CompareRows(Clones[Tile - 1], Begin, End);
+  });
+  for (auto &TileCmps : Clones)
+    for (size_t I = 0; I < Comparators.size(); ++I)
+      Comparators[I].merge(TileCmps[I]);
+
   return llvm::Error::success();
 }
@@ -0,0 +1,217 @@
+//===- ImageCache.cpp - Converted Golden Image Cache ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Each entry is a single file, mapped and used in place, so its fields are in
+// host byte order. The decoded pixels and each L*a*b* plane are 64-byte
+// aligned.
+//
+//   Entry:  Header Pixels[Height * Width] LAB[3][Height * Width]
+//   Header: "OTLC" Version:u32 Hash:u64 Height:u32 Width:u32 Depth:u8
+//           Channels:u8 IsFloat:u8
+//
+// Hash is the xxHash64 of the PNG file, which also names the entry.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Image/ImageCache.h"
+#include "Image/Color.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace offloadtest;
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "OTLC";
+// Bumped whenever the layout or the conversion to L*a*b* changes, so old
+// entries become misses.
+constexpr uint32_t Version = 1;
+constexpr uint64_t Alignment = 64;
+
+struct EntryHeader {
+  char Magic[4];
+  uint32_t Version;
+  uint64_t Hash;
+  uint32_t Height;
+  uint32_t Width;
+  uint8_t Depth;
+  uint8_t Channels;
+  uint8_t IsFloat;
+};
+
+struct EntryLayout {
+  uint64_t PixelsOffset;
+  uint64_t PixelsSize;
+  uint64_t LABOffset;
+  uint64_t PlaneSize;
+  uint64_t Size;
+
+  EntryLayout(uint64_t Pixels, uint64_t PixelSize) {
+    PixelsOffset = llvm::alignTo(sizeof(EntryHeader), Alignment);
+    PixelsSize = Pixels * PixelSize;
+    LABOffset = llvm::alignTo(PixelsOffset + PixelsSize, Alignment);
+    PlaneSize = llvm::alignTo(Pixels * sizeof(float), Alignment);
+    Size = LABOffset + 3 * PlaneSize;
+  }
+};
+
+} // namespace
+
+static std::string getEntryPath(llvm::StringRef Dir, uint64_t Hash) {
+  llvm::SmallString<256> Path(Dir);
+  llvm::sys::path::append(
+      Path, llvm::utohexstr(Hash, /*LowerCase=*/true) + ".labcache");
+  return std::string(Path);
+}
+
+std::string CachedImage::getCachePath(llvm::StringRef Dir,
+                                      llvm::StringRef PNGData) {
+  return getEntryPath(Dir, llvm::xxHash64(PNGData));
+}
+
+bool CachedImage::parse(llvm::MemoryBufferRef Entry, uint64_t Hash,
+                        CachedImage &Result) {
+  llvm::StringRef Data = Entry.getBuffer();
+  EntryHeader H;
+  if (Data.size() < sizeof(H) ||
+      reinterpret_cast<uintptr_t>(Data.data()) % alignof(float) != 0)
+    return false;
+  memcpy(&H, Data.data(), sizeof(H));
+  if (memcmp(H.Magic, Magic.data(), Magic.size()) != 0 ||
+      H.Version != Version || H.Hash != Hash)
+    return false;
+  if ((H.Channels != 3 && H.Channels != 4) || H.Depth > 8 ||
+      !llvm::isPowerOf2_32(H.Depth) || H.IsFloat > 1)
+    return false;
+  // Checked before the sizes are computed from it, so they can't overflow.
+  uint64_t Pixels = static_cast<uint64_t>(H.Height) * H.Width;
+  if (Pixels > Data.size())
+    return false;
+  EntryLayout L(Pixels, H.Depth * H.Channels);
+  if (Data.size() != L.Size)
+    return false;
+
+  Result.Img = ImageRef(H.Height, H.Width, H.Depth, H.Channels, H.IsFloat,
+                        Data.substr(L.PixelsOffset, L.PixelsSize));
+  for (int C = 0; C < 3; ++C)
+    Result.LAB[C] = reinterpret_cast<const float *>(
+        Data.data() + L.LABOffset + C * L.PlaneSize);
+  return true;
+}
+
+// Converts the pixels of Img to L*a*b*, writing channel C to the plane
+// LAB[C]. Each row is converted to float RGB in turn, so only one row of RGB
+// values is held at a time.
+static void convertToLAB(ImageRef Img, float *const LAB[3]) {
+  uint32_t Width = Img.getWidth();
+  uint64_t RowSize =
+      static_cast<uint64_t>(Width) * Img.getDepth() * Img.getChannels();
+  std::vector<float> Planes(3 * static_cast<size_t>(Width));
+  float *const RGBRow[] = {Planes.data(), Planes.data() + Width,
+                           Planes.data() + 2 * Width};
+  for (uint32_t Row = 0; Row < Img.getHeight(); ++Row) {
+    Image::loadPlanar(Img, Img.data() + Row * RowSize, Width, RGBRow);
+    uint64_t Index = static_cast<uint64_t>(Row) * Width;
+    float *const LABRow[] = {LAB[0] + Index, LAB[1] + Index, LAB[2] + Index};
+    Color::translateRGBToLAB(RGBRow, LABRow, Width);
+  }
+}
+
+// Writes Contents to Path in Dir, replacing any existing entry atomically.
+static llvm::Error writeEntry(llvm::StringRef Dir, llvm::StringRef Path,
+                              llvm::StringRef Contents) {
+  if (std::error_code EC = llvm::sys::fs::create_directories(Dir))
+    return llvm::createFileError(Dir, EC);
+  int FD;
+  llvm::SmallString<256> TmpPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          Path + "-%%%%%%.tmp", FD, TmpPath))
+    return llvm::createFileError(Path, EC);
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Contents;
+    OS.close();
+    if (OS.has_error()) {
+      std::error_code EC = OS.error();
+      OS.clear_error();
+      llvm::sys::fs::remove(TmpPath);
+      return llvm::createFileError(Path, EC);
+    }
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath, Path)) {
+    llvm::sys::fs::remove(TmpPath);
+    return llvm::createFileError(Path, EC);
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<CachedImage> CachedImage::load(llvm::StringRef PNGPath,
+                                              llvm::StringRef CacheDir) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> PNG =
+      llvm::MemoryBuffer::getFile(PNGPath, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!PNG)
+    return llvm::createFileError(PNGPath, PNG.getError());
+  uint64_t Hash = llvm::xxHash64((*PNG)->getBuffer());
+  std::string Path = getEntryPath(CacheDir, Hash);
+
+  CachedImage Result;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Cached =
+      llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (Cached && parse((*Cached)->getMemBufferRef(), Hash, Result)) {
+    Result.Buffer = std::move(*Cached);
+    Result.Hit = true;
+    return std::move(Result);
+  }
+
+  llvm::Expected<Image> Decoded = Image::loadPNG(PNGPath);
+  if (!Decoded)
+    return Decoded.takeError();
+  uint64_t Pixels =
+      static_cast<uint64_t>(Decoded->getHeight()) * Decoded->getWidth();
+  EntryLayout L(Pixels, Decoded->getDepth() * Decoded->getChannels());
+  std::unique_ptr<llvm::WritableMemoryBuffer> Entry =
+      llvm::WritableMemoryBuffer::getNewMemBuffer(L.Size, Path);
+  char *Data = Entry->getBufferStart();
+
+  EntryHeader H = {};
+  memcpy(H.Magic, Magic.data(), Magic.size());
+  H.Version = Version;
+  H.Hash = Hash;
+  H.Height = Decoded->getHeight();
+  H.Width = Decoded->getWidth();
+  H.Depth = Decoded->getDepth();
+  H.Channels = Decoded->getChannels();
+  H.IsFloat = Decoded->isFloat();
+  memcpy(Data, &H, sizeof(H));
+  memcpy(Data + L.PixelsOffset, Decoded->data(), L.PixelsSize);
+  float *const LAB[] = {
+      reinterpret_cast<float *>(Data + L.LABOffset),
+      reinterpret_cast<float *>(Data + L.LABOffset + L.PlaneSize),
+      reinterpret_cast<float *>(Data + L.LABOffset + 2 * L.PlaneSize)};
+  convertToLAB(*Decoded, LAB);
+
+  // The next load converts the image again if the entry couldn't be stored.
+  llvm::consumeError(
+      writeEntry(CacheDir, Path, llvm::StringRef(Data, L.Size)));
+  bool Parsed = parse(Entry->getMemBufferRef(), Hash, Result);
+  assert(Parsed && "Built an invalid cache entry");
+  (void)Parsed;
+  Result.Buffer = std::move(Entry);
+  return std::move(Result);
+}
@@ -0,0 +1,254 @@
+//===- Capture.cpp - Execution Capture ------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The shader and the two pipelines are stored as sections, each 64-byte
+// aligned so a pipeline can be mapped from the file and used in place. They
+// are followed by an index, which is written last so the sections can be
+// streamed out, and a fixed size trailer locating the index. All metadata
+// fields are little endian; the pipelines are in the binary pipeline format.
+//
+//   File:    Header Section... Index Trailer
+//   Header:  "OTCP" Version:u32
+//   Index:   API:str Device:str DriverVersion:str RunCount:u32 Run[RunCount]
+//            Program:Extent Inputs:Extent Outputs:Extent
+//   Run:     HostMilliseconds:f64 GPUMilliseconds:f64
+//   Extent:  Offset:u64 Size:u64
+//   Trailer: IndexOffset:u64 "OTCP"
+//   str:     Length:u32 Bytes[Length]
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Capture.h"
+#include "Support/PipelineBinary.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SwapByteOrder.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+using namespace offloadtest;
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "OTCP";
+constexpr uint32_t Version = 1;
+constexpr uint64_t TrailerSize = 8 + 4;
+
+template <typename T> T toLittleEndian(T Val) {
+  if (llvm::sys::IsBigEndianHost)
+    llvm::sys::swapByteOrder(Val);
+  return Val;
+}
+
+struct Extent {
+  uint64_t Offset = 0;
+  uint64_t Size = 0;
+};
+
+class CaptureWriter {
+  llvm::raw_ostream &OS;
+
+public:
+  CaptureWriter(llvm::raw_ostream &OS) : OS(OS) {}
+
+  template <typename T> void write(T Val) {
+    static_assert(std::is_integral_v<T>, "Only integers are supported");
+    Val = toLittleEndian(Val);
+    OS.write(reinterpret_cast<const char *>(&Val), sizeof(T));
+  }
+
+  void writeDouble(double Val) {
+    uint64_t Bits;
+    memcpy(&Bits, &Val, sizeof(Bits));
+    write<uint64_t>(Bits);
+  }
+
+  void writeString(llvm::StringRef S) {
+    write<uint32_t>(static_cast<uint32_t>(S.size()));
+    OS << S;
+  }
+
+  void writeExtent(Extent E) {
+    write<uint64_t>(E.Offset);
+    write<uint64_t>(E.Size);
+  }
+
+  // Pads the file to the alignment of a section, then writes the section
+  // with WriteContents and returns where it ended up.
+  template <typename Fn> Extent writeSection(Fn WriteContents) {
+    uint64_t Pos = OS.tell();
+    OS.write_zeros(llvm::alignTo(Pos, ResourceBuffer::DefaultAlignment) - Pos);
+    Extent E;
+    E.Offset = OS.tell();
+    WriteContents();
+    E.Size = OS.tell() - E.Offset;
+    return E;
+  }
+};
+
+class CaptureReader {
+  llvm::StringRef Data;
+  uint64_t Offset;
+
+public:
+  CaptureReader(llvm::StringRef D, uint64_t Start) : Data(D), Offset(Start) {}
+
+  template <typename T> bool read(T &Val) {
+    static_assert(std::is_integral_v<T>, "Only integers are supported");
+    if (Offset + sizeof(T) > Data.size())
+      return false;
+    memcpy(&Val, Data.data() + Offset, sizeof(T));
+    Val = toLittleEndian(Val);
+    Offset += sizeof(T);
+    return true;
+  }
+
+  bool readDouble(double &Val) {
+    uint64_t Bits;
+    if (!read(Bits))
+      return false;
+    memcpy(&Val, &Bits, sizeof(Val));
+    return true;
+  }
+
+  bool readString(std::string &S) {
+    uint32_t Len;
+    if (!read(Len) || Offset + Len > Data.size())
+      return false;
+    S = Data.substr(Offset, Len).str();
+    Offset += Len;
+    return true;
+  }
+
+  bool readExtent(Extent &E) {
+    return read(E.Offset) && read(E.Size) && E.Offset <= Data.size() &&
+           E.Size <= Data.size() - E.Offset;
+  }
+};
+
+} // namespace
+
+static llvm::Error makeCorruptError(llvm::StringRef Path,
+                                    llvm::StringRef Msg) {
+  return llvm::createStringError(std::errc::illegal_byte_sequence,
+                                 "Invalid capture %s: %s", Path.str().c_str(),
+                                 Msg.str().c_str());
+}
+
+static void writeCaptureImpl(const Capture &C, llvm::raw_ostream &OS) {
+  CaptureWriter W(OS);
+  OS << Magic;
+  W.write<uint32_t>(Version);
+  Extent Program = W.writeSection([&] { OS << C.Program; });
+  Extent Inputs =
+      W.writeSection([&] { writePipelineBinary(C.Inputs, 0, OS); });
+  Extent Outputs =
+      W.writeSection([&] { writePipelineBinary(C.Outputs, 0, OS); });
+
+  uint64_t IndexOffset = OS.tell();
+  W.writeString(C.API);
+  W.writeString(C.DeviceDescription);
+  W.writeString(C.DriverVersion);
+  W.write<uint32_t>(static_cast<uint32_t>(C.Runs.size()));
+  for (const CaptureRun &Run : C.Runs) {
+    W.writeDouble(Run.HostMilliseconds);
+    W.writeDouble(Run.GPUMilliseconds);
+  }
+  W.writeExtent(Program);
+  W.writeExtent(Inputs);
+  W.writeExtent(Outputs);
+  W.write<uint64_t>(IndexOffset);
+  OS << Magic;
+}
+
+llvm::Error offloadtest::writeCapture(const Capture &C, llvm::StringRef Path) {
+  int FD;
+  llvm::SmallString<256> TmpPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          Path + "-%%%%%%.tmp", FD, TmpPath))
+    return llvm::createFileError(Path, EC);
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    writeCaptureImpl(C, OS);
+    OS.close();
+    if (OS.has_error()) {
+      std::error_code EC = OS.error();
+      OS.clear_error();
+      llvm::sys::fs::remove(TmpPath);
+      return llvm::createFileError(Path, EC);
+    }
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath, Path)) {
+    llvm::sys::fs::remove(TmpPath);
+    return llvm::createFileError(Path, EC);
+  }
+  return llvm::Error::success();
+}
+
+// Maps the pipeline stored in extent E of the capture at Path.
+static llvm::Expected<Pipeline> readPipelineSection(llvm::StringRef Path,
+                                                    Extent E) {
+  llvm::ErrorOr<std::unique_ptr<llvm::WritableMemoryBuffer>> Buffer =
+      llvm::WritableMemoryBuffer::getFileSlice(Path, E.Size, E.Offset);
+  if (!Buffer)
+    return llvm::createFileError(Path, Buffer.getError());
+  return readPipelineBinary(std::move(*Buffer));
+}
+
+llvm::Expected<Capture> offloadtest::readCapture(llvm::StringRef Path) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> File =
+      llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!File)
+    return llvm::createFileError(Path, File.getError());
+  llvm::StringRef Data = (*File)->getBuffer();
+  if (Data.size() < Magic.size() + 4 + TrailerSize ||
+      !Data.starts_with(Magic) || !Data.ends_with(Magic))
+    return makeCorruptError(Path, "not a capture file");
+
+  uint32_t FileVersion;
+  CaptureReader(Data, Magic.size()).read(FileVersion);
+  if (FileVersion != Version)
+    return makeCorruptError(Path, "unsupported version");
+  uint64_t IndexOffset;
+  CaptureReader(Data, Data.size() - TrailerSize).read(IndexOffset);
+  if (IndexOffset > Data.size() - TrailerSize)
+    return makeCorruptError(Path, "index out of range");
+
+  Capture C;
+  CaptureReader R(Data.drop_back(TrailerSize), IndexOffset);
+  uint32_t RunCount;
+  if (!R.readString(C.API) || !R.readString(C.DeviceDescription) ||
+      !R.readString(C.DriverVersion) || !R.read(RunCount))
+    return makeCorruptError(Path, "truncated index");
+  for (uint32_t I = 0; I < RunCount; ++I) {
+    CaptureRun &Run = C.Runs.emplace_back();
+    if (!R.readDouble(Run.HostMilliseconds) ||
+        !R.readDouble(Run.GPUMilliseconds))
+      return makeCorruptError(Path, "truncated timings");
+  }
+  Extent Program, Inputs, Outputs;
+  if (!R.readExtent(Program) || !R.readExtent(Inputs) ||
+      !R.readExtent(Outputs))
+    return makeCorruptError(Path, "truncated index");
+  C.Program = Data.substr(Program.Offset, Program.Size).str();
+
+  llvm::Expected<Pipeline> InputsOrErr = readPipelineSection(Path, Inputs);
+  if (!InputsOrErr)
+    return InputsOrErr.takeError();
+  C.Inputs = std::move(*InputsOrErr);
+  llvm::Expected<Pipeline> OutputsOrErr = readPipelineSection(Path, Outputs);
+  if (!OutputsOrErr)
+    return OutputsOrErr.takeError();
+  C.Outputs = std::move(*OutputsOrErr);
+  return std::move(C);
+}
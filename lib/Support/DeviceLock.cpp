@@ -0,0 +1,124 @@
+//===- DeviceLock.cpp - Cross-Process Device Scheduling -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/DeviceLock.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+
+using namespace offloadtest;
+
+DeviceLock &DeviceLock::operator=(DeviceLock &&RHS) {
+  if (this != &RHS) {
+    release();
+    FDs = std::move(RHS.FDs);
+    RHS.FDs.clear();
+  }
+  return *this;
+}
+
+void DeviceLock::release() {
+  for (int FD : FDs) {
+    llvm::sys::fs::unlockFile(FD);
+    llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+  }
+  FDs.clear();
+}
+
+std::string offloadtest::getDeviceFileName(llvm::StringRef DeviceName) {
+  std::string Name;
+  for (char C : DeviceName)
+    Name.push_back(llvm::isAlnum(C) || C == '-' ? C : '_');
+  return Name;
+}
+
+std::string DeviceLock::getSlotPath(llvm::StringRef Dir,
+                                    llvm::StringRef DeviceName,
+                                    unsigned Slot) {
+  llvm::SmallString<256> Path(Dir);
+  llvm::sys::path::append(Path, getDeviceFileName(DeviceName) + "." +
+                                    std::to_string(Slot) + ".lock");
+  return std::string(Path);
+}
+
+static llvm::Expected<int> openSlot(llvm::StringRef Dir,
+                                    llvm::StringRef DeviceName,
+                                    unsigned Slot) {
+  std::string Path = DeviceLock::getSlotPath(Dir, DeviceName, Slot);
+  int FD;
+  if (std::error_code EC = llvm::sys::fs::openFileForReadWrite(
+          Path, FD, llvm::sys::fs::CD_OpenAlways, llvm::sys::fs::OF_None))
+    return llvm::createFileError(Path, EC);
+  return FD;
+}
+
+llvm::Expected<DeviceLock> DeviceLock::acquire(llvm::StringRef Dir,
+                                               llvm::StringRef DeviceName,
+                                               unsigned Concurrency,
+                                               bool Exclusive) {
+  if (Concurrency == 0)
+    return llvm::createStringError(std::errc::invalid_argument,
+                                   "Device concurrency must be at least 1");
+  if (std::error_code EC = llvm::sys::fs::create_directories(Dir))
+    return llvm::createFileError(Dir, EC);
+
+  DeviceLock Lock;
+  llvm::SmallVector<int> Slots;
+  for (unsigned Slot = 0; Slot < Concurrency; ++Slot) {
+    llvm::Expected<int> FD = openSlot(Dir, DeviceName, Slot);
+    if (!FD) {
+      for (int Open : Slots)
+        llvm::sys::Process::SafelyCloseFileDescriptor(Open);
+      return FD.takeError();
+    }
+    Slots.push_back(*FD);
+  }
+  auto Take = [&](unsigned Slot) {
+    Lock.FDs.push_back(Slots[Slot]);
+    Slots[Slot] = -1;
+  };
+  auto CloseUnused = [&] {
+    for (int FD : Slots)
+      if (FD != -1)
+        llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+  };
+
+  if (Exclusive) {
+    for (unsigned Slot = 0; Slot < Concurrency; ++Slot) {
+      if (std::error_code EC = llvm::sys::fs::lockFile(Slots[Slot])) {
+        CloseUnused();
+        return llvm::createFileError(getSlotPath(Dir, DeviceName, Slot), EC);
+      }
+      Take(Slot);
+    }
+    return std::move(Lock);
+  }
+
+  // Take the first free slot. If they are all busy, wait on one picked by
+  // process ID so waiting processes spread over the slots.
+  unsigned Chosen = Concurrency;
+  for (unsigned Slot = 0; Slot < Concurrency && Chosen == Concurrency; ++Slot)
+    if (!llvm::sys::fs::tryLockFile(Slots[Slot]))
+      Chosen = Slot;
+  if (Chosen == Concurrency) {
+    Chosen = llvm::sys::Process::getProcessId() % Concurrency;
+    if (std::error_code EC = llvm::sys::fs::lockFile(Slots[Chosen])) {
+      CloseUnused();
+      return llvm::createFileError(getSlotPath(Dir, DeviceName, Chosen), EC);
+    }
+  }
+  Take(Chosen);
+  CloseUnused();
+  return std::move(Lock);
+}
@@ -0,0 +1,106 @@
+//===- OutputSelection.cpp - Resource Output Selection --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/OutputSelection.h"
+
+#include "llvm/ADT/SmallBitVector.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace offloadtest;
+
+bool offloadtest::matchesSelector(llvm::StringRef Selector, const Resource &R,
+                                  unsigned SetIdx, unsigned ResIdx) {
+  if (!R.OutputProps.Name.empty() && Selector == R.OutputProps.Name)
+    return true;
+  auto [SetStr, ResStr] = Selector.split(':');
+  unsigned Set, Res;
+  if (ResStr.empty() || SetStr.getAsInteger(10, Set) ||
+      ResStr.getAsInteger(10, Res))
+    return false;
+  return Set == SetIdx && Res == ResIdx;
+}
+
+Resource offloadtest::selectElements(const Resource &R,
+                                     const OutputSelection &Sel) {
+  Resource Out = R.cloneDescription();
+  uint64_t EltSize = R.getElementSize();
+  uint64_t Count = EltSize ? R.Size / EltSize : 0;
+  uint64_t Begin = 0;
+  uint64_t End = Count;
+  if (Sel.First)
+    End = std::min(Sel.First, Count);
+  else if (Sel.Last)
+    Begin = Count - std::min(Sel.Last, Count);
+
+  char *Src = const_cast<char *>(R.Data.data()) + Begin * EltSize;
+  if (Sel.Stride <= 1) {
+    Out.Size = (End - Begin) * EltSize;
+    Out.Data = ResourceBuffer::wrap(Src, Out.Size);
+    return Out;
+  }
+
+  uint64_t Selected = (End - Begin + Sel.Stride - 1) / Sel.Stride;
+  Out.Size = Selected * EltSize;
+  Out.Data = ResourceBuffer::allocate(Out.Size);
+  char *Dst = Out.Data.data();
+  for (uint64_t I = 0; I < Selected; ++I)
+    memcpy(Dst + I * EltSize, Src + I * Sel.Stride * EltSize, EltSize);
+  return Out;
+}
+
+llvm::Expected<Pipeline> offloadtest::selectOutput(
+    const Pipeline &P, const OutputSelection &Sel,
+    llvm::SmallVectorImpl<llvm::SmallVector<unsigned>> *ResourceIndices) {
+  if (Sel.First && Sel.Last)
+    return llvm::createStringError(
+        std::errc::invalid_argument,
+        "Cannot select both the first and the last elements");
+  if (Sel.Stride == 0)
+    return llvm::createStringError(std::errc::invalid_argument,
+                                   "Element stride must be at least 1");
+
+  Pipeline Out;
+  std::copy(std::begin(P.DispatchSize), std::end(P.DispatchSize),
+            Out.DispatchSize);
+  llvm::SmallBitVector Used(Sel.Resources.size());
+  if (ResourceIndices)
+    ResourceIndices->clear();
+  for (unsigned SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const DescriptorSet &S = P.Sets[SetIdx];
+    DescriptorSet &OutSet = Out.Sets.emplace_back();
+    if (ResourceIndices)
+      ResourceIndices->emplace_back();
+    for (unsigned ResIdx = 0; ResIdx < S.Resources.size(); ++ResIdx) {
+      const Resource &R = S.Resources[ResIdx];
+      bool Keep = Sel.Resources.empty();
+      for (unsigned SelIdx = 0; SelIdx < Sel.Resources.size(); ++SelIdx) {
+        if (!matchesSelector(Sel.Resources[SelIdx], R, SetIdx, ResIdx))
+          continue;
+        Keep = true;
+        Used.set(SelIdx);
+      }
+      if (!Keep)
+        continue;
+      OutSet.Resources.push_back(selectElements(R, Sel));
+      if (ResourceIndices)
+        ResourceIndices->back().push_back(ResIdx);
+    }
+  }
+
+  for (unsigned SelIdx = 0; SelIdx < Sel.Resources.size(); ++SelIdx)
+    if (!Used.test(SelIdx))
+      return llvm::createStringError(std::errc::invalid_argument,
+                                     "No resource matches '%s'",
+                                     Sel.Resources[SelIdx].c_str());
+  return std::move(Out);
+}
@@ -13,6 +13,78 @@
 
 using namespace offloadtest;
 
+Resource Resource::cloneDescription() const {
+  Resource R;
+  R.Format = Format;
+  R.Channels = Channels;
+  R.RawSize = RawSize;
+  R.Access = Access;
+  R.Size = Size;
+  R.DataFile = DataFile;
+  R.DXBinding = DXBinding;
+  R.OutputProps = OutputProps;
+  R.ZeroInitSize = ZeroInitSize;
+  return R;
+}
+
+Resource Resource::clone() const {
+  Resource R = cloneDescription();
+  if (Access == DataAccess::ReadWrite)
+    R.Data = ResourceBuffer::copy(llvm::ArrayRef<char>(Data.data(), Size));
+  else
+    R.Data = ResourceBuffer::wrap(const_cast<char *>(Data.data()), Size);
+  R.Expected.Size = Expected.Size;
+  R.Expected.File = Expected.File;
+  R.Expected.Tol = Expected.Tol;
+  if (Expected.Data)
+    R.Expected.Data = ResourceBuffer::wrap(
+        const_cast<char *>(Expected.Data.data()), Expected.Data.size());
+  return R;
+}
+
+Pipeline Pipeline::clone() const {
+  Pipeline P;
+  std::copy(std::begin(DispatchSize), std::end(DispatchSize), P.DispatchSize);
+  for (const auto &S : Sets) {
+    DescriptorSet &NewSet = P.Sets.emplace_back();
+    for (const auto &R : S.Resources)
+      NewSet.Resources.push_back(R.clone());
+  }
+  P.Sweep = Sweep;
+  return P;
+}
+
+llvm::hash_code Pipeline::getLayoutHash() const {
+  llvm::hash_code Hash = llvm::hash_value(Sets.size());
+  for (const auto &S : Sets) {
+    Hash = llvm::hash_combine(Hash, S.Resources.size());
+    for (const auto &R : S.Resources)
+      Hash = llvm::hash_combine(Hash, R.Format, R.Channels, R.RawSize,
+                                R.Access, R.DXBinding.Register,
+                                R.DXBinding.Space);
+  }
+  return Hash;
+}
+
+template <typename T>
+static void mapExpectedValues(llvm::yaml::IO &I, ExpectedData &E) {
+  if (I.outputting()) {
+    if (!E.Data)
+      return;
+    llvm::MutableArrayRef<T> Arr(reinterpret_cast<T *>(E.Data.data()),
+                                 E.Size / sizeof(T));
+    I.mapRequired("Data", Arr);
+    return;
+  }
+  llvm::SmallVector<T, 64> Arr;
+  I.mapOptional("Data", Arr);
+  if (Arr.empty())
+    return;
+  E.Size = Arr.size() * sizeof(T);
+  E.Data = ResourceBuffer::copy(llvm::ArrayRef<char>(
+      reinterpret_cast<const char *>(Arr.data()), E.Size));
+}
+
 namespace llvm {
 namespace yaml {
 void MappingTraits<offloadtest::Pipeline>::mapping(IO &I,
@@ -20,6 +92,14 @@ void MappingTraits<offloadtest::Pipeline>::mapping(IO &I,
   MutableArrayRef<int> MutableDispatchSize(P.DispatchSize);
   I.mapRequired("DispatchSize", MutableDispatchSize);
   I.mapRequired("DescriptorSets", P.Sets);
+  I.mapOptional("Sweep", P.Sweep);
+}
+
+void MappingTraits<offloadtest::SweepPoint>::mapping(
+    IO &I, offloadtest::SweepPoint &S) {
+  MutableArrayRef<int> MutableDispatchSize(S.DispatchSize);
+  I.mapRequired("DispatchSize", MutableDispatchSize);
+  I.mapOptional("Scale", S.Scale, 1u);
 }
 
 void MappingTraits<offloadtest::DescriptorSet>::mapping(
@@ -34,27 +114,32 @@ void MappingTraits<offloadtest::Resource>::mapping(IO &I,
   I.mapOptional("Channels", R.Channels, 1);
   I.mapOptional("RawSize", R.RawSize, 0);
   assert(R.RawSize >= 0 && "RawSize must be non-negative");
+  if (!I.outputting()) {
+    I.mapOptional("DataFile", R.DataFile, std::string());
+    if (!R.DataFile.empty())
+      R.Size = 0;
+  }
   switch (R.Format) {
 #define DATA_CASE(Enum, Type)                                                  \
   case DataFormat::Enum: {                                                     \
     if (I.outputting()) {                                                      \
-      llvm::MutableArrayRef<Type> Arr(reinterpret_cast<Type *>(R.Data.get()),  \
+      llvm::MutableArrayRef<Type> Arr(reinterpret_cast<Type *>(R.Data.data()), \
                                       R.Size / sizeof(Type));                  \
       I.mapRequired("Data", Arr);                                              \
-    } else {                                                                   \
+    } else if (R.DataFile.empty()) {                                           \
       int64_t ZeroInitSize;                                                    \
       I.mapOptional("ZeroInitSize", ZeroInitSize, 0);                          \
       if (ZeroInitSize > 0) {                                                  \
+        R.ZeroInitSize = ZeroInitSize;                                         \
         R.Size = ZeroInitSize;                                                 \
-        R.Data.reset(new char[R.Size]);                                        \
-        memset(R.Data.get(), 0, R.Size);                                       \
+        R.Data = ResourceBuffer::allocateZeroed(R.Size);                       \
         break;                                                                 \
       }                                                                        \
       llvm::SmallVector<Type, 64> Arr;                                         \
       I.mapRequired("Data", Arr);                                              \
       R.Size = Arr.size() * sizeof(Type);                                      \
-      R.Data.reset(new char[R.Size]);                                          \
-      memcpy(R.Data.get(), Arr.data(), R.Size);                                \
+      R.Data = ResourceBuffer::copy(llvm::ArrayRef<char>(                      \
+          reinterpret_cast<const char *>(Arr.data()), R.Size));                \
     }                                                                          \
     break;                                                                     \
   }
@@ -74,6 +159,66 @@ void MappingTraits<offloadtest::Resource>::mapping(IO &I,
 
   I.mapRequired("DirectXBinding", R.DXBinding);
   I.mapOptional("OutputProps", R.OutputProps);
+  // Expected values are checked by the tool running the pipeline, they are
+  // not part of the results.
+  if (!I.outputting())
+    I.mapOptionalWithContext("Expected", R.Expected, R.Format);
+}
+
+void MappingContextTraits<offloadtest::ExpectedData, offloadtest::DataFormat>::
+    mapping(IO &I, offloadtest::ExpectedData &E,
+            offloadtest::DataFormat &Format) {
+  switch (Format) {
+#define EXPECTED_CASE(Enum, Type)                                              \
+  case DataFormat::Enum:                                                       \
+    mapExpectedValues<Type>(I, E);                                             \
+    break;
+    EXPECTED_CASE(Hex8, llvm::yaml::Hex8)
+    EXPECTED_CASE(Hex16, llvm::yaml::Hex16)
+    EXPECTED_CASE(Hex32, llvm::yaml::Hex32)
+    EXPECTED_CASE(Hex64, llvm::yaml::Hex64)
+    EXPECTED_CASE(UInt16, uint16_t)
+    EXPECTED_CASE(UInt32, uint32_t)
+    EXPECTED_CASE(UInt64, uint64_t)
+    EXPECTED_CASE(Int16, int16_t)
+    EXPECTED_CASE(Int32, int32_t)
+    EXPECTED_CASE(Int64, int64_t)
+    EXPECTED_CASE(Float32, float)
+    EXPECTED_CASE(Float64, double)
+#undef EXPECTED_CASE
+  }
+  I.mapOptional("File", E.File, std::string());
+  I.mapOptional("Tolerance", E.Tol);
+  if (!I.outputting() && !E.isSet())
+    I.setError("Expected requires either Data or File");
+  if (!I.outputting() && E.Data && !E.File.empty())
+    I.setError("Expected cannot specify both Data and File");
+}
+
+void MappingTraits<offloadtest::Tolerance>::mapping(IO &I,
+                                                    offloadtest::Tolerance &T) {
+  if (I.outputting()) {
+    if (T.Kind == ToleranceKind::ULP)
+      I.mapRequired("ULP", T.ULP);
+    else if (T.Kind == ToleranceKind::Abs)
+      I.mapRequired("Abs", T.Abs);
+    return;
+  }
+  int64_t ULP = -1;
+  double Abs = -1.0;
+  I.mapOptional("ULP", ULP, -1);
+  I.mapOptional("Abs", Abs, -1.0);
+  if (ULP >= 0 && Abs >= 0.0) {
+    I.setError("Tolerance cannot specify both ULP and Abs");
+    return;
+  }
+  if (ULP >= 0) {
+    T.Kind = ToleranceKind::ULP;
+    T.ULP = ULP;
+  } else if (Abs >= 0.0) {
+    T.Kind = ToleranceKind::Abs;
+    T.Abs = Abs;
+  }
 }
 
 void MappingTraits<offloadtest::DirectXBinding>::mapping(
@@ -0,0 +1,376 @@
+//===- PipelineBinary.cpp - Binary Pipeline Serialization -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The encoding is a fixed header followed by the pipeline metadata and then
+// the resource data. All metadata fields are little endian. Resource data is
+// stored in host byte order, which is recorded in the header so a file written
+// on a host of the other endianness is rejected rather than misread.
+//
+//   Header:   "OTPB" Version:u32 Flags:u32 Reserved:u32 SourceHash:u64
+//   Pipeline: DispatchSize:i32[3] SweepCount:u32 SweepPoint[SweepCount]
+//             SetCount:u32 Set[SetCount]
+//   SweepPoint: DispatchSize:i32[3] Scale:u32
+//   Set:      ResourceCount:u32 Resource[ResourceCount]
+//   Resource: Format:u32 Channels:i32 RawSize:i32 Access:u32
+//             Register:u32 Space:u32
+//             Name:str Height:i32 Width:i32 Depth:i32 DataFile:str
+//             Flags:u32 Size:u64 DataOffset:u64 Expected
+//   Expected: Flags:u32 ToleranceKind:u32 ULP:u64 Abs:f64
+//             File:str Size:u64 DataOffset:u64
+//   str:      Length:u32 Bytes[Length]
+//
+// Zero-filled resources (typically large outputs) are flagged and their data
+// is not stored. Resources declared with ZeroInitSize are flagged separately,
+// since sweeps scale them. Every other resource's data is stored, including
+// data that was loaded from its DataFile, such as by captures and the result
+// cache; the DataFile name is kept too. Expected data is only stored when it
+// was given inline; files referenced by an Expected block are read when the
+// pipeline is run.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/PipelineBinary.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SwapByteOrder.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <cstring>
+
+using namespace offloadtest;
+
+namespace {
+
+template <typename T> T toLittleEndian(T Val) {
+  if (llvm::sys::IsBigEndianHost)
+    llvm::sys::swapByteOrder(Val);
+  return Val;
+}
+
+constexpr llvm::StringLiteral Magic = "OTPB";
+constexpr uint32_t Version = 4;
+constexpr uint32_t BigEndianDataFlag = 1;
+constexpr uint32_t ZeroFilledResourceFlag = 1;
+constexpr uint32_t ZeroInitResourceFlag = 2;
+constexpr uint32_t HasExpectedFlag = 1;
+constexpr uint64_t HeaderSize = 4 + 4 + 4 + 4 + 8;
+constexpr uint64_t SourceHashOffset = 16;
+
+class BinaryWriter {
+  llvm::SmallVectorImpl<char> &Buf;
+
+public:
+  BinaryWriter(llvm::SmallVectorImpl<char> &B) : Buf(B) {}
+
+  template <typename T> void write(T Val) {
+    static_assert(std::is_integral_v<T>, "Only integers are supported");
+    Val = toLittleEndian(Val);
+    const char *Bytes = reinterpret_cast<const char *>(&Val);
+    Buf.append(Bytes, Bytes + sizeof(T));
+  }
+
+  template <typename T> void patch(uint64_t Offset, T Val) {
+    Val = toLittleEndian(Val);
+    memcpy(&Buf[Offset], &Val, sizeof(T));
+  }
+
+  void writeString(llvm::StringRef S) {
+    write<uint32_t>(static_cast<uint32_t>(S.size()));
+    writeBytes(S);
+  }
+
+  void writeBytes(llvm::StringRef S) { Buf.append(S.begin(), S.end()); }
+
+  uint64_t tell() const { return Buf.size(); }
+};
+
+class BinaryReader {
+  llvm::StringRef Data;
+  uint64_t Offset = 0;
+
+public:
+  BinaryReader(llvm::StringRef D, uint64_t Start = 0)
+      : Data(D), Offset(Start) {}
+
+  template <typename T> bool read(T &Val) {
+    static_assert(std::is_integral_v<T>, "Only integers are supported");
+    if (Offset + sizeof(T) > Data.size())
+      return false;
+    memcpy(&Val, Data.data() + Offset, sizeof(T));
+    Val = toLittleEndian(Val);
+    Offset += sizeof(T);
+    return true;
+  }
+
+  bool readString(std::string &S) {
+    uint32_t Len;
+    if (!read(Len) || Offset + Len > Data.size())
+      return false;
+    S = Data.substr(Offset, Len).str();
+    Offset += Len;
+    return true;
+  }
+};
+
+} // namespace
+
+static bool isZeroFilled(const Resource &R) {
+  const char *Ptr = R.Data.data();
+  if (R.Size == 0 || Ptr[0] != 0)
+    return false;
+  // If the first byte is zero and the buffer equals itself shifted by one
+  // byte, every byte is zero.
+  return memcmp(Ptr, Ptr + 1, R.Size - 1) == 0;
+}
+
+static llvm::Error makeCorruptError(llvm::StringRef Msg) {
+  return llvm::createStringError(std::errc::illegal_byte_sequence,
+                                 "Invalid binary pipeline: %s",
+                                 Msg.str().c_str());
+}
+
+uint64_t offloadtest::hashPipelineSource(llvm::StringRef Source) {
+  return llvm::xxHash64(Source);
+}
+
+std::string offloadtest::getPipelineBinaryPath(llvm::StringRef YAMLPath) {
+  return (YAMLPath + ".pipebin").str();
+}
+
+uint64_t offloadtest::getPipelineBinarySourceHash(llvm::StringRef Buffer) {
+  if (Buffer.size() < HeaderSize || !Buffer.starts_with(Magic))
+    return 0;
+  BinaryReader R(Buffer, Magic.size());
+  uint32_t FileVersion, Flags;
+  if (!R.read(FileVersion) || FileVersion != Version || !R.read(Flags))
+    return 0;
+  if (((Flags & BigEndianDataFlag) != 0) != llvm::sys::IsBigEndianHost)
+    return 0;
+  uint64_t SourceHash;
+  R = BinaryReader(Buffer, SourceHashOffset);
+  R.read(SourceHash);
+  return SourceHash;
+}
+
+void offloadtest::writePipelineBinary(const Pipeline &P, uint64_t SourceHash,
+                                      llvm::raw_ostream &OS) {
+  llvm::SmallString<1024> Meta;
+  BinaryWriter W(Meta);
+  W.writeBytes(Magic);
+  W.write<uint32_t>(Version);
+  W.write<uint32_t>(llvm::sys::IsBigEndianHost ? BigEndianDataFlag : 0);
+  W.write<uint32_t>(0);
+  W.write<uint64_t>(SourceHash);
+  assert(W.tell() == HeaderSize && "Header size mismatch");
+
+  for (int I = 0; I < 3; ++I)
+    W.write<int32_t>(P.DispatchSize[I]);
+  W.write<uint32_t>(static_cast<uint32_t>(P.Sweep.size()));
+  for (const auto &Point : P.Sweep) {
+    for (int I = 0; I < 3; ++I)
+      W.write<int32_t>(Point.DispatchSize[I]);
+    W.write<uint32_t>(Point.Scale);
+  }
+  W.write<uint32_t>(static_cast<uint32_t>(P.Sets.size()));
+
+  // Data offsets aren't known until all of the metadata is written, so record
+  // where each one goes and patch it afterwards.
+  struct DataFixup {
+    uint64_t Offset;
+    llvm::ArrayRef<char> Data;
+  };
+  llvm::SmallVector<DataFixup> DataFixups;
+  for (const auto &S : P.Sets) {
+    W.write<uint32_t>(static_cast<uint32_t>(S.Resources.size()));
+    for (const auto &R : S.Resources) {
+      W.write<uint32_t>(static_cast<uint32_t>(R.Format));
+      W.write<int32_t>(R.Channels);
+      W.write<int32_t>(R.RawSize);
+      W.write<uint32_t>(static_cast<uint32_t>(R.Access));
+      W.write<uint32_t>(R.DXBinding.Register);
+      W.write<uint32_t>(R.DXBinding.Space);
+      W.writeString(R.OutputProps.Name);
+      W.write<int32_t>(R.OutputProps.Height);
+      W.write<int32_t>(R.OutputProps.Width);
+      W.write<int32_t>(R.OutputProps.Depth);
+      W.writeString(R.DataFile);
+      bool ZeroFilled = isZeroFilled(R);
+      uint32_t ResFlags = ZeroFilled ? ZeroFilledResourceFlag : 0;
+      if (R.ZeroInitSize > 0)
+        ResFlags |= ZeroInitResourceFlag;
+      W.write<uint32_t>(ResFlags);
+      W.write<uint64_t>(R.Size);
+      if (!ZeroFilled)
+        DataFixups.push_back({W.tell(), {R.Data.data(), R.Size}});
+      W.write<uint64_t>(0);
+
+      const ExpectedData &E = R.Expected;
+      W.write<uint32_t>(E.isSet() ? HasExpectedFlag : 0);
+      W.write<uint32_t>(static_cast<uint32_t>(E.Tol.Kind));
+      W.write<uint64_t>(E.Tol.ULP);
+      uint64_t AbsBits;
+      memcpy(&AbsBits, &E.Tol.Abs, sizeof(AbsBits));
+      W.write<uint64_t>(AbsBits);
+      W.writeString(E.File);
+      bool HasInlineData = E.File.empty() && E.Data;
+      W.write<uint64_t>(HasInlineData ? E.Size : 0);
+      if (HasInlineData)
+        DataFixups.push_back({W.tell(), {E.Data.data(), E.Size}});
+      W.write<uint64_t>(0);
+    }
+  }
+
+  uint64_t DataOffset = W.tell();
+  for (auto &Fixup : DataFixups) {
+    DataOffset = llvm::alignTo(DataOffset, ResourceBuffer::DefaultAlignment);
+    W.patch<uint64_t>(Fixup.Offset, DataOffset);
+    DataOffset += Fixup.Data.size();
+  }
+
+  OS << Meta;
+  // Stream the resource data directly rather than staging it in the metadata
+  // buffer, since it can be very large.
+  uint64_t Pos = Meta.size();
+  for (auto &Fixup : DataFixups) {
+    uint64_t Aligned = llvm::alignTo(Pos, ResourceBuffer::DefaultAlignment);
+    OS.write_zeros(Aligned - Pos);
+    OS.write(Fixup.Data.data(), Fixup.Data.size());
+    Pos = Aligned + Fixup.Data.size();
+  }
+}
+
+llvm::Error offloadtest::writePipelineBinary(const Pipeline &P,
+                                             uint64_t SourceHash,
+                                             llvm::StringRef Path) {
+  int FD;
+  llvm::SmallString<256> TmpPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          Path + "-%%%%%%.tmp", FD, TmpPath))
+    return llvm::errorCodeToError(EC);
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    writePipelineBinary(P, SourceHash, OS);
+    OS.close();
+    if (OS.has_error()) {
+      std::error_code EC = OS.error();
+      OS.clear_error();
+      llvm::sys::fs::remove(TmpPath);
+      return llvm::errorCodeToError(EC);
+    }
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath, Path)) {
+    llvm::sys::fs::remove(TmpPath);
+    return llvm::errorCodeToError(EC);
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<Pipeline> offloadtest::readPipelineBinary(
+    std::unique_ptr<llvm::WritableMemoryBuffer> Buffer) {
+  llvm::StringRef Data(Buffer->getBufferStart(), Buffer->getBufferSize());
+  if (Data.size() < HeaderSize)
+    return makeCorruptError("truncated header");
+  if (!Data.starts_with(Magic))
+    return makeCorruptError("bad magic");
+
+  BinaryReader R(Data, Magic.size());
+  uint32_t FileVersion, Flags;
+  R.read(FileVersion);
+  R.read(Flags);
+  if (FileVersion != Version)
+    return makeCorruptError("unsupported version");
+  if (((Flags & BigEndianDataFlag) != 0) != llvm::sys::IsBigEndianHost)
+    return makeCorruptError("data byte order does not match host");
+  R = BinaryReader(Data, HeaderSize);
+
+  // Every resource shares ownership of the underlying (usually memory-mapped)
+  // buffer so it stays alive as long as any resource refers to it.
+  std::shared_ptr<llvm::WritableMemoryBuffer> Shared(std::move(Buffer));
+
+  auto GetData = [&](uint64_t Offset, uint64_t Size,
+                     ResourceBuffer &Buf) -> bool {
+    if (Offset > Data.size() || Size > Data.size() - Offset)
+      return false;
+    char *Ptr = Shared->getBufferStart() + Offset;
+    if (reinterpret_cast<uintptr_t>(Ptr) % ResourceBuffer::DefaultAlignment)
+      Buf = ResourceBuffer::copy(llvm::ArrayRef<char>(Ptr, Size));
+    else
+      Buf = ResourceBuffer::wrap(
+          Ptr, Size, [Shared](char *, size_t) mutable { Shared.reset(); });
+    return true;
+  };
+
+  Pipeline P;
+  uint32_t SweepCount, SetCount;
+  for (int I = 0; I < 3; ++I)
+    if (!R.read(P.DispatchSize[I]))
+      return makeCorruptError("truncated pipeline");
+  if (!R.read(SweepCount))
+    return makeCorruptError("truncated pipeline");
+  for (uint32_t PointIdx = 0; PointIdx < SweepCount; ++PointIdx) {
+    SweepPoint &Point = P.Sweep.emplace_back();
+    if (!R.read(Point.DispatchSize[0]) || !R.read(Point.DispatchSize[1]) ||
+        !R.read(Point.DispatchSize[2]) || !R.read(Point.Scale))
+      return makeCorruptError("truncated sweep");
+  }
+  if (!R.read(SetCount))
+    return makeCorruptError("truncated pipeline");
+
+  for (uint32_t SetIdx = 0; SetIdx < SetCount; ++SetIdx) {
+    DescriptorSet &Set = P.Sets.emplace_back();
+    uint32_t ResourceCount;
+    if (!R.read(ResourceCount))
+      return makeCorruptError("truncated descriptor set");
+    for (uint32_t ResIdx = 0; ResIdx < ResourceCount; ++ResIdx) {
+      Resource &Res = Set.Resources.emplace_back();
+      uint32_t Format, Access, ResFlags;
+      uint64_t Size, Offset;
+      if (!R.read(Format) || !R.read(Res.Channels) || !R.read(Res.RawSize) ||
+          !R.read(Access) || !R.read(Res.DXBinding.Register) ||
+          !R.read(Res.DXBinding.Space) || !R.readString(Res.OutputProps.Name) ||
+          !R.read(Res.OutputProps.Height) || !R.read(Res.OutputProps.Width) ||
+          !R.read(Res.OutputProps.Depth) || !R.readString(Res.DataFile) ||
+          !R.read(ResFlags) || !R.read(Size) || !R.read(Offset))
+        return makeCorruptError("truncated resource");
+      if (Format > static_cast<uint32_t>(DataFormat::Float64) ||
+          Access > static_cast<uint32_t>(DataAccess::Constant))
+        return makeCorruptError("invalid resource format or access");
+      Res.Format = static_cast<DataFormat>(Format);
+      Res.Access = static_cast<DataAccess>(Access);
+      Res.Size = Size;
+      if (ResFlags & ZeroInitResourceFlag)
+        Res.ZeroInitSize = Size;
+      if (ResFlags & ZeroFilledResourceFlag)
+        Res.Data = ResourceBuffer::allocateZeroed(Size);
+      else if (!GetData(Offset, Size, Res.Data))
+        return makeCorruptError("resource data out of range");
+
+      ExpectedData &E = Res.Expected;
+      uint32_t ExpectedFlags, TolKind;
+      uint64_t AbsBits, ExpectedSize, ExpectedOffset;
+      if (!R.read(ExpectedFlags) || !R.read(TolKind) || !R.read(E.Tol.ULP) ||
+          !R.read(AbsBits) || !R.readString(E.File) || !R.read(ExpectedSize) ||
+          !R.read(ExpectedOffset))
+        return makeCorruptError("truncated expected data");
+      if (TolKind > static_cast<uint32_t>(ToleranceKind::Abs))
+        return makeCorruptError("invalid tolerance");
+      E.Tol.Kind = static_cast<ToleranceKind>(TolKind);
+      memcpy(&E.Tol.Abs, &AbsBits, sizeof(AbsBits));
+      if (!(ExpectedFlags & HasExpectedFlag) || !E.File.empty())
+        continue;
+      E.Size = ExpectedSize;
+      if (!GetData(ExpectedOffset, ExpectedSize, E.Data))
+        return makeCorruptError("expected data out of range");
+    }
+  }
+  return std::move(P);
+}
@@ -0,0 +1,211 @@
+//===- ResourceBuffer.cpp - Resource Data Storage -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/ResourceBuffer.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace offloadtest;
+
+// Allocations at least this large are aligned to, and hinted as, huge pages.
+static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+static void adviseHugePages(char *Ptr, size_t Size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (Size >= HugePageSize)
+    (void)madvise(Ptr, Size, MADV_HUGEPAGE);
+#else
+  (void)Ptr;
+  (void)Size;
+#endif
+}
+
+static size_t getPageAlignment(size_t Size) {
+  if (Size >= HugePageSize)
+    return HugePageSize;
+  return static_cast<size_t>(llvm::sys::Process::getPageSizeEstimate());
+}
+
+static char *allocateAligned(size_t Size, size_t Alignment) {
+  return static_cast<char *>(::operator new(std::max<size_t>(Size, 1),
+                                            std::align_val_t(Alignment)));
+}
+
+static void deallocateAligned(char *Ptr, size_t Size, size_t Alignment) {
+  ::operator delete(Ptr, std::max<size_t>(Size, 1),
+                    std::align_val_t(Alignment));
+}
+
+ResourceBuffer::ResourceBuffer(ResourceBuffer &&RHS) noexcept
+    : Ptr(RHS.Ptr), Size(RHS.Size), Release(std::move(RHS.Release)) {
+  RHS.Ptr = nullptr;
+  RHS.Size = 0;
+}
+
+ResourceBuffer &ResourceBuffer::operator=(ResourceBuffer &&RHS) noexcept {
+  if (this == &RHS)
+    return *this;
+  reset();
+  Ptr = RHS.Ptr;
+  Size = RHS.Size;
+  Release = std::move(RHS.Release);
+  RHS.Ptr = nullptr;
+  RHS.Size = 0;
+  return *this;
+}
+
+void ResourceBuffer::reset() {
+  if (Ptr && Release)
+    Release(Ptr, Size);
+  Ptr = nullptr;
+  Size = 0;
+  Release = nullptr;
+}
+
+ResourceBuffer ResourceBuffer::allocate(size_t Size, size_t Alignment) {
+  assert(llvm::isPowerOf2_64(Alignment) && "Alignment must be a power of 2");
+  Alignment = std::max(Alignment, DefaultAlignment);
+  char *Ptr = allocateAligned(Size, Alignment);
+  return ResourceBuffer(Ptr, Size, [Alignment](char *P, size_t S) {
+    deallocateAligned(P, S, Alignment);
+  });
+}
+
+ResourceBuffer ResourceBuffer::allocateZeroed(size_t Size, size_t Alignment) {
+  ResourceBuffer Buf = allocate(Size, Alignment);
+  memset(Buf.data(), 0, Size);
+  return Buf;
+}
+
+ResourceBuffer ResourceBuffer::allocatePages(size_t Size) {
+  ResourceBuffer Buf = allocate(Size, getPageAlignment(Size));
+  adviseHugePages(Buf.data(), Size);
+  return Buf;
+}
+
+ResourceBuffer ResourceBuffer::copy(llvm::ArrayRef<char> Src,
+                                    size_t Alignment) {
+  ResourceBuffer Buf = allocate(Src.size(), Alignment);
+  if (!Src.empty())
+    memcpy(Buf.data(), Src.data(), Src.size());
+  return Buf;
+}
+
+ResourceBuffer ResourceBuffer::wrap(char *Ptr, size_t Size,
+                                    ReleaseFn Release) {
+  return ResourceBuffer(Ptr, Size, std::move(Release));
+}
+
+ResourceBuffer
+ResourceBuffer::wrap(std::unique_ptr<llvm::WritableMemoryBuffer> MB) {
+  llvm::WritableMemoryBuffer *Raw = MB.release();
+  return ResourceBuffer(Raw->getBufferStart(), Raw->getBufferSize(),
+                        [Raw](char *, size_t) { delete Raw; });
+}
+
+struct BufferPool::Impl {
+  size_t Alignment;
+  bool UseHugePages;
+  mutable std::mutex Lock;
+  llvm::DenseMap<size_t, llvm::SmallVector<char *, 4>> FreeLists;
+  size_t CachedBytes = 0;
+
+  Impl(size_t A, bool H) : Alignment(A), UseHugePages(H) {}
+
+  ~Impl() { trim(); }
+
+  size_t getAlignment(size_t ClassSize) const {
+    if (UseHugePages)
+      return std::max(Alignment, getPageAlignment(ClassSize));
+    return Alignment;
+  }
+
+  static size_t getSizeClass(size_t Size) {
+    // Round small requests up to a page so tiny buffers share one class.
+    return llvm::PowerOf2Ceil(std::max<size_t>(Size, 4096));
+  }
+
+  char *take(size_t ClassSize) {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      auto It = FreeLists.find(ClassSize);
+      if (It != FreeLists.end() && !It->second.empty()) {
+        char *Ptr = It->second.pop_back_val();
+        CachedBytes -= ClassSize;
+        return Ptr;
+      }
+    }
+    char *Ptr = allocateAligned(ClassSize, getAlignment(ClassSize));
+    if (UseHugePages)
+      adviseHugePages(Ptr, ClassSize);
+    return Ptr;
+  }
+
+  void give(char *Ptr, size_t ClassSize) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    FreeLists[ClassSize].push_back(Ptr);
+    CachedBytes += ClassSize;
+  }
+
+  void trim() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    for (auto &Entry : FreeLists)
+      for (char *Ptr : Entry.second)
+        deallocateAligned(Ptr, Entry.first, getAlignment(Entry.first));
+    FreeLists.clear();
+    CachedBytes = 0;
+  }
+};
+
+BufferPool::BufferPool(size_t Alignment, bool UseHugePages)
+    : I(std::make_shared<Impl>(
+          std::max(Alignment, ResourceBuffer::DefaultAlignment),
+          UseHugePages)) {
+  assert(llvm::isPowerOf2_64(Alignment) && "Alignment must be a power of 2");
+}
+
+BufferPool::~BufferPool() = default;
+
+ResourceBuffer BufferPool::allocate(size_t Size) {
+  size_t ClassSize = Impl::getSizeClass(Size);
+  char *Ptr = I->take(ClassSize);
+  // Capturing the pool implementation keeps it alive for as long as any of
+  // its buffers are.
+  return ResourceBuffer::wrap(
+      Ptr, Size, [Pool = I, ClassSize](char *P, size_t) {
+        Pool->give(P, ClassSize);
+      });
+}
+
+ResourceBuffer BufferPool::allocateZeroed(size_t Size) {
+  ResourceBuffer Buf = allocate(Size);
+  memset(Buf.data(), 0, Size);
+  return Buf;
+}
+
+void BufferPool::trim() { I->trim(); }
+
+size_t BufferPool::getCachedBytes() const {
+  std::lock_guard<std::mutex> Guard(I->Lock);
+  return I->CachedBytes;
+}
@@ -0,0 +1,327 @@
+//===- ResourceIO.cpp - Resource Data Files -------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/ResourceIO.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SwapByteOrder.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <memory>
+
+using namespace offloadtest;
+
+static constexpr llvm::StringLiteral NumPyMagic = "\x93NUMPY";
+
+// zlib takes sizes as unsigned int, so large buffers are transferred in
+// chunks of this size.
+static constexpr size_t GZipChunkSize = 1u << 30;
+
+ResourceFileFormat offloadtest::getResourceFileFormat(llvm::StringRef Path) {
+  llvm::StringRef Ext = llvm::sys::path::extension(Path);
+  if (Ext == ".npy")
+    return ResourceFileFormat::NumPy;
+  if (Ext == ".gz")
+    return ResourceFileFormat::GZip;
+  return ResourceFileFormat::Raw;
+}
+
+llvm::StringRef
+offloadtest::getResourceFileExtension(ResourceFileFormat Format) {
+  switch (Format) {
+  case ResourceFileFormat::Raw:
+    return ".bin";
+  case ResourceFileFormat::NumPy:
+    return ".npy";
+  case ResourceFileFormat::GZip:
+    return ".gz";
+  }
+  llvm_unreachable("All cases covered.");
+}
+
+std::string offloadtest::getNumPyDType(const Resource &R) {
+  if (R.isRaw())
+    return "|V" + std::to_string(R.RawSize);
+  const char Order = llvm::sys::IsBigEndianHost ? '>' : '<';
+  switch (R.Format) {
+  case DataFormat::Hex8:
+    return "|u1";
+  case DataFormat::Hex16:
+  case DataFormat::UInt16:
+    return std::string(1, Order) + "u2";
+  case DataFormat::Int16:
+    return std::string(1, Order) + "i2";
+  case DataFormat::Hex32:
+  case DataFormat::UInt32:
+    return std::string(1, Order) + "u4";
+  case DataFormat::Int32:
+    return std::string(1, Order) + "i4";
+  case DataFormat::Float32:
+    return std::string(1, Order) + "f4";
+  case DataFormat::Hex64:
+  case DataFormat::UInt64:
+    return std::string(1, Order) + "u8";
+  case DataFormat::Int64:
+    return std::string(1, Order) + "i8";
+  case DataFormat::Float64:
+    return std::string(1, Order) + "f8";
+  }
+  llvm_unreachable("All cases covered.");
+}
+
+void offloadtest::writeNumPyHeader(const Resource &R, llvm::raw_ostream &OS) {
+  uint64_t ElementSize = R.getElementSize();
+  uint64_t Count = ElementSize ? R.Size / ElementSize : 0;
+  std::string Dict;
+  llvm::raw_string_ostream DictOS(Dict);
+  DictOS << "{'descr': '" << getNumPyDType(R)
+         << "', 'fortran_order': False, 'shape': (" << Count;
+  if (!R.isRaw() && R.Channels > 1)
+    DictOS << ", " << R.Channels << "), }";
+  else
+    DictOS << ",), }";
+  DictOS.flush();
+
+  // Version 1.0 header: magic, version, little endian u16 header length and
+  // the dictionary, padded with spaces and a newline so the data that follows
+  // is 64-byte aligned.
+  const size_t Prefix = NumPyMagic.size() + 4;
+  size_t Total = llvm::alignTo(Prefix + Dict.size() + 1,
+                               ResourceBuffer::DefaultAlignment);
+  uint16_t HeaderLen = static_cast<uint16_t>(Total - Prefix);
+  OS << NumPyMagic;
+  OS << '\x01' << '\x00';
+  OS << static_cast<char>(HeaderLen & 0xff)
+     << static_cast<char>(HeaderLen >> 8);
+  OS << Dict;
+  OS.indent(Total - Prefix - Dict.size() - 1);
+  OS << '\n';
+}
+
+static llvm::Error writeGZip(llvm::StringRef Path, llvm::ArrayRef<char> Data) {
+  // Favor speed over ratio; result buffers are large and mostly regular.
+  gzFile F = gzopen(Path.str().c_str(), "wb1");
+  if (!F)
+    return llvm::createStringError(std::errc::io_error,
+                                   "Could not open '%s' for writing",
+                                   Path.str().c_str());
+  gzbuffer(F, 1u << 20);
+  bool Failed = false;
+  for (size_t Offset = 0; Offset < Data.size() && !Failed;
+       Offset += GZipChunkSize) {
+    unsigned Len =
+        static_cast<unsigned>(std::min(GZipChunkSize, Data.size() - Offset));
+    Failed = gzwrite(F, Data.data() + Offset, Len) != static_cast<int>(Len);
+  }
+  if (gzclose(F) != Z_OK || Failed)
+    return llvm::createStringError(std::errc::io_error,
+                                   "Could not write '%s'", Path.str().c_str());
+  return llvm::Error::success();
+}
+
+llvm::Error offloadtest::writeResourceFile(const Resource &R,
+                                           llvm::StringRef Path,
+                                           ResourceFileFormat Format) {
+  llvm::ArrayRef<char> Data(R.Data.data(), R.Size);
+  if (Format == ResourceFileFormat::GZip)
+    return writeGZip(Path, Data);
+
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::OF_None);
+  if (EC)
+    return llvm::createFileError(Path, EC);
+  if (Format == ResourceFileFormat::NumPy)
+    writeNumPyHeader(R, OS);
+  // raw_fd_ostream hands writes larger than its buffer directly to the file,
+  // so the data goes out in a single sequential write.
+  OS.write(Data.data(), Data.size());
+  OS.close();
+  if (OS.has_error())
+    return llvm::createFileError(Path, OS.error());
+  return llvm::Error::success();
+}
+
+static llvm::Error makeNumPyError(llvm::StringRef Path, llvm::StringRef Msg) {
+  return llvm::createStringError(std::errc::illegal_byte_sequence,
+                                 "'%s' is not a valid NumPy file: %s",
+                                 Path.str().c_str(), Msg.str().c_str());
+}
+
+// Returns the value of a quoted entry in the header dictionary, or an empty
+// string if there is none.
+static llvm::StringRef getNumPyHeaderString(llvm::StringRef Header,
+                                            llvm::StringRef Key) {
+  size_t Pos = Header.find(("'" + Key + "':").str());
+  if (Pos == llvm::StringRef::npos)
+    return "";
+  llvm::StringRef Rest = Header.drop_front(Pos + Key.size() + 3).ltrim();
+  if (Rest.empty() || (Rest[0] != '\'' && Rest[0] != '"'))
+    return "";
+  char Quote = Rest[0];
+  Rest = Rest.drop_front();
+  return Rest.take_until([Quote](char C) { return C == Quote; });
+}
+
+// Parses the shape tuple of the header dictionary into Dims. Returns false if
+// there is none or it isn't a tuple of integers.
+static bool getNumPyShape(llvm::StringRef Header,
+                          llvm::SmallVectorImpl<uint64_t> &Dims) {
+  size_t Pos = Header.find("'shape':");
+  if (Pos == llvm::StringRef::npos)
+    return false;
+  llvm::StringRef Rest = Header.drop_front(Pos + 8).ltrim();
+  if (!Rest.consume_front("("))
+    return false;
+  Rest = Rest.take_until([](char C) { return C == ')'; });
+  llvm::SmallVector<llvm::StringRef> Parts;
+  Rest.split(Parts, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (llvm::StringRef Part : Parts) {
+    Part = Part.trim();
+    if (Part.empty())
+      continue;
+    uint64_t Dim;
+    if (Part.getAsInteger(10, Dim))
+      return false;
+    Dims.push_back(Dim);
+  }
+  return true;
+}
+
+static llvm::Expected<ResourceBuffer>
+readNumPy(const Resource &R, llvm::StringRef Path,
+          std::unique_ptr<llvm::WritableMemoryBuffer> Buffer) {
+  llvm::StringRef Contents = Buffer->getMemBufferRef().getBuffer();
+  if (!Contents.starts_with(NumPyMagic) || Contents.size() < 10)
+    return makeNumPyError(Path, "missing header");
+  const unsigned char *Bytes =
+      reinterpret_cast<const unsigned char *>(Contents.data());
+  uint8_t Major = Bytes[6];
+  size_t HeaderLen, Prefix;
+  if (Major == 1) {
+    HeaderLen = Bytes[8] | (Bytes[9] << 8);
+    Prefix = 10;
+  } else if ((Major == 2 || Major == 3) && Contents.size() >= 12) {
+    HeaderLen = Bytes[8] | (Bytes[9] << 8) | (Bytes[10] << 16) |
+                (size_t(Bytes[11]) << 24);
+    Prefix = 12;
+  } else {
+    return makeNumPyError(Path, "unsupported version");
+  }
+  if (HeaderLen > Contents.size() - Prefix)
+    return makeNumPyError(Path, "truncated header");
+
+  llvm::StringRef Header = Contents.substr(Prefix, HeaderLen);
+  if (!Header.contains("'fortran_order': False"))
+    return makeNumPyError(Path, "only C order arrays are supported");
+  llvm::StringRef DType = getNumPyHeaderString(Header, "descr");
+  std::string Expected = getNumPyDType(R);
+  llvm::StringRef Want = Expected;
+  bool Matches = DType == Want;
+  // Byte order is irrelevant for single byte and record types, which NumPy
+  // may write with either '|' or '<'.
+  if (!Matches && (R.isRaw() || R.getSingleElementSize() == 1))
+    Matches = DType.size() == Want.size() &&
+              DType.drop_front() == Want.drop_front();
+  if (!Matches)
+    return llvm::createStringError(
+        std::errc::invalid_argument,
+        "'%s' holds dtype '%s', but the resource expects '%s'",
+        Path.str().c_str(), DType.str().c_str(), Expected.c_str());
+
+  size_t Offset = Prefix + HeaderLen;
+  size_t Size = Contents.size() - Offset;
+  if (Size % R.getElementSize())
+    return makeNumPyError(Path, "truncated data");
+
+  // The shape is (Count,) or, for resources of several channels, as written
+  // by writeNumPyHeader, (Count, Channels).
+  llvm::SmallVector<uint64_t, 2> Dims;
+  if (!getNumPyShape(Header, Dims))
+    return makeNumPyError(Path, "missing shape");
+  uint64_t Channels = R.isRaw() ? 1 : R.Channels;
+  bool ShapeMatches = Dims.size() == 1 && Channels == 1;
+  if (Dims.size() == 2 && Channels > 1)
+    ShapeMatches = Dims[1] == Channels;
+  if (!ShapeMatches || Dims[0] != Size / R.getElementSize())
+    return makeNumPyError(Path, "shape doesn't match the resource");
+  std::shared_ptr<llvm::WritableMemoryBuffer> Shared(std::move(Buffer));
+  char *Ptr = Shared->getBufferStart() + Offset;
+  if (reinterpret_cast<uintptr_t>(Ptr) % ResourceBuffer::DefaultAlignment)
+    return ResourceBuffer::copy(llvm::ArrayRef<char>(Ptr, Size));
+  return ResourceBuffer::wrap(
+      Ptr, Size, [Shared](char *, size_t) mutable { Shared.reset(); });
+}
+
+static llvm::Expected<ResourceBuffer> readGZip(llvm::StringRef Path) {
+  gzFile F = gzopen(Path.str().c_str(), "rb");
+  if (!F)
+    return llvm::createStringError(std::errc::no_such_file_or_directory,
+                                   "Could not open '%s'", Path.str().c_str());
+  gzbuffer(F, 1u << 20);
+  llvm::SmallVector<char, 0> Data;
+  constexpr size_t ReadSize = 1u << 20;
+  int Read;
+  do {
+    size_t Old = Data.size();
+    Data.resize_for_overwrite(Old + ReadSize);
+    Read = gzread(F, Data.data() + Old, ReadSize);
+    Data.truncate(Old + std::max(Read, 0));
+  } while (Read > 0);
+  gzclose(F);
+  if (Read < 0)
+    return llvm::createStringError(std::errc::illegal_byte_sequence,
+                                   "Could not decompress '%s'",
+                                   Path.str().c_str());
+  return ResourceBuffer::copy(Data);
+}
+
+llvm::Expected<ResourceBuffer>
+offloadtest::readResourceFile(const Resource &R, llvm::StringRef Path) {
+  ResourceFileFormat Format = getResourceFileFormat(Path);
+  if (Format == ResourceFileFormat::GZip)
+    return readGZip(Path);
+
+  llvm::ErrorOr<std::unique_ptr<llvm::WritableMemoryBuffer>> FileOrErr =
+      llvm::WritableMemoryBuffer::getFile(Path);
+  if (!FileOrErr)
+    return llvm::createFileError(Path, FileOrErr.getError());
+  if (Format == ResourceFileFormat::NumPy)
+    return readNumPy(R, Path, std::move(*FileOrErr));
+  return ResourceBuffer::wrap(std::move(*FileOrErr));
+}
+
+llvm::Error offloadtest::loadResourceFiles(Pipeline &P,
+                                           llvm::StringRef BaseDir) {
+  for (auto &S : P.Sets) {
+    for (auto &R : S.Resources) {
+      if (R.DataFile.empty())
+        continue;
+      llvm::SmallString<256> Path;
+      if (llvm::sys::path::is_relative(R.DataFile))
+        Path = BaseDir;
+      llvm::sys::path::append(Path, R.DataFile);
+      llvm::Expected<ResourceBuffer> Data = readResourceFile(R, Path);
+      if (!Data)
+        return Data.takeError();
+      R.Data = std::move(*Data);
+      R.Size = R.Data.size();
+    }
+  }
+  return llvm::Error::success();
+}
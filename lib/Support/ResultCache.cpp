@@ -0,0 +1,104 @@
+//===- ResultCache.cpp - Execution Result Cache ---------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/ResultCache.h"
+#include "Support/PipelineBinary.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace offloadtest;
+
+// Bumped whenever what a key covers changes, so old entries become misses.
+static constexpr llvm::StringLiteral KeyVersion = "OTRC1";
+
+uint64_t offloadtest::getResultKey(const ResultKeyInputs &K) {
+  llvm::SmallString<256> Key;
+  llvm::raw_svector_ostream OS(Key);
+  OS << KeyVersion << '\0' << K.API << '\0' << K.DeviceDescription << '\0'
+     << K.DriverVersion << '\0' << llvm::xxHash64(K.Program) << '\0'
+     << K.PipelineHash << '\0';
+  // Inline data is part of the source, only data loaded from files needs to
+  // be hashed separately.
+  if (K.Inputs)
+    for (const auto &S : K.Inputs->Sets)
+      for (const auto &R : S.Resources)
+        if (!R.DataFile.empty())
+          OS << llvm::xxHash64(R.Data.getStringRef().take_front(R.Size))
+             << '\0';
+  return llvm::xxHash64(Key);
+}
+
+std::string offloadtest::getResultCachePath(llvm::StringRef Dir,
+                                            uint64_t Key) {
+  llvm::SmallString<256> Path(Dir);
+  llvm::sys::path::append(
+      Path, llvm::utohexstr(Key, /*LowerCase=*/true) + ".pipebin");
+  return std::string(Path);
+}
+
+std::optional<Pipeline> offloadtest::lookupResult(llvm::StringRef Dir,
+                                                  uint64_t Key) {
+  llvm::ErrorOr<std::unique_ptr<llvm::WritableMemoryBuffer>> BufOrErr =
+      llvm::WritableMemoryBuffer::getFile(getResultCachePath(Dir, Key));
+  if (!BufOrErr || getPipelineBinarySourceHash(
+                       (*BufOrErr)->getMemBufferRef().getBuffer()) != Key)
+    return std::nullopt;
+  llvm::Expected<Pipeline> P = readPipelineBinary(std::move(*BufOrErr));
+  if (!P) {
+    llvm::consumeError(P.takeError());
+    return std::nullopt;
+  }
+  return std::move(*P);
+}
+
+llvm::Error offloadtest::storeResult(llvm::StringRef Dir, uint64_t Key,
+                                     const Pipeline &P) {
+  if (std::error_code EC = llvm::sys::fs::create_directories(Dir))
+    return llvm::createFileError(Dir, EC);
+  return writePipelineBinary(P, Key, getResultCachePath(Dir, Key));
+}
+
+bool offloadtest::hasResultLayout(const Pipeline &Cached, const Pipeline &P) {
+  if (P.Sets.size() != Cached.Sets.size())
+    return false;
+  for (size_t SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const auto &Resources = P.Sets[SetIdx].Resources;
+    const auto &CachedResources = Cached.Sets[SetIdx].Resources;
+    if (Resources.size() != CachedResources.size())
+      return false;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &R = Resources[ResIdx];
+      const Resource &C = CachedResources[ResIdx];
+      if (R.Format != C.Format || R.Channels != C.Channels ||
+          R.RawSize != C.RawSize || R.Size != C.Size)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool offloadtest::applyResult(Pipeline &P, Pipeline &Cached) {
+  if (!hasResultLayout(Cached, P))
+    return false;
+  for (size_t SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    auto &Resources = P.Sets[SetIdx].Resources;
+    auto &CachedResources = Cached.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx)
+      Resources[ResIdx].Data = std::move(CachedResources[ResIdx].Data);
+  }
+  return true;
+}
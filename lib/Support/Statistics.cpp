@@ -0,0 +1,239 @@
+//===- Statistics.cpp - Resource Summary Statistics -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Statistics.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+using namespace offloadtest;
+
+// Number of values each parallel task processes. Chunks are fixed so results,
+// including the rounding of the sum, don't depend on the number of threads.
+static constexpr uint64_t ChunkSize = 1u << 16;
+
+namespace {
+
+struct ChunkStatistics {
+  double Min = std::numeric_limits<double>::infinity();
+  double Max = -std::numeric_limits<double>::infinity();
+  double Sum = 0.0;
+  uint64_t NaNCount = 0;
+  uint64_t InfCount = 0;
+};
+
+template <size_t Size> struct UIntOfSize;
+template <> struct UIntOfSize<1> { using Type = uint8_t; };
+template <> struct UIntOfSize<2> { using Type = uint16_t; };
+template <> struct UIntOfSize<4> { using Type = uint32_t; };
+template <> struct UIntOfSize<8> { using Type = uint64_t; };
+
+} // namespace
+
+// Returns the bits of V, with the values that compare equal but have
+// different encodings (both zeros and all NaNs) mapped to a single encoding.
+template <typename T>
+static typename UIntOfSize<sizeof(T)>::Type getDistinctKey(T V) {
+  if constexpr (std::is_floating_point_v<T>) {
+    if (V != V)
+      V = std::numeric_limits<T>::quiet_NaN();
+    else if (V == 0)
+      V = 0;
+  }
+  typename UIntOfSize<sizeof(T)>::Type Bits;
+  memcpy(&Bits, &V, sizeof(V));
+  return Bits;
+}
+
+// The loop is branch-free so the compiler can vectorize it; for integer types
+// the NaN and infinity checks fold away.
+template <typename T>
+static void accumulateChunk(const T *Data, uint64_t Count,
+                            ChunkStatistics &C) {
+  double Min = C.Min, Max = C.Max, Sum = 0.0;
+  uint64_t NaNs = 0, Infs = 0;
+  for (uint64_t I = 0; I < Count; ++I) {
+    double V = static_cast<double>(Data[I]);
+    bool IsNaN = V != V;
+    bool IsInf = !IsNaN && V - V != 0.0;
+    bool IsFinite = !IsNaN && !IsInf;
+    NaNs += IsNaN;
+    Infs += IsInf;
+    Min = IsFinite && V < Min ? V : Min;
+    Max = IsFinite && V > Max ? V : Max;
+    Sum += IsFinite ? V : 0.0;
+  }
+  C.Min = Min;
+  C.Max = Max;
+  C.Sum = Sum;
+  C.NaNCount = NaNs;
+  C.InfCount = Infs;
+}
+
+template <typename T>
+static ResourceStatistics computeTyped(llvm::ArrayRef<char> Bytes,
+                                       unsigned HistogramBins) {
+  ResourceStatistics S;
+  const T *Data = reinterpret_cast<const T *>(Bytes.data());
+  uint64_t Count = Bytes.size() / sizeof(T);
+  S.Count = Count;
+  if (Count == 0)
+    return S;
+  uint64_t NumChunks = llvm::divideCeil(Count, ChunkSize);
+  auto ChunkBegin = [](uint64_t Chunk) { return Chunk * ChunkSize; };
+  auto ChunkCount = [Count](uint64_t Chunk) {
+    return std::min(ChunkSize, Count - Chunk * ChunkSize);
+  };
+
+  std::vector<ChunkStatistics> Chunks(NumChunks);
+  llvm::parallelFor(0, NumChunks, [&](size_t Chunk) {
+    accumulateChunk(Data + ChunkBegin(Chunk), ChunkCount(Chunk),
+                    Chunks[Chunk]);
+  });
+  double Min = std::numeric_limits<double>::infinity();
+  double Max = -std::numeric_limits<double>::infinity();
+  for (const ChunkStatistics &C : Chunks) {
+    Min = std::min(Min, C.Min);
+    Max = std::max(Max, C.Max);
+    S.Sum += C.Sum;
+    S.NaNCount += C.NaNCount;
+    S.InfCount += C.InfCount;
+  }
+  uint64_t FiniteCount = Count - S.NaNCount - S.InfCount;
+  if (FiniteCount) {
+    S.Min = Min;
+    S.Max = Max;
+    S.Mean = S.Sum / static_cast<double>(FiniteCount);
+  }
+
+  if (HistogramBins) {
+    S.Histogram.assign(HistogramBins, 0);
+    double Range = S.Max - S.Min;
+    double Scale = Range > 0.0 ? HistogramBins / Range : 0.0;
+    std::vector<uint64_t> ChunkBins(NumChunks * HistogramBins, 0);
+    if (FiniteCount) {
+      llvm::parallelFor(0, NumChunks, [&](size_t Chunk) {
+        const T *ChunkData = Data + ChunkBegin(Chunk);
+        uint64_t *Bins = ChunkBins.data() + Chunk * HistogramBins;
+        for (uint64_t I = 0, E = ChunkCount(Chunk); I < E; ++I) {
+          double V = static_cast<double>(ChunkData[I]);
+          if (!(V - V == 0.0))
+            continue;
+          uint64_t Bin = static_cast<uint64_t>((V - S.Min) * Scale);
+          ++Bins[std::min<uint64_t>(Bin, HistogramBins - 1)];
+        }
+      });
+    }
+    for (uint64_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+      for (unsigned Bin = 0; Bin < HistogramBins; ++Bin)
+        S.Histogram[Bin] += ChunkBins[Chunk * HistogramBins + Bin];
+  }
+
+  // Distinct values are counted by sorting a copy of their encodings.
+  using KeyT = typename UIntOfSize<sizeof(T)>::Type;
+  std::vector<KeyT> Keys(Count);
+  llvm::parallelFor(0, NumChunks, [&](size_t Chunk) {
+    uint64_t Begin = ChunkBegin(Chunk);
+    for (uint64_t I = Begin, E = Begin + ChunkCount(Chunk); I < E; ++I)
+      Keys[I] = getDistinctKey(Data[I]);
+  });
+  llvm::parallelSort(Keys.begin(), Keys.end());
+  S.DistinctCount = 1;
+  for (uint64_t I = 1; I < Count; ++I)
+    S.DistinctCount += Keys[I] != Keys[I - 1];
+  return S;
+}
+
+ResourceStatistics offloadtest::computeStatistics(const Resource &R,
+                                                  unsigned HistogramBins) {
+  llvm::ArrayRef<char> Data(R.Data.data(), R.Size);
+  switch (R.Format) {
+  case DataFormat::Hex8:
+    return computeTyped<uint8_t>(Data, HistogramBins);
+  case DataFormat::Hex16:
+  case DataFormat::UInt16:
+    return computeTyped<uint16_t>(Data, HistogramBins);
+  case DataFormat::Hex32:
+  case DataFormat::UInt32:
+    return computeTyped<uint32_t>(Data, HistogramBins);
+  case DataFormat::Hex64:
+  case DataFormat::UInt64:
+    return computeTyped<uint64_t>(Data, HistogramBins);
+  case DataFormat::Int16:
+    return computeTyped<int16_t>(Data, HistogramBins);
+  case DataFormat::Int32:
+    return computeTyped<int32_t>(Data, HistogramBins);
+  case DataFormat::Int64:
+    return computeTyped<int64_t>(Data, HistogramBins);
+  case DataFormat::Float32:
+    return computeTyped<float>(Data, HistogramBins);
+  case DataFormat::Float64:
+    return computeTyped<double>(Data, HistogramBins);
+  }
+  llvm_unreachable("All cases covered.");
+}
+
+std::vector<ResourceSummary>
+offloadtest::summarizePipeline(const Pipeline &P, unsigned HistogramBins) {
+  std::vector<ResourceSummary> Summaries;
+  for (unsigned SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const DescriptorSet &Set = P.Sets[SetIdx];
+    for (unsigned ResIdx = 0; ResIdx < Set.Resources.size(); ++ResIdx) {
+      const Resource &R = Set.Resources[ResIdx];
+      ResourceSummary &S = Summaries.emplace_back();
+      S.Set = SetIdx;
+      S.Index = ResIdx;
+      S.Name = R.OutputProps.Name;
+      S.Format = R.Format;
+      S.Channels = R.Channels;
+      S.Stats = computeStatistics(R, HistogramBins);
+    }
+  }
+  return Summaries;
+}
+
+namespace llvm {
+namespace yaml {
+void MappingTraits<offloadtest::ResourceSummary>::mapping(
+    IO &I, offloadtest::ResourceSummary &S) {
+  I.mapRequired("Set", S.Set);
+  I.mapRequired("Index", S.Index);
+  I.mapOptional("Name", S.Name, std::string());
+  I.mapRequired("Format", S.Format);
+  I.mapOptional("Channels", S.Channels, 1);
+  I.mapRequired("Count", S.Stats.Count);
+  I.mapRequired("Min", S.Stats.Min);
+  I.mapRequired("Max", S.Stats.Max);
+  I.mapRequired("Mean", S.Stats.Mean);
+  I.mapRequired("Sum", S.Stats.Sum);
+  I.mapRequired("NaNs", S.Stats.NaNCount);
+  I.mapRequired("Infs", S.Stats.InfCount);
+  I.mapRequired("Distinct", S.Stats.DistinctCount);
+  MutableArrayRef<uint64_t> Histogram(S.Stats.Histogram);
+  I.mapRequired("Histogram", Histogram);
+}
+} // namespace yaml
+} // namespace llvm
+
+double offloadtest::getMedian(llvm::ArrayRef<double> Values) {
+  assert(!Values.empty() && "No median of no values");
+  llvm::SmallVector<double> Sorted(Values.begin(), Values.end());
+  llvm::sort(Sorted);
+  size_t Mid = Sorted.size() / 2;
+  return Sorted.size() % 2 ? Sorted[Mid]
+                           : (Sorted[Mid - 1] + Sorted[Mid]) / 2.0;
+}
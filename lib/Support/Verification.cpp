@@ -0,0 +1,246 @@
+//===- Verification.cpp - Expected Data Verification ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Verification.h"
+#include "Support/ResourceIO.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+using namespace offloadtest;
+
+// Maps the bits of a floating point value onto integers such that adjacent
+// representable values are adjacent integers. Both zeros map to 0.
+static int64_t toOrderedInt(float F) {
+  int32_t I;
+  memcpy(&I, &F, sizeof(I));
+  return I < 0 ? int64_t(INT32_MIN) - I : I;
+}
+
+static int64_t toOrderedInt(double D) {
+  int64_t I;
+  memcpy(&I, &D, sizeof(I));
+  return I < 0 ? INT64_MIN - I : I;
+}
+
+static uint64_t absDiff(int64_t A, int64_t B) {
+  return A > B ? uint64_t(A) - uint64_t(B) : uint64_t(B) - uint64_t(A);
+}
+
+namespace {
+
+// Error functions return the distance between two values; the comparison
+// fails when the distance exceeds the tolerance limit. NaNs compare equal to
+// each other and infinitely far from everything else.
+template <typename T> struct ULPError {
+  double operator()(T E, T A) const {
+    bool ENaN = E != E;
+    bool ANaN = A != A;
+    double D = static_cast<double>(absDiff(toOrderedInt(E), toOrderedInt(A)));
+    D = ENaN || ANaN ? 0.0 : D;
+    return ENaN != ANaN ? std::numeric_limits<double>::infinity() : D;
+  }
+};
+
+template <typename T> struct AbsError {
+  double operator()(T E, T A) const {
+    bool ENaN = E != E;
+    bool ANaN = A != A;
+    double D = std::fabs(static_cast<double>(E) - static_cast<double>(A));
+    D = ENaN || ANaN ? 0.0 : D;
+    return ENaN != ANaN ? std::numeric_limits<double>::infinity() : D;
+  }
+};
+
+template <typename T> struct IntError {
+  double operator()(T E, T A) const {
+    if constexpr (std::is_signed_v<T>)
+      return static_cast<double>(absDiff(E, A));
+    else
+      return static_cast<double>(E > A ? E - A : A - E);
+  }
+};
+
+} // namespace
+
+// Values are compared in blocks. The first pass over a block is branch-free so
+// it vectorizes; the second pass, which records indices, only runs for blocks
+// that can change the summary.
+template <typename T, typename ErrorFn>
+static void compareValues(const T *Expected, const T *Actual, uint64_t Count,
+                          double Limit, unsigned MaxReported,
+                          MismatchSummary &S) {
+  constexpr uint64_t BlockSize = 1024;
+  ErrorFn Err;
+  for (uint64_t Begin = 0; Begin < Count; Begin += BlockSize) {
+    uint64_t End = std::min(Count, Begin + BlockSize);
+    uint64_t Mismatches = 0;
+    double BlockMax = 0.0;
+    for (uint64_t I = Begin; I < End; ++I) {
+      double E = Err(Expected[I], Actual[I]);
+      Mismatches += E > Limit;
+      BlockMax = E > BlockMax ? E : BlockMax;
+    }
+    S.MismatchCount += Mismatches;
+
+    bool NeedIndices = Mismatches && S.FirstMismatches.size() < MaxReported;
+    if (!NeedIndices && !(BlockMax > S.MaxError))
+      continue;
+    for (uint64_t I = Begin; I < End; ++I) {
+      double E = Err(Expected[I], Actual[I]);
+      if (E > Limit && S.FirstMismatches.size() < MaxReported)
+        S.FirstMismatches.push_back(I);
+      if (E > S.MaxError) {
+        S.MaxError = E;
+        S.MaxErrorIndex = I;
+      }
+    }
+  }
+}
+
+template <typename T>
+static void compareTyped(llvm::ArrayRef<char> Actual,
+                         llvm::ArrayRef<char> Expected, const Tolerance &Tol,
+                         unsigned MaxReported, MismatchSummary &S) {
+  uint64_t Count = Expected.size() / sizeof(T);
+  S.ValueCount = Count;
+  const T *E = reinterpret_cast<const T *>(Expected.data());
+  const T *A = reinterpret_cast<const T *>(Actual.data());
+
+  if constexpr (std::is_floating_point_v<T>) {
+    if (Tol.Kind == ToleranceKind::Abs)
+      compareValues<T, AbsError<T>>(E, A, Count, Tol.Abs, MaxReported, S);
+    else
+      compareValues<T, ULPError<T>>(
+          E, A, Count,
+          Tol.Kind == ToleranceKind::ULP ? static_cast<double>(Tol.ULP) : 0.0,
+          MaxReported, S);
+  } else {
+    double Limit = 0.0;
+    if (Tol.Kind == ToleranceKind::ULP)
+      Limit = static_cast<double>(Tol.ULP);
+    else if (Tol.Kind == ToleranceKind::Abs)
+      Limit = Tol.Abs;
+    compareValues<T, IntError<T>>(E, A, Count, Limit, MaxReported, S);
+  }
+}
+
+MismatchSummary offloadtest::compareData(DataFormat Format,
+                                         llvm::ArrayRef<char> Actual,
+                                         llvm::ArrayRef<char> Expected,
+                                         const Tolerance &Tol,
+                                         unsigned MaxReported) {
+  MismatchSummary S;
+  if (Actual.size() != Expected.size()) {
+    S.SizeMismatch = true;
+    return S;
+  }
+  switch (Format) {
+  case DataFormat::Hex8:
+    compareTyped<uint8_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Hex16:
+  case DataFormat::UInt16:
+    compareTyped<uint16_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Hex32:
+  case DataFormat::UInt32:
+    compareTyped<uint32_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Hex64:
+  case DataFormat::UInt64:
+    compareTyped<uint64_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Int16:
+    compareTyped<int16_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Int32:
+    compareTyped<int32_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Int64:
+    compareTyped<int64_t>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Float32:
+    compareTyped<float>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  case DataFormat::Float64:
+    compareTyped<double>(Actual, Expected, Tol, MaxReported, S);
+    break;
+  }
+  return S;
+}
+
+MismatchSummary offloadtest::verifyResource(const Resource &R,
+                                            unsigned MaxReported) {
+  return compareData(R.Format, llvm::ArrayRef<char>(R.Data.data(), R.Size),
+                     llvm::ArrayRef<char>(R.Expected.Data.data(),
+                                          R.Expected.Size),
+                     R.Expected.Tol, MaxReported);
+}
+
+llvm::Error offloadtest::loadExpectedData(Pipeline &P,
+                                          llvm::StringRef BaseDir) {
+  for (auto &S : P.Sets) {
+    for (auto &R : S.Resources) {
+      ExpectedData &E = R.Expected;
+      if (E.File.empty() || E.Data)
+        continue;
+      llvm::SmallString<256> Path;
+      if (llvm::sys::path::is_relative(E.File))
+        Path = BaseDir;
+      llvm::sys::path::append(Path, E.File);
+      llvm::Expected<ResourceBuffer> Data = readResourceFile(R, Path);
+      if (!Data)
+        return Data.takeError();
+      E.Data = std::move(*Data);
+      E.Size = E.Data.size();
+    }
+  }
+  return llvm::Error::success();
+}
+
+void offloadtest::printMismatchSummary(llvm::raw_ostream &OS,
+                                       const MismatchSummary &S,
+                                       const Tolerance &Tol) {
+  if (S.SizeMismatch) {
+    OS << "  size differs from expected data\n";
+    return;
+  }
+  OS << "  " << S.MismatchCount << " of " << S.ValueCount
+     << " values differ (tolerance: ";
+  switch (Tol.Kind) {
+  case ToleranceKind::Exact:
+    OS << "exact";
+    break;
+  case ToleranceKind::ULP:
+    OS << Tol.ULP << " ULP";
+    break;
+  case ToleranceKind::Abs:
+    OS << "abs " << llvm::format("%g", Tol.Abs);
+    break;
+  }
+  OS << ")\n";
+  OS << "  max error " << llvm::format("%g", S.MaxError) << " at index "
+     << S.MaxErrorIndex << "\n";
+  if (S.FirstMismatches.empty())
+    return;
+  OS << "  first mismatches:";
+  for (uint64_t Idx : S.FirstMismatches)
+    OS << " " << Idx;
+  OS << "\n";
+}
@@ -30,8 +30,13 @@ config.suffixes = [".test", ".yaml"]
 # directories.
 config.excludes = ["Inputs", "CMakeLists.txt", "README.txt", "LICENSE.txt"]
 
-# test_source_root: The root path where tests are located.
+# test_source_root: The root path where tests are located. The perf- suites
+# run only the benchmarks in Perf, which the other suites skip.
 config.test_source_root = os.path.dirname(__file__)
+if config.offloadtest_suite.startswith("perf-"):
+  config.test_source_root = os.path.join(config.test_source_root, "Perf")
+else:
+  config.excludes.append("Perf")
 
 # test_exec_root: The root path where tests should be run.
 config.test_exec_root = os.path.join(config.offloadtest_obj_root, "test", config.offloadtest_suite)
@@ -39,30 +44,76 @@ config.test_exec_root = os.path.join(config.offloadtest_obj_root, "test", config
 tools = [
     ToolSubst("FileCheck", FindTool("FileCheck")),
     ToolSubst("split-file", FindTool("split-file")),
-    ToolSubst("imgdiff", FindTool("imgdiff"))
+    ToolSubst("not", FindTool("not")),
+    ToolSubst("imgdiff", FindTool("imgdiff")),
+    ToolSubst("offload-replay", FindTool("offload-replay")),
+    ToolSubst("offload-stress", FindTool("offload-stress")),
+    ToolSubst("pipeline-gen", FindTool("pipeline-gen"))
 ]
 
+api_query = os.path.join(config.llvm_tools_dir, "api-query")
+query_string = subprocess.check_output(api_query)
+devices = yaml.safe_load(query_string)
+
+# Reuse the parsed pipeline across runs while the test's YAML is unchanged.
+offloader_args = ["-pipeline-cache"]
+
+# Tests run with full host parallelism, so offloader limits how many of them
+# execute on a GPU at once. Software rasterizers run on the host and aren't
+# limited. The limit can be set with --param device_concurrency=N, where 0
+# disables it.
+software_devices = ["Microsoft Basic Render Driver", "llvmpipe", "SwiftShader"]
+hardware_gpu = not config.offloadtest_test_warp and any(
+    not any(name in device['Description'] for name in software_devices)
+    for device in devices['Devices'])
+device_concurrency = lit_config.params.get("device_concurrency", "4" if hardware_gpu else "0")
+if device_concurrency != "0":
+  offloader_args.append("-device-concurrency=%s" % device_concurrency)
+  offloader_args.append("-device-lock-dir=%s" % os.path.join(config.offloadtest_obj_root, "device-locks"))
+
 if config.offloadtest_test_warp:
   config.available_features.add("DirectX-WARP")
-  tools.append(ToolSubst("%offloader", command=FindTool("offloader"), extra_args=["-warp"]))
-else:
-  tools.append(ToolSubst("%offloader", FindTool("offloader")))
+  offloader_args.append("-warp")
+
+# offloader can compile .hlsl source in-process with the clang libraries.
+if config.offloadtest_enable_clang_compiler:
+  config.available_features.add("offloader-hlsl")
+  if os.path.exists(config.offloadtest_dxc_dir):
+    offloader_args.append("-Xcompiler=--dxv-path=%s" % config.offloadtest_dxc_dir)
+tools.append(ToolSubst("%offloader", command=FindTool("offloader"), extra_args=offloader_args))
+
+# Benchmarks are compared against the baselines checked in for each device.
+# --param perf_update_baselines=1 records the results as the new baselines.
+perf_compare_args = ["-baseline-dir=%s" % os.path.join(config.offloadtest_src_root, "test", "Perf", "Baselines")]
+if lit_config.params.get("perf_update_baselines"):
+  perf_compare_args.append("-update")
+tools.append(ToolSubst("%perf-compare", command=FindTool("perf-compare"), extra_args=perf_compare_args))
+
+# Shader compiles go through compile-cache, which reuses the output of an
+# identical compile from another suite or an earlier run.
+def add_dxc(compiler, extra_args=[]):
+  if config.offloadtest_compile_cache:
+    config.environment["OFFLOADTEST_COMPILE_CACHE_DIR"] = config.offloadtest_compile_cache_dir
+    tools.append(ToolSubst("dxc", command=FindTool("compile-cache"), extra_args=[compiler] + extra_args))
+  else:
+    tools.append(ToolSubst("dxc", command=compiler, extra_args=extra_args))
 
 if config.offloadtest_test_clang:
+  clang_dxc_args = []
   if os.path.exists(config.offloadtest_dxc_dir):
-    tools.append(ToolSubst("dxc", FindTool("clang-dxc"), extra_args=["--dxv-path=%s" % config.offloadtest_dxc_dir]))
+    clang_dxc_args = ["--dxv-path=%s" % config.offloadtest_dxc_dir]
+  clang_dxc = lit.util.which("clang-dxc", config.llvm_tools_dir)
+  if clang_dxc:
+    add_dxc('"' + clang_dxc + '"', clang_dxc_args)
   else:
-    tools.append(ToolSubst("dxc", FindTool("clang-dxc")))
+    # Left for lit to report as missing.
+    tools.append(ToolSubst("dxc", FindTool("clang-dxc"), extra_args=clang_dxc_args))
   config.available_features.add("Clang")
 else:
-  tools.append(ToolSubst("dxc", config.offloadtest_dxc))
+  add_dxc(config.offloadtest_dxc)
 
 llvm_config.add_tool_substitutions(tools, config.llvm_tools_dir)
 
-api_query = os.path.join(config.llvm_tools_dir, "api-query")
-query_string = subprocess.check_output(api_query)
-devices = yaml.safe_load(query_string)
-
 for device in devices['Devices']:
   if device['API'] == "DirectX" and config.offloadtest_enable_d3d12:
     config.available_features.add("DirectX")
@@ -77,4 +128,8 @@ for device in devices['Devices']:
 
 if os.path.exists(config.goldenimage_dir):
   config.substitutions.append(("%goldenimage_dir", config.goldenimage_dir))
+  # Golden images are only decoded and converted to L*a*b* once. Only pass
+  # this to imgdiff when the expected image is a golden image.
+  golden_cache = os.path.join(config.offloadtest_obj_root, "golden-cache")
+  config.substitutions.append(("%golden_cache", "-golden-cache=" + golden_cache))
   config.available_features.add("goldenimage")
@@ -33,6 +33,7 @@ int main(int ArgC, char **ArgV) {
   for (const auto &D : Device::devices()) {
     outs() << "- API: " << D->getAPIName() << "\n";
     outs() << "  Description: " << D->getDescription() << "\n";
+    outs() << "  DriverVersion: '" << D->getDriverVersion() << "'\n";
     outs() << "  Features: \n";
     for (const auto &C : D->getCapabilities()) {
       outs() << "    ";
@@ -0,0 +1,326 @@
+//===- compile-cache.cpp - Shader Compilation Cache -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs a shader compiler, reusing the result of an identical earlier run:
+//
+//   compile-cache <compiler> <compiler arguments>...
+//
+// A compile is identified by the compiler binary (its path, size and
+// modification time), the arguments, and the contents of every file named on
+// the command line. Files are identified by their contents alone, so the same
+// shader compiled from each suite's own temporary directory is a hit. The
+// output file given with -Fo (or -o), and the compiler's stdout and stderr,
+// are stored in the cache directory and replayed on later hits. Failed
+// compiles are never cached, and neither are compiles that write other outputs
+// or whose sources #include other files, since those inputs aren't part of the
+// key.
+//
+// The cache lives in $OFFLOADTEST_COMPILE_CACHE_DIR, or in the user's cache
+// directory if that isn't set. Setting OFFLOADTEST_COMPILE_CACHE=off runs the
+// compiler directly.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <optional>
+#include <string>
+
+using namespace llvm;
+
+static constexpr StringLiteral EntryMagic = "OTCC";
+static constexpr uint32_t EntryVersion = 1;
+
+namespace {
+
+// A cached compile: the compiler's output streams and the output file, if the
+// compile wrote one.
+struct CacheEntry {
+  std::string Stdout;
+  std::string Stderr;
+  std::optional<std::string> Output;
+};
+
+struct Invocation {
+  std::string Compiler;
+  SmallVector<StringRef> Args;
+  std::string OutputPath;
+  // Index in Args of the output path, which is not part of the key since
+  // split-file and lit give every test its own temporary directory.
+  size_t OutputArg = ~size_t(0);
+  bool Cacheable = true;
+};
+
+} // namespace
+
+static ExitOnError ExitOnErr("compile-cache: error: ");
+
+// Returns true if A is the option Opt, spelled with a dash or, on Windows
+// where a leading slash can't start an absolute path, with a slash.
+static bool isOption(StringRef A, StringRef Opt, bool AllowJoined) {
+  bool Windows = false;
+#ifdef _WIN32
+  Windows = true;
+#endif
+  if (!A.consume_front("-") && !(Windows && A.consume_front("/")))
+    return false;
+  return AllowJoined ? A.starts_with(Opt) : A == Opt;
+}
+
+static void parseArguments(Invocation &I) {
+  for (size_t Idx = 0; Idx < I.Args.size(); ++Idx) {
+    StringRef A = I.Args[Idx];
+    if ((isOption(A, "Fo", false) || A == "-o") && Idx + 1 < I.Args.size()) {
+      I.OutputArg = ++Idx;
+      I.OutputPath = I.Args[Idx].str();
+    } else if (isOption(A, "Fo", true)) {
+      I.OutputArg = Idx;
+      I.OutputPath = A.drop_front(3).str();
+    } else if (isOption(A, "F", true)) {
+      // Other outputs, such as disassembly or reflection, are not cached.
+      I.Cacheable = false;
+    }
+  }
+}
+
+// Returns the cache key of the invocation, or std::nullopt if it can't be
+// cached.
+static std::optional<uint64_t> computeKey(const Invocation &I) {
+  SmallString<1024> Key;
+  raw_svector_ostream OS(Key);
+  OS << EntryMagic << EntryVersion << '\0';
+
+  sys::fs::file_status Status;
+  if (sys::fs::status(I.Compiler, Status))
+    return std::nullopt;
+  OS << I.Compiler << '\0' << Status.getSize() << '\0'
+     << Status.getLastModificationTime().time_since_epoch().count() << '\0';
+
+  for (size_t Idx = 0; Idx < I.Args.size(); ++Idx) {
+    if (Idx == I.OutputArg) {
+      OS << "<output>" << '\0';
+      continue;
+    }
+    StringRef A = I.Args[Idx];
+    if (!sys::fs::is_regular_file(A)) {
+      OS << A << '\0';
+      continue;
+    }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(A);
+    if (!File)
+      return std::nullopt;
+    StringRef Contents = (*File)->getBuffer();
+    if (Contents.contains("#include"))
+      return std::nullopt;
+    OS << "<file>" << '\0' << xxHash64(Contents) << '\0';
+  }
+  return xxHash64(Key);
+}
+
+static std::string getEntryPath(StringRef Dir, uint64_t Key) {
+  SmallString<256> Path(Dir);
+  sys::path::append(Path, utohexstr(Key, /*LowerCase=*/true) + ".entry");
+  return std::string(Path);
+}
+
+static std::optional<CacheEntry> readEntry(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  if (!File)
+    return std::nullopt;
+  StringRef Data = (*File)->getBuffer();
+  auto ReadU64 = [&Data](uint64_t &V) {
+    if (Data.size() < sizeof(V))
+      return false;
+    V = support::endian::read64le(Data.data());
+    Data = Data.drop_front(sizeof(V));
+    return true;
+  };
+  auto ReadString = [&](std::string &S) {
+    uint64_t Size;
+    if (!ReadU64(Size) || Size > Data.size())
+      return false;
+    S = Data.take_front(Size).str();
+    Data = Data.drop_front(Size);
+    return true;
+  };
+
+  if (!Data.consume_front(EntryMagic) || Data.size() < sizeof(uint32_t) ||
+      support::endian::read32le(Data.data()) != EntryVersion)
+    return std::nullopt;
+  Data = Data.drop_front(sizeof(uint32_t));
+  CacheEntry E;
+  uint64_t HasOutput;
+  if (!ReadString(E.Stdout) || !ReadString(E.Stderr) || !ReadU64(HasOutput))
+    return std::nullopt;
+  if (HasOutput && !ReadString(E.Output.emplace()))
+    return std::nullopt;
+  return E;
+}
+
+// Writes the entry to a temporary file and renames it into place, so
+// concurrent compiles of the same shader never see a partial entry.
+static void writeEntry(StringRef Dir, StringRef Path, const CacheEntry &E) {
+  if (sys::fs::create_directories(Dir))
+    return;
+  SmallString<256> TempPath;
+  int FD;
+  if (sys::fs::createUniqueFile(Path + ".tmp-%%%%%%%%", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    auto WriteU64 = [&OS](uint64_t V) {
+      char Buf[sizeof(V)];
+      support::endian::write64le(Buf, V);
+      OS.write(Buf, sizeof(Buf));
+    };
+    char Version[sizeof(EntryVersion)];
+    support::endian::write32le(Version, EntryVersion);
+    OS << EntryMagic;
+    OS.write(Version, sizeof(Version));
+    WriteU64(E.Stdout.size());
+    OS << E.Stdout;
+    WriteU64(E.Stderr.size());
+    OS << E.Stderr;
+    WriteU64(E.Output ? 1 : 0);
+    if (E.Output) {
+      WriteU64(E.Output->size());
+      OS << *E.Output;
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, Path))
+    sys::fs::remove(TempPath);
+}
+
+static int replayEntry(const Invocation &I, const CacheEntry &E) {
+  if (E.Output) {
+    std::error_code EC;
+    raw_fd_ostream OS(I.OutputPath, EC, sys::fs::OF_None);
+    ExitOnErr(errorCodeToError(EC));
+    OS << *E.Output;
+  }
+  outs() << E.Stdout;
+  errs() << E.Stderr;
+  return 0;
+}
+
+static std::string readFileOrEmpty(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  return File ? (*File)->getBuffer().str() : std::string();
+}
+
+static int runCompiler(const Invocation &I,
+                       ArrayRef<std::optional<StringRef>> Redirects) {
+  SmallVector<StringRef> Argv = {I.Compiler};
+  Argv.append(I.Args.begin(), I.Args.end());
+  std::string ErrMsg;
+  int Result = sys::ExecuteAndWait(I.Compiler, Argv, /*Env=*/std::nullopt,
+                                   Redirects, /*SecondsToWait=*/0,
+                                   /*MemoryLimit=*/0, &ErrMsg);
+  if (Result < 0)
+    ExitOnErr(createStringError(std::errc::no_such_file_or_directory,
+                                "could not run '%s': %s", I.Compiler.c_str(),
+                                ErrMsg.c_str()));
+  return Result;
+}
+
+// Runs the compiler with its output streams captured, then prints them and
+// stores the result if the compile succeeded.
+static int compileAndStore(const Invocation &I, StringRef Dir,
+                           StringRef EntryPath) {
+  SmallString<128> StdoutPath, StderrPath;
+  ExitOnErr(errorCodeToError(
+      sys::fs::createTemporaryFile("compile-cache", "out", StdoutPath)));
+  ExitOnErr(errorCodeToError(
+      sys::fs::createTemporaryFile("compile-cache", "err", StderrPath)));
+  std::optional<StringRef> Redirects[] = {std::nullopt, StringRef(StdoutPath),
+                                          StringRef(StderrPath)};
+  int Result = runCompiler(I, Redirects);
+
+  CacheEntry E;
+  E.Stdout = readFileOrEmpty(StdoutPath);
+  E.Stderr = readFileOrEmpty(StderrPath);
+  sys::fs::remove(StdoutPath);
+  sys::fs::remove(StderrPath);
+  outs() << E.Stdout;
+  errs() << E.Stderr;
+  if (Result != 0)
+    return Result;
+
+  if (!I.OutputPath.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Output =
+        MemoryBuffer::getFile(I.OutputPath, /*IsText=*/false,
+                              /*RequiresNullTerminator=*/false);
+    if (!Output)
+      return 0;
+    E.Output = (*Output)->getBuffer().str();
+  }
+  writeEntry(Dir, EntryPath, E);
+  return 0;
+}
+
+static std::string getCacheDirectory() {
+  if (std::optional<std::string> Dir =
+          sys::Process::GetEnv("OFFLOADTEST_COMPILE_CACHE_DIR"))
+    return *Dir;
+  SmallString<256> Dir;
+  if (!sys::path::cache_directory(Dir))
+    return "";
+  sys::path::append(Dir, "offloadtest", "compile-cache");
+  return std::string(Dir);
+}
+
+int main(int ArgC, char **ArgV) {
+  InitLLVM X(ArgC, ArgV);
+  if (ArgC < 2) {
+    errs() << "usage: compile-cache <compiler> [<compiler arguments>...]\n";
+    return 1;
+  }
+
+  Invocation I;
+  I.Compiler = ArgV[1];
+  if (!sys::path::has_parent_path(I.Compiler)) {
+    ErrorOr<std::string> Path = sys::findProgramByName(I.Compiler);
+    ExitOnErr(errorCodeToError(Path.getError()));
+    I.Compiler = *Path;
+  }
+  for (int Idx = 2; Idx < ArgC; ++Idx)
+    I.Args.push_back(ArgV[Idx]);
+  parseArguments(I);
+
+  std::optional<std::string> Mode =
+      sys::Process::GetEnv("OFFLOADTEST_COMPILE_CACHE");
+  std::string Dir = getCacheDirectory();
+  std::optional<uint64_t> Key;
+  if (I.Cacheable && !Dir.empty() && (!Mode || *Mode != "off"))
+    Key = computeKey(I);
+  if (!Key)
+    return runCompiler(I, {});
+
+  std::string EntryPath = getEntryPath(Dir, *Key);
+  if (std::optional<CacheEntry> E = readEntry(EntryPath))
+    return replayEntry(I, *E);
+  return compileAndStore(I, Dir, EntryPath);
+}
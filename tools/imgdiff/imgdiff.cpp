@@ -11,12 +11,14 @@
 
 #include "Image/Color.h"
 #include "Image/Image.h"
+#include "Image/ImageCache.h"
 #include "Image/ImageComparators.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/InitLLVM.h"
+#include <optional>
 #include <string>
 
 using namespace llvm;
@@ -45,12 +47,32 @@ static cl::opt<std::string> OutputFilename("o", cl::desc("Output filename"),
 static cl::opt<std::string> RulesFilename("rules", cl::desc("Rules filename"),
                                           cl::value_desc("filename"));
 
+static cl::opt<std::string> GoldenCache(
+    "golden-cache",
+    cl::desc("Directory caching the expected image decoded and converted to "
+             "L*a*b*, keyed by the contents of its PNG file"),
+    cl::value_desc("directory"));
+
 int main(int ArgC, char **ArgV) {
   InitLLVM X(ArgC, ArgV);
   cl::ParseCommandLineOptions(ArgC, ArgV, "Image Comparison Tool");
   ExitOnError ExitOnErr("imgdiff: error: ");
 
-  Image ExpectedImage = ExitOnErr(Image::loadPNG(ExpectedPath));
+  // The expected image is normally a golden image, which is only decoded and
+  // converted the first time it is compared with -golden-cache.
+  std::optional<CachedImage> CachedExpected;
+  std::optional<Image> LoadedExpected;
+  ImageRef ExpectedImage;
+  const float *const *ExpectedLAB = nullptr;
+  if (!GoldenCache.empty()) {
+    CachedExpected.emplace(
+        ExitOnErr(CachedImage::load(ExpectedPath, GoldenCache)));
+    ExpectedImage = CachedExpected->getImage();
+    ExpectedLAB = CachedExpected->getLAB();
+  } else {
+    LoadedExpected.emplace(ExitOnErr(Image::loadPNG(ExpectedPath)));
+    ExpectedImage = *LoadedExpected;
+  }
   Image ActualImage = ExitOnErr(Image::loadPNG(ActualPath));
   if (ExpectedImage.size() != ActualImage.size())
     ExitOnErr(createStringError(std::errc::executable_format_error,
@@ -82,7 +104,8 @@ int main(int ArgC, char **ArgV) {
       Cmps.push_back(make_comparator<ImageComparatorDiffImage>(
           ExpectedImage.getHeight(), ExpectedImage.getWidth(), OutputFilename));
 
-    ExitOnErr(Image::compareImages(ExpectedImage, ActualImage, Cmps));
+    ExitOnErr(
+        Image::compareImages(ExpectedImage, ActualImage, Cmps, ExpectedLAB));
 
     bool Success = true;
     for (auto &Cmp : Cmps)
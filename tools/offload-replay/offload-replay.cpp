@@ -0,0 +1,201 @@
+//===- offload-replay.cpp - Execution Capture Replay ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Replays a run recorded with offloader -capture on a device of the same API
+// and reports how the results and times differ from the recorded ones:
+//
+//   offload-replay [-repeat=N] [-max-slowdown=F] <capture>
+//
+// Fails if any result differs, or if the median time grew by more than
+// -max-slowdown, so a driver or compiler bisection can run it directly.
+//
+//===----------------------------------------------------------------------===//
+
+#include "API/Device.h"
+#include "Support/Capture.h"
+#include "Support/Pipeline.h"
+#include "Support/ResultCache.h"
+#include "Support/Statistics.h"
+#include "Support/Verification.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+using namespace llvm;
+using namespace offloadtest;
+
+static cl::opt<std::string> InputCapture(cl::Positional, cl::Required,
+                                         cl::desc("<capture>"),
+                                         cl::value_desc("filename"));
+
+static cl::opt<unsigned>
+    Repeat("repeat",
+           cl::desc("Number of times to execute (default: as many as were "
+                    "recorded)"),
+           cl::value_desc("N"), cl::init(0));
+
+static cl::opt<bool> UseWarp("warp", cl::desc("Use warp"));
+
+static cl::opt<uint64_t>
+    CompareULP("ulp",
+               cl::desc("Allow floating point results to differ from the "
+                        "recorded ones by N units in the last place"),
+               cl::value_desc("N"), cl::init(0));
+
+static cl::opt<double>
+    CompareAbs("abs",
+               cl::desc("Allow results to differ from the recorded ones by "
+                        "an absolute amount"),
+               cl::value_desc("delta"), cl::init(0.0));
+
+static cl::opt<double> MaxSlowdown(
+    "max-slowdown",
+    cl::desc("Fail if the median time exceeds the recorded one by more than "
+             "this fraction (0 only reports times)"),
+    cl::init(0.0));
+
+static cl::opt<unsigned> MaxReportedMismatches(
+    "max-mismatches",
+    cl::desc("Number of mismatching indices to report per resource"),
+    cl::init(8));
+
+static ExitOnError ExitOnErr("offload-replay: error: ");
+
+// Compares every ReadWrite resource of Replayed to the recorded results.
+// Returns the number of resources that differ.
+static unsigned compareResults(const Pipeline &Replayed,
+                               const Pipeline &Recorded) {
+  Tolerance Tol;
+  if (CompareULP > 0) {
+    Tol.Kind = ToleranceKind::ULP;
+    Tol.ULP = CompareULP;
+  } else if (CompareAbs > 0.0) {
+    Tol.Kind = ToleranceKind::Abs;
+    Tol.Abs = CompareAbs;
+  }
+
+  unsigned Differences = 0;
+  for (size_t SetIdx = 0; SetIdx < Recorded.Sets.size(); ++SetIdx) {
+    const auto &Resources = Recorded.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &Rec = Resources[ResIdx];
+      const Resource &Rep = Replayed.Sets[SetIdx].Resources[ResIdx];
+      if (Rec.Access != DataAccess::ReadWrite)
+        continue;
+      MismatchSummary S =
+          compareData(Rec.Format, {Rep.Data.data(), Rep.Size},
+                      {Rec.Data.data(), Rec.Size}, Tol, MaxReportedMismatches);
+      outs() << "Set " << SetIdx << ", resource " << ResIdx;
+      if (!Rec.OutputProps.Name.empty())
+        outs() << " (" << Rec.OutputProps.Name << ")";
+      if (S.passed()) {
+        outs() << ": " << (S.MaxError == 0.0 ? "identical" : "within tolerance")
+               << "\n";
+        continue;
+      }
+      ++Differences;
+      outs() << ": differs\n";
+      printMismatchSummary(outs(), S, Tol);
+    }
+  }
+  return Differences;
+}
+
+// Prints the recorded and replayed median times. Returns true if the replay
+// is slower than -max-slowdown allows.
+static bool compareTimes(StringRef Label, ArrayRef<double> Recorded,
+                         ArrayRef<double> Replayed) {
+  double Before = getMedian(Recorded);
+  double After = getMedian(Replayed);
+  double Change = Before > 0.0 ? After / Before - 1.0 : 0.0;
+  bool Slower = MaxSlowdown > 0.0 && Change > MaxSlowdown;
+  outs() << format("%-5s recorded %10.3f ms, replayed %10.3f ms (%+.1f%%)",
+                   Label.str().c_str(), Before, After, Change * 100.0)
+         << (Slower ? " SLOWER" : "") << "\n";
+  return Slower;
+}
+
+int main(int ArgC, char **ArgV) {
+  InitLLVM X(ArgC, ArgV);
+  cl::ParseCommandLineOptions(ArgC, ArgV, "Execution Capture Replay");
+
+  Capture C = ExitOnErr(readCapture(InputCapture));
+  if (!hasResultLayout(C.Outputs, C.Inputs))
+    ExitOnErr(createStringError(std::errc::illegal_byte_sequence,
+                                "The results in %s don't match its pipeline",
+                                InputCapture.c_str()));
+  ExitOnErr(Device::initialize());
+  // Prefers the recorded device, then any other of the same API.
+  Device *D = Device::findDevice(C.API, C.DeviceDescription, UseWarp);
+  if (!D)
+    ExitOnErr(createStringError(std::errc::no_such_device,
+                                "No %s device to replay on", C.API.c_str()));
+
+  outs() << "Recorded on " << C.DeviceDescription << " (driver "
+         << C.DriverVersion << ")\n";
+  outs() << "Replaying on " << D->getDescription() << " (driver "
+         << D->getDriverVersion() << ")\n";
+
+  unsigned Runs = Repeat ? Repeat : std::max<size_t>(C.Runs.size(), 1);
+  SmallVector<double> HostTimes, GPUTimes;
+  Pipeline Replayed;
+  for (unsigned I = 0; I < Runs; ++I) {
+    Replayed = C.Inputs.clone();
+    ExecutionTimes Times;
+    auto Start = std::chrono::steady_clock::now();
+    ExitOnErr(D->executeProgram(C.Program, Replayed, Times));
+    std::chrono::duration<double, std::milli> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    HostTimes.push_back(Elapsed.count());
+    if (Times.hasGPUTime())
+      GPUTimes.push_back(Times.GPUMilliseconds);
+  }
+
+  unsigned Differences = compareResults(Replayed, C.Outputs);
+
+  SmallVector<double> RecordedHost, RecordedGPU;
+  for (const CaptureRun &Run : C.Runs) {
+    RecordedHost.push_back(Run.HostMilliseconds);
+    if (Run.hasGPUTime())
+      RecordedGPU.push_back(Run.GPUMilliseconds);
+  }
+  bool Slower = false;
+  if (!C.Runs.empty()) {
+    outs() << "Median times of " << C.Runs.size() << " recorded and " << Runs
+           << " replayed run(s):\n";
+    // The GPU time decides whether the replay is slower when both devices
+    // could time the dispatch, otherwise the host time does.
+    bool HasGPUTimes =
+        RecordedGPU.size() == C.Runs.size() && GPUTimes.size() == Runs;
+    if (HasGPUTimes)
+      Slower = compareTimes("GPU:", RecordedGPU, GPUTimes);
+    bool HostSlower = compareTimes("Host:", RecordedHost, HostTimes);
+    if (!HasGPUTimes)
+      Slower = HostSlower;
+  }
+
+  if (Differences)
+    ExitOnErr(createStringError(std::errc::result_out_of_range,
+                                "%u resource(s) differ from the recorded "
+                                "results",
+                                Differences));
+  if (Slower)
+    ExitOnErr(createStringError(std::errc::timed_out,
+                                "Replay is more than %.1f%% slower than "
+                                "recorded",
+                                MaxSlowdown * 100.0));
+  return 0;
+}
@@ -0,0 +1,311 @@
+//===- offload-stress.cpp - Concurrent Submission Stress Tool -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Executes a run recorded with offloader -capture from a growing number of
+// host threads at once and reports how throughput and latency scale:
+//
+//   offload-stress [-threads=1,2,4,8] [-duration=S] <capture>
+//
+// Each level runs for the given duration with every thread executing the
+// pipeline back to back. Levels that scale poorly are flagged, separating
+// time spent waiting on the device's own locks from serialization in the
+// driver or on the GPU.
+//
+//===----------------------------------------------------------------------===//
+
+#include "API/Device.h"
+#include "Support/Capture.h"
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace llvm;
+using namespace offloadtest;
+
+static cl::opt<std::string> InputCapture(cl::Positional, cl::Required,
+                                         cl::desc("<capture>"),
+                                         cl::value_desc("filename"));
+
+static cl::list<unsigned>
+    ThreadCounts("threads", cl::CommaSeparated,
+                 cl::desc("Numbers of threads to run with (default: "
+                          "1,2,4,8)"),
+                 cl::value_desc("N,..."));
+
+static cl::opt<double>
+    RunSeconds("duration",
+               cl::desc("Seconds to run each number of threads for"),
+               cl::value_desc("seconds"), cl::init(2.0));
+
+static cl::opt<bool> UseWarp("warp", cl::desc("Use warp"));
+
+static cl::opt<bool>
+    Verify("verify",
+           cl::desc("Check that every execution produces the recorded "
+                    "results exactly"));
+
+static cl::opt<double> MinEfficiency(
+    "min-efficiency",
+    cl::desc("Flag thread counts whose throughput is less than this fraction "
+             "of perfect scaling from the first thread count"),
+    cl::init(0.5));
+
+static cl::opt<double> MaxWaitFraction(
+    "max-wait",
+    cl::desc("Flag thread counts that spend more than this fraction of the "
+             "execution time waiting for the device's locks"),
+    cl::init(0.1));
+
+static ExitOnError ExitOnErr("offload-stress: error: ");
+
+namespace {
+// What one thread measured while running a level.
+struct WorkerResult {
+  SmallVector<double> Latencies;
+  double WaitMilliseconds = 0.0;
+  unsigned Mismatches = 0;
+  std::string Error;
+};
+
+struct LevelResult {
+  unsigned Threads = 0;
+  double Seconds = 0.0;
+  SmallVector<double> Latencies;
+  double WaitMilliseconds = 0.0;
+  unsigned Mismatches = 0;
+
+  double getThroughput() const { return Latencies.size() / Seconds; }
+};
+
+// Lets the threads of a level finish their warm-up before any of them starts
+// being measured.
+class StartGate {
+  std::mutex Mutex;
+  std::condition_variable CV;
+  unsigned Ready = 0;
+  bool Open = false;
+
+public:
+  void arriveAndWait() {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    ++Ready;
+    CV.notify_all();
+    CV.wait(Lock, [this] { return Open; });
+  }
+
+  void waitForAll(unsigned Count) {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    CV.wait(Lock, [&] { return Ready == Count; });
+  }
+
+  void open() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Open = true;
+    CV.notify_all();
+  }
+};
+} // namespace
+
+// Returns true if the ReadWrite resources of P hold exactly the recorded
+// results.
+static bool matchesRecorded(const Pipeline &P, const Pipeline &Recorded) {
+  for (size_t SetIdx = 0; SetIdx < Recorded.Sets.size(); ++SetIdx) {
+    const auto &Resources = Recorded.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &Rec = Resources[ResIdx];
+      const Resource &Res = P.Sets[SetIdx].Resources[ResIdx];
+      if (Rec.Access == DataAccess::ReadWrite &&
+          memcmp(Res.Data.data(), Rec.Data.data(), Rec.Size) != 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+static void runWorker(Device &D, const Capture &C, StartGate &Gate,
+                      const std::chrono::steady_clock::time_point &Deadline,
+                      WorkerResult &Result) {
+  // The warm-up execution takes the device's per-thread objects, so creating
+  // them isn't measured.
+  Pipeline P = C.Inputs.clone();
+  if (Error Err = D.executeProgram(C.Program, P))
+    Result.Error = toString(std::move(Err));
+  Gate.arriveAndWait();
+  if (!Result.Error.empty())
+    return;
+
+  while (std::chrono::steady_clock::now() < Deadline) {
+    P = C.Inputs.clone();
+    ExecutionTimes Times;
+    auto Start = std::chrono::steady_clock::now();
+    if (Error Err = D.executeProgram(C.Program, P, Times)) {
+      Result.Error = toString(std::move(Err));
+      return;
+    }
+    std::chrono::duration<double, std::milli> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    Result.Latencies.push_back(Elapsed.count());
+    Result.WaitMilliseconds += Times.WaitMilliseconds;
+    if (Verify && !matchesRecorded(P, C.Outputs))
+      ++Result.Mismatches;
+  }
+}
+
+static Expected<LevelResult> runLevel(Device &D, const Capture &C,
+                                      unsigned Threads) {
+  SmallVector<WorkerResult> Results(Threads);
+  StartGate Gate;
+  std::chrono::steady_clock::time_point Deadline;
+  SmallVector<std::thread> Workers;
+  for (unsigned I = 0; I < Threads; ++I)
+    Workers.emplace_back(runWorker, std::ref(D), std::cref(C), std::ref(Gate),
+                         std::cref(Deadline), std::ref(Results[I]));
+
+  Gate.waitForAll(Threads);
+  auto Start = std::chrono::steady_clock::now();
+  Deadline = Start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::duration<double>(RunSeconds));
+  Gate.open();
+  for (std::thread &T : Workers)
+    T.join();
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+
+  LevelResult Level;
+  Level.Threads = Threads;
+  Level.Seconds = Elapsed.count();
+  for (WorkerResult &R : Results) {
+    if (!R.Error.empty())
+      return createStringError(std::errc::io_error, "%u thread(s): %s",
+                               Threads, R.Error.c_str());
+    Level.Latencies.append(R.Latencies.begin(), R.Latencies.end());
+    Level.WaitMilliseconds += R.WaitMilliseconds;
+    Level.Mismatches += R.Mismatches;
+  }
+  llvm::sort(Level.Latencies);
+  return Level;
+}
+
+// Returns the nearest-rank percentile P of the values in Sorted.
+static double getPercentile(ArrayRef<double> Sorted, double P) {
+  if (Sorted.empty())
+    return 0.0;
+  size_t Rank = static_cast<size_t>(std::ceil(P / 100.0 * Sorted.size()));
+  return Sorted[std::clamp<size_t>(Rank, 1, Sorted.size()) - 1];
+}
+
+static double getWaitFraction(const LevelResult &L) {
+  double Total = 0.0;
+  for (double Latency : L.Latencies)
+    Total += Latency;
+  return Total > 0.0 ? L.WaitMilliseconds / Total : 0.0;
+}
+
+int main(int ArgC, char **ArgV) {
+  InitLLVM X(ArgC, ArgV);
+  cl::ParseCommandLineOptions(ArgC, ArgV, "Concurrent Submission Stress Tool");
+
+  SmallVector<unsigned> Levels(ThreadCounts.begin(), ThreadCounts.end());
+  if (Levels.empty())
+    Levels = {1, 2, 4, 8};
+  if (is_contained(Levels, 0u))
+    ExitOnErr(createStringError(std::errc::invalid_argument,
+                                "-threads must be at least 1"));
+  if (RunSeconds <= 0.0)
+    ExitOnErr(createStringError(std::errc::invalid_argument,
+                                "-duration must be positive"));
+
+  Capture C = ExitOnErr(readCapture(InputCapture));
+  ExitOnErr(Device::initialize());
+  // Prefers the recorded device, then any other of the same API.
+  Device *D = Device::findDevice(C.API, C.DeviceDescription, UseWarp);
+  if (!D)
+    ExitOnErr(createStringError(std::errc::no_such_device,
+                                "No %s device to run on", C.API.c_str()));
+  bool Concurrent = any_of(Levels, [](unsigned T) { return T > 1; });
+  if (Concurrent && !D->supportsConcurrentExecution())
+    ExitOnErr(createStringError(std::errc::not_supported,
+                                "%s devices can't execute from several "
+                                "threads at once",
+                                C.API.c_str()));
+  Device::setShowProgress(false);
+
+  outs() << "Stressing " << D->getDescription() << " (driver "
+         << D->getDriverVersion() << ") for " << RunSeconds
+         << " s per thread count\n";
+  outs() << "Threads Executions    Exec/s  Scaling    p50 ms    p95 ms"
+            "    p99 ms    max ms Lock wait\n";
+
+  SmallVector<LevelResult> Results;
+  for (unsigned Threads : Levels) {
+    LevelResult L = ExitOnErr(runLevel(*D, C, Threads));
+    // Scaling is relative to the throughput of the first thread count run,
+    // normally one thread, so that must have completed executions.
+    if (Results.empty() && L.Latencies.empty())
+      ExitOnErr(createStringError(std::errc::timed_out,
+                                  "No execution finished within %g s with "
+                                  "%u thread(s); increase -duration",
+                                  RunSeconds.getValue(), Threads));
+    const LevelResult &Base = Results.empty() ? L : Results.front();
+    double Scaling = L.getThroughput() / Base.getThroughput();
+    outs() << format("%7u %10zu %9.1f %7.2fx %9.3f %9.3f %9.3f %9.3f %8.1f%%\n",
+                     Threads, L.Latencies.size(), L.getThroughput(), Scaling,
+                     getPercentile(L.Latencies, 50),
+                     getPercentile(L.Latencies, 95),
+                     getPercentile(L.Latencies, 99),
+                     L.Latencies.empty() ? 0.0 : L.Latencies.back(),
+                     getWaitFraction(L) * 100.0);
+    Results.push_back(std::move(L));
+  }
+
+  const LevelResult &Base = Results.front();
+  unsigned Mismatches = 0;
+  for (const LevelResult &L : Results) {
+    Mismatches += L.Mismatches;
+    if (L.Mismatches)
+      outs() << "warning: " << L.Threads << " thread(s): " << L.Mismatches
+             << " execution(s) didn't produce the recorded results\n";
+    if (L.Threads <= Base.Threads)
+      continue;
+    double Efficiency = L.getThroughput() * Base.Threads /
+                        (Base.getThroughput() * L.Threads);
+    double WaitFraction = getWaitFraction(L);
+    if (WaitFraction > MaxWaitFraction)
+      outs() << "warning: " << L.Threads << " threads: "
+             << format("%.1f%%", WaitFraction * 100.0)
+             << " of the execution time is spent waiting for the device's "
+                "locks\n";
+    else if (Efficiency < MinEfficiency)
+      outs() << "warning: " << L.Threads << " threads: "
+             << format("%.0f%%", Efficiency * 100.0)
+             << " scaling efficiency without waiting for the device's locks; "
+                "the driver or the GPU serializes the executions\n";
+  }
+
+  if (Mismatches)
+    ExitOnErr(createStringError(std::errc::result_out_of_range,
+                                "%u execution(s) didn't produce the recorded "
+                                "results",
+                                Mismatches));
+  return 0;
+}
@@ -12,17 +12,36 @@
 #include "API/API.h"
 #include "API/Device.h"
 #include "Config.h"
+#ifdef OFFLOADTEST_ENABLE_CLANG_COMPILER
+#include "Compiler/Compiler.h"
+#endif
 #include "Image/Image.h"
+#include "Support/Capture.h"
+#include "Support/DeviceLock.h"
+#include "Support/OutputSelection.h"
 #include "Support/Pipeline.h"
+#include "Support/PipelineBinary.h"
+#include "Support/ResourceIO.h"
+#include "Support/ResultCache.h"
+#include "Support/Statistics.h"
+#include "Support/Verification.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Regex.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include <string>
 
 using namespace llvm;
@@ -32,9 +51,43 @@ static cl::opt<std::string>
     InputPipeline(cl::Positional, cl::desc("<input pipeline description>"),
                   cl::value_desc("filename"));
 
-static cl::opt<std::string> InputShader(cl::Positional,
-                                        cl::desc("<input compiled shader>"),
-                                        cl::value_desc("filename"));
+static cl::opt<std::string>
+    InputShader(cl::Positional,
+                cl::desc("<input compiled shader, or .hlsl source>"),
+                cl::value_desc("filename"));
+
+static cl::opt<std::string> CompareShader(
+    "compare-shader",
+    cl::desc("Execute this compiled shader, or .hlsl source, on the same "
+             "pipeline as the input shader and report how their results and "
+             "times differ"),
+    cl::value_desc("filename"));
+
+static cl::opt<uint64_t> CompareULP(
+    "compare-ulp",
+    cl::desc("With -compare-shader, allow floating point results to differ "
+             "by N units in the last place"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<double> CompareAbs(
+    "compare-abs",
+    cl::desc("With -compare-shader, allow results to differ by an absolute "
+             "amount"),
+    cl::value_desc("delta"), cl::init(0.0));
+
+static cl::opt<std::string> ShaderProfile(
+    "profile", cl::desc("Target profile to compile .hlsl source with"),
+    cl::value_desc("profile"), cl::init("cs_6_0"));
+
+static cl::opt<std::string>
+    EntryPoint("entry", cl::desc("Entry point of .hlsl source"),
+               cl::value_desc("name"), cl::init("main"));
+
+static cl::list<std::string>
+    CompilerArgs("Xcompiler",
+                 cl::desc("Pass <arg> to the compiler of .hlsl source, as a "
+                          "clang-dxc argument"),
+                 cl::value_desc("arg"));
 
 static cl::opt<GPUAPI>
     APIToUse("api", cl::desc("GPU API to use"), cl::init(GPUAPI::Unknown),
@@ -42,19 +95,145 @@ static cl::opt<GPUAPI>
                         clEnumValN(GPUAPI::Vulkan, "vk", "Vulkan"),
                         clEnumValN(GPUAPI::Metal, "mtl", "Metal")));
 
-static cl::opt<std::string> OutputFilename("o", cl::desc("Output filename"),
-                                           cl::value_desc("filename"),
-                                           cl::init("-"));
+static cl::opt<std::string> OutputFilename(
+    "o",
+    cl::desc("Output filename, or directory for the binary output formats"),
+    cl::value_desc("filename"), cl::init("-"));
 
-static cl::opt<std::string>
-    ImageOutput("r", cl::desc("Resource name to output as png"),
-                cl::value_desc("<name>"), cl::init(""));
+enum class OutputFormat { YAML, Summary, Raw, NumPy, GZip };
+
+static cl::opt<OutputFormat> OutputFormatOpt(
+    "output-format", cl::desc("Format to write result resources in"),
+    cl::init(OutputFormat::YAML),
+    cl::values(
+        clEnumValN(OutputFormat::YAML, "yaml", "The pipeline description"),
+        clEnumValN(OutputFormat::Summary, "summary",
+                   "Summary statistics of each resource"),
+        clEnumValN(OutputFormat::Raw, "bin", "Raw binary, one file each"),
+        clEnumValN(OutputFormat::NumPy, "npy", "NumPy arrays, one file each"),
+        clEnumValN(OutputFormat::GZip, "gz",
+                   "gzip compressed raw binary, one file each")));
+
+static cl::list<std::string> ImageOutputs(
+    "r",
+    cl::desc("Resource to output as png, written to <filename> or, if only "
+             "one is given, to the -o filename"),
+    cl::value_desc("<name>[=<filename>]"));
+
+static cl::opt<bool> AllImageOutputs(
+    "all-images",
+    cl::desc("Output every resource with OutputProps as <name>.png in the -o "
+             "directory"));
 
 static cl::opt<bool>
     Quiet("quiet", cl::desc("Suppress printing the pipeline as output"));
 
 static cl::opt<bool> UseWarp("warp", cl::desc("Use warp"));
 
+static cl::opt<bool> UsePipelineCache(
+    "pipeline-cache",
+    cl::desc("Cache the parsed pipeline in a binary file next to the pipeline "
+             "description and reuse it while the description is unchanged"));
+
+static cl::opt<unsigned> MaxReportedMismatches(
+    "max-mismatches",
+    cl::desc("Number of mismatching indices to report per resource when "
+             "checking expected data"),
+    cl::init(8));
+
+static cl::list<std::string> OutputResources(
+    "output-resource",
+    cl::desc("Only print the named resources, given by OutputProps name or as "
+             "<set>:<index>"),
+    cl::value_desc("name"), cl::CommaSeparated);
+
+static cl::opt<uint64_t>
+    OutputFirst("output-first",
+                cl::desc("Only print the first N elements of each resource"),
+                cl::value_desc("N"), cl::init(0));
+
+static cl::opt<uint64_t>
+    OutputLast("output-last",
+               cl::desc("Only print the last N elements of each resource"),
+               cl::value_desc("N"), cl::init(0));
+
+static cl::opt<uint64_t> OutputStride(
+    "output-stride",
+    cl::desc("Only print every K-th element of each resource"),
+    cl::value_desc("K"), cl::init(1));
+
+static cl::opt<unsigned> HistogramBins(
+    "histogram-bins",
+    cl::desc("Number of histogram bins in -output-format=summary"),
+    cl::init(16));
+
+static cl::opt<std::string> ResultCacheDir(
+    "result-cache",
+    cl::desc("Reuse the results of earlier runs of the same shader and "
+             "pipeline on the same device and driver, stored in <directory>"),
+    cl::value_desc("directory"));
+
+enum class ResultCacheMode { Use, Bypass, Refresh, Verify };
+
+static cl::opt<ResultCacheMode> ResultCacheModeOpt(
+    "result-cache-mode", cl::desc("How -result-cache is used"),
+    cl::init(ResultCacheMode::Use),
+    cl::values(clEnumValN(ResultCacheMode::Use, "use",
+                          "Return cached results, execute and store on a miss"),
+               clEnumValN(ResultCacheMode::Bypass, "bypass",
+                          "Execute without reading or storing results"),
+               clEnumValN(ResultCacheMode::Refresh, "refresh",
+                          "Execute and replace the cached results"),
+               clEnumValN(ResultCacheMode::Verify, "verify",
+                          "Execute on every hit and check the cached results "
+                          "match")));
+
+static cl::opt<unsigned> ResultCacheVerifyEvery(
+    "result-cache-verify-every",
+    cl::desc("In -result-cache-mode=use, execute and verify one in N hits "
+             "chosen at random (0 never verifies)"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<unsigned> DeviceConcurrency(
+    "device-concurrency",
+    cl::desc("Limit the number of processes executing on the device at once "
+             "to N, 0 for no limit"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<std::string> DeviceLockDir(
+    "device-lock-dir",
+    cl::desc("Directory of the lock files -device-concurrency shares between "
+             "processes (default: a directory in the system temp directory)"),
+    cl::value_desc("directory"));
+
+static cl::opt<bool> ExclusiveDevice(
+    "exclusive",
+    cl::desc("Wait for sole use of the device while executing, for timing "
+             "sensitive runs"));
+
+static cl::opt<std::string> TimingJSON(
+    "timing-json",
+    cl::desc("Write the time each execution took to <filename> as JSON"),
+    cl::value_desc("filename"));
+
+static cl::opt<unsigned> TimingRepeat(
+    "timing-repeat",
+    cl::desc("Execute N times, each on a fresh copy of the inputs, and time "
+             "every execution"),
+    cl::value_desc("N"), cl::init(1));
+
+static cl::opt<std::string> CapturePath(
+    "capture",
+    cl::desc("Record the shader, device, inputs, results and execution times "
+             "in <filename> for offload-replay"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string>
+    TimingName("timing-name",
+               cl::desc("Name of the benchmark in the -timing-json output "
+                        "(default: the pipeline file name)"),
+               cl::value_desc("name"));
+
 std::unique_ptr<MemoryBuffer> readFile(const std::string &Path) {
   ExitOnError ExitOnErr("gpu-exec: error: ");
   ErrorOr<std::unique_ptr<MemoryBuffer>> FileOrErr =
@@ -64,37 +243,135 @@ std::unique_ptr<MemoryBuffer> readFile(const std::string &Path) {
   return std::move(FileOrErr.get());
 }
 
-int run();
+// Reads the compiled shader at Path, compiling it first if it is HLSL source.
+// Source is compiled in-process to DXIL for DirectX or SPIR-V for Vulkan.
+std::unique_ptr<MemoryBuffer> readShader(const char *Argv0,
+                                         const std::string &Path) {
+  ExitOnError ExitOnErr("gpu-exec: error: ");
+  if (!StringRef(Path).ends_with(".hlsl"))
+    return readFile(Path);
+#ifdef OFFLOADTEST_ENABLE_CLANG_COMPILER
+  if (APIToUse != GPUAPI::DirectX && APIToUse != GPUAPI::Vulkan)
+    ExitOnErr(createStringError(std::errc::invalid_argument,
+                                "Compiling .hlsl source requires -api=dx or "
+                                "-api=vk"));
+  SmallVector<std::string> Args = {"-T", ShaderProfile, "-E", EntryPoint};
+  if (APIToUse == GPUAPI::Vulkan)
+    Args.push_back("-spirv");
+  Args.append(CompilerArgs.begin(), CompilerArgs.end());
+
+  // One compiler serves every shader, so its targets are set up once and
+  // a -compare-shader source identical to the input is compiled only once.
+  void *MainAddr = reinterpret_cast<void *>(&readShader);
+  static ShaderCompiler Compiler(
+      ShaderCompiler::getClangPathForTool(
+          sys::fs::getMainExecutable(Argv0, MainAddr)),
+      errs());
+  // The compiler owns the object for the rest of the run.
+  StringRef Object = ExitOnErr(Compiler.compile(Path, Args));
+  return MemoryBuffer::getMemBuffer(Object, Path,
+                                    /*RequiresNullTerminator=*/false);
+#else
+  ExitOnErr(createStringError(std::errc::not_supported,
+                              "offloader was built without in-process HLSL "
+                              "compilation"));
+  return nullptr;
+#endif
+}
+
+// Reads the pipeline at Path, setting SourceHash to the hash of its YAML
+// source.
+Pipeline readPipeline(const std::string &Path, uint64_t &SourceHash) {
+  ExitOnError ExitOnErr("gpu-exec: error: ");
+  std::unique_ptr<MemoryBuffer> PipelineBuf = readFile(Path);
+  SourceHash = hashPipelineSource(PipelineBuf->getBuffer());
+
+  std::string CachePath;
+  if (UsePipelineCache && Path != "-") {
+    CachePath = getPipelineBinaryPath(Path);
+    ErrorOr<std::unique_ptr<WritableMemoryBuffer>> CacheOrErr =
+        WritableMemoryBuffer::getFile(CachePath);
+    if (CacheOrErr && getPipelineBinarySourceHash(
+                          (*CacheOrErr)->getMemBufferRef().getBuffer()) ==
+                          SourceHash) {
+      Expected<Pipeline> Cached = readPipelineBinary(std::move(*CacheOrErr));
+      if (Cached)
+        return std::move(*Cached);
+      // A corrupt cache is rebuilt from the description below.
+      consumeError(Cached.takeError());
+    }
+  }
+
+  Pipeline PipelineDesc;
+  yaml::Input YIn(PipelineBuf->getBuffer());
+  YIn >> PipelineDesc;
+  ExitOnErr(llvm::errorCodeToError(YIn.error()));
+
+  // Failing to write the cache is not fatal, the description is
+  // authoritative.
+  if (!CachePath.empty())
+    consumeError(writePipelineBinary(PipelineDesc, SourceHash, CachePath));
+  return PipelineDesc;
+}
+
+// Returns the API a compiled shader is for, or GPUAPI::Unknown.
+GPUAPI identifyAPI(StringRef Program) {
+  if (Program.starts_with("DXBC"))
+    return GPUAPI::DirectX;
+  if (Program.size() >= sizeof(uint32_t) &&
+      *reinterpret_cast<const uint32_t *>(Program.data()) == 0x07230203)
+    return GPUAPI::Vulkan;
+  if (Program.starts_with("MTLB"))
+    return GPUAPI::Metal;
+  return GPUAPI::Unknown;
+}
+
+int run(const char *Argv0);
+unsigned verifyExpected(const Pipeline &P);
+Expected<DeviceLock> lockDevice(const Device &D);
+Error runSweep(Device &D, StringRef Program, const Pipeline &Base);
+Error runCompare(Device &D, StringRef ProgramA, StringRef ProgramB,
+                 const Pipeline &P);
+Error runTimed(Device &D, StringRef Program, Pipeline &P);
+Error runWithResultCache(Device &D, StringRef Program, uint64_t PipelineHash,
+                         Pipeline &P);
+Error writeOutput(Pipeline &P);
+Error writeResourceFiles(const Pipeline &P, ResourceFileFormat Format,
+                         ArrayRef<SmallVector<unsigned>> ResourceIndices);
+Error writeImages(const Pipeline &P);
 
 int main(int ArgC, char **ArgV) {
   InitLLVM X(ArgC, ArgV);
   cl::ParseCommandLineOptions(ArgC, ArgV, "GPU Execution Tool");
 
-  if (run()) {
+  if (run(ArgV[0])) {
     errs() << "No device available.";
     return 1;
   }
   return 0;
 }
 
-int run() {
+int run(const char *Argv0) {
   ExitOnError ExitOnErr("gpu-exec: error: ");
   ExitOnErr(Device::initialize());
 
-  std::unique_ptr<MemoryBuffer> ShaderBuf = readFile(InputShader);
+  std::unique_ptr<MemoryBuffer> ShaderBuf = readShader(Argv0, InputShader);
 
   // Try to guess the API by reading the shader binary.
   if (APIToUse == GPUAPI::Unknown) {
-    if (ShaderBuf->getBuffer().starts_with("DXBC")) {
-      APIToUse = GPUAPI::DirectX;
+    APIToUse = identifyAPI(ShaderBuf->getBuffer());
+    switch (APIToUse) {
+    case GPUAPI::DirectX:
       outs() << "Using DirectX API\n";
-    } else if (*reinterpret_cast<const uint32_t *>(
-                   ShaderBuf->getBuffer().data()) == 0x07230203) {
-      APIToUse = GPUAPI::Vulkan;
+      break;
+    case GPUAPI::Vulkan:
       outs() << "Using Vulkan API\n";
-    } else if (ShaderBuf->getBuffer().starts_with("MTLB")) {
-      APIToUse = GPUAPI::Metal;
+      break;
+    case GPUAPI::Metal:
       outs() << "Using Metal API\n";
+      break;
+    default:
+      break;
     }
   }
 
@@ -107,47 +384,603 @@ int run() {
         createStringError(std::errc::executable_format_error,
                           "Could not identify API to execute provided shader"));
 
-  std::unique_ptr<MemoryBuffer> PipelineBuf = readFile(InputPipeline);
-  Pipeline PipelineDesc;
-  yaml::Input YIn(PipelineBuf->getBuffer());
-  YIn >> PipelineDesc;
-  ExitOnErr(llvm::errorCodeToError(YIn.error()));
+  // Both shaders of a comparison run on the same device, so they must target
+  // the same API.
+  std::unique_ptr<MemoryBuffer> CompareBuf;
+  if (!CompareShader.empty()) {
+    CompareBuf = readShader(Argv0, CompareShader);
+    GPUAPI CompareAPI = identifyAPI(CompareBuf->getBuffer());
+    if (CompareAPI != GPUAPI::Unknown && CompareAPI != APIToUse)
+      ExitOnErr(createStringError(std::errc::executable_format_error,
+                                  "%s is not a shader for the same API as %s",
+                                  CompareShader.c_str(), InputShader.c_str()));
+  }
+
+  uint64_t PipelineHash;
+  Pipeline PipelineDesc = readPipeline(InputPipeline, PipelineHash);
+  if (InputPipeline != "-") {
+    StringRef BaseDir = sys::path::parent_path(InputPipeline);
+    ExitOnErr(loadResourceFiles(PipelineDesc, BaseDir));
+    ExitOnErr(loadExpectedData(PipelineDesc, BaseDir));
+  }
 
   for (const auto &D : Device::devices()) {
     if (D->getAPI() != APIToUse)
       continue;
     if (UseWarp && D->getDescription() != "Microsoft Basic Render Driver")
       continue;
-    ExitOnErr(D->executeProgram(ShaderBuf->getBuffer(), PipelineDesc));
-
-    if (Quiet)
+    if (CompareBuf) {
+      if (!PipelineDesc.Sweep.empty())
+        ExitOnErr(createStringError(std::errc::invalid_argument,
+                                    "-compare-shader cannot run a sweep"));
+      ExitOnErr(runCompare(*D, ShaderBuf->getBuffer(), CompareBuf->getBuffer(),
+                           PipelineDesc));
       return 0;
-
-    std::error_code EC;
-    llvm::sys::fs::OpenFlags OpenFlags = llvm::sys::fs::OF_None;
-    if (ImageOutput.empty()) {
-      OpenFlags |= llvm::sys::fs::OF_Text;
-      auto Out =
-          std::make_unique<llvm::ToolOutputFile>(OutputFilename, EC, OpenFlags);
-      ExitOnErr(llvm::errorCodeToError(EC));
-
-      yaml::Output YOut(Out->os());
-      YOut << PipelineDesc;
-      Out->keep();
+    }
+    if (!PipelineDesc.Sweep.empty()) {
+      ExitOnErr(runSweep(*D, ShaderBuf->getBuffer(), PipelineDesc));
       return 0;
     }
-    for (const auto &S : PipelineDesc.Sets) {
-      for (const auto &R : S.Resources) {
-        if (R.OutputProps.Name == ImageOutput) {
-          ImageRef Img = ImageRef(R);
-          ExitOnErr(Image::writePNG(Img, OutputFilename));
-          return 0;
+
+    // Timed and captured runs always execute, so they bypass the result
+    // cache.
+    if (TimingRepeat > 1 || !TimingJSON.empty() || !CapturePath.empty())
+      ExitOnErr(runTimed(*D, ShaderBuf->getBuffer(), PipelineDesc));
+    else if (!ResultCacheDir.empty() &&
+             ResultCacheModeOpt != ResultCacheMode::Bypass)
+      ExitOnErr(runWithResultCache(*D, ShaderBuf->getBuffer(), PipelineHash,
+                                   PipelineDesc));
+    else {
+      DeviceLock Lock = ExitOnErr(lockDevice(*D));
+      ExitOnErr(D->executeProgram(ShaderBuf->getBuffer(), PipelineDesc));
+    }
+
+    unsigned Failures = verifyExpected(PipelineDesc);
+    if (!Quiet)
+      ExitOnErr(writeOutput(PipelineDesc));
+    if (Failures)
+      ExitOnErr(createStringError(std::errc::result_out_of_range,
+                                  "%u resource(s) did not match expected data",
+                                  Failures));
+    return 0;
+  }
+  return 1;
+}
+
+// Waits until this process may execute on D, as limited by
+// -device-concurrency and -exclusive. Returns an empty lock if neither is
+// given.
+Expected<DeviceLock> lockDevice(const Device &D) {
+  if (DeviceConcurrency == 0 && !ExclusiveDevice)
+    return DeviceLock();
+  SmallString<256> Dir(DeviceLockDir);
+  if (Dir.empty()) {
+    sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Dir);
+    sys::path::append(Dir, "offloadtest-device-locks");
+  }
+  unsigned Concurrency = DeviceConcurrency ? DeviceConcurrency : 1;
+  return DeviceLock::acquire(Dir, D.getDescription(), Concurrency,
+                             ExclusiveDevice);
+}
+
+// Returns true if a result cache hit should be executed and verified anyway.
+static bool shouldVerifyHit() {
+  if (ResultCacheModeOpt == ResultCacheMode::Verify)
+    return true;
+  if (ResultCacheVerifyEvery == 0)
+    return false;
+  std::random_device RD;
+  return std::uniform_int_distribution<unsigned>(
+             0, ResultCacheVerifyEvery - 1)(RD) == 0;
+}
+
+// Compares the results P holds after execution to the cached ones and
+// reports every resource that differs.
+static Error checkCachedResult(const Pipeline &P, const Pipeline &Cached,
+                               StringRef EntryPath) {
+  unsigned Failures = 0;
+  Tolerance Exact;
+  for (size_t SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const auto &Resources = P.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &R = Resources[ResIdx];
+      const Resource &C = Cached.Sets[SetIdx].Resources[ResIdx];
+      MismatchSummary S =
+          compareData(R.Format, {R.Data.data(), R.Size},
+                      {C.Data.data(), C.Size}, Exact, MaxReportedMismatches);
+      if (S.passed())
+        continue;
+      ++Failures;
+      errs() << "Cached result mismatch in set " << SetIdx << ", resource "
+             << ResIdx;
+      if (!R.OutputProps.Name.empty())
+        errs() << " (" << R.OutputProps.Name << ")";
+      errs() << ":\n";
+      printMismatchSummary(errs(), S, Exact);
+    }
+  }
+  if (Failures)
+    return createStringError(std::errc::result_out_of_range,
+                             "%u resource(s) did not match the result cached "
+                             "in %s",
+                             Failures, EntryPath.str().c_str());
+  return Error::success();
+}
+
+// Executes P on D unless the result cache holds its results already. The
+// device is still enumerated on a hit, since its description and driver
+// version are part of the key, but nothing is created or run on it.
+Error runWithResultCache(Device &D, StringRef Program, uint64_t PipelineHash,
+                         Pipeline &P) {
+  ResultKeyInputs K;
+  K.Program = Program;
+  K.PipelineHash = PipelineHash;
+  K.Inputs = &P;
+  K.API = D.getAPIName();
+  K.DeviceDescription = D.getDescription();
+  K.DriverVersion = D.getDriverVersion();
+  uint64_t Key = getResultKey(K);
+
+  std::optional<Pipeline> Cached;
+  if (ResultCacheModeOpt != ResultCacheMode::Refresh)
+    Cached = lookupResult(ResultCacheDir, Key);
+  // An entry that doesn't fit the pipeline is a miss, and is replaced below.
+  if (Cached && !hasResultLayout(*Cached, P))
+    Cached.reset();
+  if (Cached && !shouldVerifyHit()) {
+    applyResult(P, *Cached);
+    return Error::success();
+  }
+
+  {
+    Expected<DeviceLock> Lock = lockDevice(D);
+    if (!Lock)
+      return Lock.takeError();
+    if (Error Err = D.executeProgram(Program, P))
+      return Err;
+  }
+  Error CheckErr =
+      Cached ? checkCachedResult(P, *Cached,
+                                 getResultCachePath(ResultCacheDir, Key))
+             : Error::success();
+  if (Cached) {
+    if (!CheckErr)
+      return Error::success();
+    // The device's result replaces the mismatching entry, which must be
+    // unmapped first.
+    Cached.reset();
+  }
+  // Failing to store the result is not fatal, it is still printed.
+  consumeError(storeResult(ResultCacheDir, Key, P));
+  return CheckErr;
+}
+
+// Returns the minimum, median and mean of Values as a JSON object.
+static json::Object summarizeTimes(ArrayRef<double> Values) {
+  double Sum = 0.0;
+  for (double V : Values)
+    Sum += V;
+  return json::Object{{"min", *std::min_element(Values.begin(), Values.end())},
+                      {"median", getMedian(Values)},
+                      {"mean", Sum / Values.size()}};
+}
+
+// Executes P -timing-repeat times and writes the times to -timing-json, and
+// the whole run to -capture. Every execution starts from a copy of the inputs,
+// and the last one leaves its results in P.
+Error runTimed(Device &D, StringRef Program, Pipeline &P) {
+  if (TimingRepeat == 0)
+    return createStringError(std::errc::invalid_argument,
+                             "-timing-repeat must be at least 1");
+  Capture C;
+  if (!CapturePath.empty())
+    C.Inputs = P.clone();
+  {
+    Expected<DeviceLock> Lock = lockDevice(D);
+    if (!Lock)
+      return Lock.takeError();
+    for (unsigned I = 0; I < TimingRepeat; ++I) {
+      Pipeline Copy;
+      bool Last = I + 1 == TimingRepeat;
+      if (!Last)
+        Copy = P.clone();
+      ExecutionTimes Times;
+      auto Start = std::chrono::steady_clock::now();
+      if (Error Err = D.executeProgram(Program, Last ? P : Copy, Times))
+        return Err;
+      std::chrono::duration<double, std::milli> Elapsed =
+          std::chrono::steady_clock::now() - Start;
+      C.Runs.push_back({Elapsed.count(), Times.GPUMilliseconds});
+    }
+  }
+
+  if (!CapturePath.empty()) {
+    C.API = D.getAPIName().str();
+    C.DeviceDescription = D.getDescription().str();
+    C.DriverVersion = D.getDriverVersion().str();
+    C.Program = Program.str();
+    C.Outputs = P.clone();
+    if (Error Err = writeCapture(C, CapturePath))
+      return Err;
+  }
+  if (TimingJSON.empty())
+    return Error::success();
+
+  SmallVector<double> GPUTimes, HostTimes;
+  for (const CaptureRun &Run : C.Runs) {
+    HostTimes.push_back(Run.HostMilliseconds);
+    if (Run.hasGPUTime())
+      GPUTimes.push_back(Run.GPUMilliseconds);
+  }
+  std::string Name = TimingName;
+  if (Name.empty())
+    Name = sys::path::stem(InputPipeline).str();
+  json::Object Result{{"name", Name},
+                      {"api", D.getAPIName()},
+                      {"device", D.getDescription()},
+                      {"driver", D.getDriverVersion()},
+                      {"runs", static_cast<int64_t>(TimingRepeat)},
+                      {"host_ms", json::Array(HostTimes)},
+                      {"host", summarizeTimes(HostTimes)}};
+  // Not every device can time the dispatch itself.
+  if (GPUTimes.size() == HostTimes.size()) {
+    Result["gpu_ms"] = json::Array(GPUTimes);
+    Result["gpu"] = summarizeTimes(GPUTimes);
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(TimingJSON, EC, sys::fs::OF_Text);
+  if (EC)
+    return createFileError(TimingJSON, EC);
+  Out.os() << formatv("{0:2}", json::Value(std::move(Result))) << "\n";
+  Out.keep();
+  return Error::success();
+}
+
+// Executes ProgramA and ProgramB on copies of P, -timing-repeat times each
+// with the runs interleaved, then reports every ReadWrite resource whose
+// results differ and the relative times. Read-only inputs are shared by the
+// copies rather than duplicated.
+Error runCompare(Device &D, StringRef ProgramA, StringRef ProgramB,
+                 const Pipeline &P) {
+  if (TimingRepeat == 0)
+    return createStringError(std::errc::invalid_argument,
+                             "-timing-repeat must be at least 1");
+  struct Variant {
+    StringRef Program;
+    Pipeline Result;
+    SmallVector<double> GPUTimes;
+    SmallVector<double> HostTimes;
+  };
+  Variant Variants[2];
+  Variants[0].Program = ProgramA;
+  Variants[1].Program = ProgramB;
+  {
+    // The device is held for all runs so their times are comparable.
+    Expected<DeviceLock> Lock = lockDevice(D);
+    if (!Lock)
+      return Lock.takeError();
+    for (unsigned I = 0; I < TimingRepeat; ++I) {
+      for (Variant &V : Variants) {
+        V.Result = P.clone();
+        ExecutionTimes Times;
+        auto Start = std::chrono::steady_clock::now();
+        if (Error Err = D.executeProgram(V.Program, V.Result, Times))
+          return Err;
+        std::chrono::duration<double, std::milli> Elapsed =
+            std::chrono::steady_clock::now() - Start;
+        V.HostTimes.push_back(Elapsed.count());
+        if (Times.hasGPUTime())
+          V.GPUTimes.push_back(Times.GPUMilliseconds);
+      }
+    }
+  }
+
+  Tolerance DefaultTol;
+  if (CompareULP > 0) {
+    DefaultTol.Kind = ToleranceKind::ULP;
+    DefaultTol.ULP = CompareULP;
+  } else if (CompareAbs > 0.0) {
+    DefaultTol.Kind = ToleranceKind::Abs;
+    DefaultTol.Abs = CompareAbs;
+  }
+
+  outs() << "Comparing " << InputShader << " (A) to " << CompareShader
+         << " (B) on " << D.getDescription() << ":\n";
+  unsigned Differences = 0;
+  const Pipeline &A = Variants[0].Result;
+  const Pipeline &B = Variants[1].Result;
+  for (size_t SetIdx = 0; SetIdx < A.Sets.size(); ++SetIdx) {
+    const auto &Resources = A.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &RA = Resources[ResIdx];
+      const Resource &RB = B.Sets[SetIdx].Resources[ResIdx];
+      if (RA.Access != DataAccess::ReadWrite)
+        continue;
+      // A resource's own Expected tolerance is how much it may vary.
+      const Tolerance &Tol = RA.Expected.Tol.Kind != ToleranceKind::Exact
+                                 ? RA.Expected.Tol
+                                 : DefaultTol;
+      MismatchSummary S =
+          compareData(RA.Format, {RB.Data.data(), RB.Size},
+                      {RA.Data.data(), RA.Size}, Tol, MaxReportedMismatches);
+      outs() << "Set " << SetIdx << ", resource " << ResIdx;
+      if (!RA.OutputProps.Name.empty())
+        outs() << " (" << RA.OutputProps.Name << ")";
+      if (S.passed()) {
+        outs() << ": " << (S.MaxError == 0.0 ? "identical" : "within tolerance")
+               << "\n";
+        continue;
+      }
+      ++Differences;
+      outs() << ": differs\n";
+      printMismatchSummary(outs(), S, Tol);
+    }
+  }
+
+  auto PrintTimes = [&](StringRef Label, ArrayRef<double> TimesA,
+                        ArrayRef<double> TimesB) {
+    double MedianA = getMedian(TimesA);
+    double MedianB = getMedian(TimesB);
+    outs() << format("%-5s A %10.3f ms, B %10.3f ms", Label.str().c_str(),
+                     MedianA, MedianB);
+    if (MedianA > 0.0)
+      outs() << format(" (B/A %.3fx)", MedianB / MedianA);
+    outs() << "\n";
+  };
+  outs() << "Median times of " << TimingRepeat << " run(s):\n";
+  // Not every device can time the dispatch itself.
+  if (Variants[0].GPUTimes.size() == TimingRepeat &&
+      Variants[1].GPUTimes.size() == TimingRepeat)
+    PrintTimes("GPU:", Variants[0].GPUTimes, Variants[1].GPUTimes);
+  PrintTimes("Host:", Variants[0].HostTimes, Variants[1].HostTimes);
+
+  if (Differences)
+    return createStringError(std::errc::result_out_of_range,
+                             "%u resource(s) differ between %s and %s",
+                             Differences, InputShader.c_str(),
+                             CompareShader.c_str());
+  return Error::success();
+}
+
+// Runs every point of the pipeline's sweep on D and prints a table of the
+// problem size against the time taken. Results are not printed or verified
+// since the resource sizes differ from the description.
+Error runSweep(Device &D, StringRef Program, const Pipeline &Base) {
+  struct PointResult {
+    const SweepPoint *Point;
+    uint64_t Groups;
+    uint64_t Bytes;
+    ExecutionTimes Times;
+    double HostMilliseconds;
+  };
+  SmallVector<PointResult> Results;
+
+  // The device is held for the whole sweep so the points are comparable.
+  Expected<DeviceLock> Lock = lockDevice(D);
+  if (!Lock)
+    return Lock.takeError();
+  for (const SweepPoint &Point : Base.Sweep) {
+    Pipeline P = Base.clone();
+    PointResult &Result = Results.emplace_back();
+    Result.Point = &Point;
+    Result.Groups = 1;
+    Result.Bytes = 0;
+    for (int I = 0; I < 3; ++I) {
+      P.DispatchSize[I] = Point.DispatchSize[I];
+      Result.Groups *= Point.DispatchSize[I];
+    }
+    for (auto &S : P.Sets) {
+      for (auto &R : S.Resources) {
+        if (R.ZeroInitSize > 0) {
+          R.Size = R.ZeroInitSize * Point.Scale;
+          R.Data = ResourceBuffer::allocateZeroed(R.Size);
         }
+        Result.Bytes += R.Size;
       }
     }
 
-    ExitOnErr(
-        createStringError(Twine("No descriptor with name ") + ImageOutput));
+    auto Start = std::chrono::steady_clock::now();
+    if (Error Err = D.executeProgram(Program, P, Result.Times))
+      return Err;
+    std::chrono::duration<double, std::milli> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    Result.HostMilliseconds = Elapsed.count();
   }
-  return 1;
+
+  Lock->release();
+
+  outs() << "Sweep results on " << D.getDescription() << ":\n";
+  outs() << left_justify("DispatchSize", 24) << right_justify("Groups", 13)
+         << right_justify("Bytes", 15) << right_justify("GPU (ms)", 13)
+         << right_justify("Host (ms)", 13) << right_justify("GB/s", 11) << "\n";
+  for (const PointResult &Result : Results) {
+    std::string Dispatch;
+    raw_string_ostream DispatchOS(Dispatch);
+    DispatchOS << "[" << Result.Point->DispatchSize[0] << ", "
+               << Result.Point->DispatchSize[1] << ", "
+               << Result.Point->DispatchSize[2] << "]";
+    // Throughput is based on the GPU time when the device measures it.
+    double Milliseconds = Result.Times.hasGPUTime()
+                              ? Result.Times.GPUMilliseconds
+                              : Result.HostMilliseconds;
+    double GBPerSecond =
+        Milliseconds > 0.0 ? Result.Bytes / (Milliseconds * 1e6) : 0.0;
+    outs() << format("%-24s %12llu %14llu ", DispatchOS.str().c_str(),
+                     static_cast<unsigned long long>(Result.Groups),
+                     static_cast<unsigned long long>(Result.Bytes));
+    if (Result.Times.hasGPUTime())
+      outs() << format("%12.3f ", Result.Times.GPUMilliseconds);
+    else
+      outs() << right_justify("n/a", 12) << " ";
+    outs() << format("%12.3f %10.3f\n", Result.HostMilliseconds, GBPerSecond);
+  }
+  return Error::success();
+}
+
+// Checks every resource with an Expected block and prints a summary of the
+// ones that don't match. Returns the number of mismatching resources.
+unsigned verifyExpected(const Pipeline &P) {
+  unsigned Failures = 0;
+  for (size_t SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const auto &Resources = P.Sets[SetIdx].Resources;
+    for (size_t ResIdx = 0; ResIdx < Resources.size(); ++ResIdx) {
+      const Resource &R = Resources[ResIdx];
+      if (!R.Expected.isSet())
+        continue;
+      MismatchSummary S = verifyResource(R, MaxReportedMismatches);
+      if (S.passed())
+        continue;
+      ++Failures;
+      errs() << "Expected data mismatch in set " << SetIdx << ", resource "
+             << ResIdx;
+      if (!R.OutputProps.Name.empty())
+        errs() << " (" << R.OutputProps.Name << ")";
+      errs() << ":\n";
+      printMismatchSummary(errs(), S, R.Expected.Tol);
+    }
+  }
+  return Failures;
+}
+
+Error writeOutput(Pipeline &P) {
+  if (!ImageOutputs.empty() || AllImageOutputs)
+    return writeImages(P);
+
+  OutputSelection Sel;
+  Sel.Resources.assign(OutputResources.begin(), OutputResources.end());
+  Sel.First = OutputFirst;
+  Sel.Last = OutputLast;
+  Sel.Stride = OutputStride;
+  Pipeline Selected;
+  Pipeline *Out = &P;
+  SmallVector<SmallVector<unsigned>> ResourceIndices;
+  if (!Sel.selectsAll()) {
+    Expected<Pipeline> SelectedOrErr = selectOutput(P, Sel, &ResourceIndices);
+    if (!SelectedOrErr)
+      return SelectedOrErr.takeError();
+    Selected = std::move(*SelectedOrErr);
+    Out = &Selected;
+  }
+
+  switch (OutputFormatOpt) {
+  case OutputFormat::YAML:
+  case OutputFormat::Summary:
+    break;
+  case OutputFormat::Raw:
+    return writeResourceFiles(*Out, ResourceFileFormat::Raw,
+                              ResourceIndices);
+  case OutputFormat::NumPy:
+    return writeResourceFiles(*Out, ResourceFileFormat::NumPy,
+                              ResourceIndices);
+  case OutputFormat::GZip:
+    return writeResourceFiles(*Out, ResourceFileFormat::GZip,
+                              ResourceIndices);
+  }
+
+  std::error_code EC;
+  auto OutFile = std::make_unique<llvm::ToolOutputFile>(
+      OutputFilename, EC, llvm::sys::fs::OF_Text);
+  if (EC)
+    return llvm::errorCodeToError(EC);
+  yaml::Output YOut(OutFile->os());
+  if (OutputFormatOpt == OutputFormat::Summary) {
+    std::vector<ResourceSummary> Summaries =
+        summarizePipeline(*Out, HistogramBins);
+    YOut << Summaries;
+  } else {
+    YOut << *Out;
+  }
+  OutFile->keep();
+  return Error::success();
+}
+
+// Writes each resource of P to its own file in the output directory, named
+// after its OutputProps name or, failing that, its set and index in the
+// pipeline description. ResourceIndices holds those indices, by set, if P is
+// a selection from the description.
+Error writeResourceFiles(const Pipeline &P, ResourceFileFormat Format,
+                         ArrayRef<SmallVector<unsigned>> ResourceIndices) {
+  if (OutputFilename == "-")
+    return createStringError(std::errc::invalid_argument,
+                             "Binary output formats require an output "
+                             "directory (-o)");
+  if (std::error_code EC = sys::fs::create_directories(OutputFilename))
+    return createFileError(OutputFilename, EC);
+  for (unsigned SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const DescriptorSet &S = P.Sets[SetIdx];
+    for (unsigned ResIdx = 0; ResIdx < S.Resources.size(); ++ResIdx) {
+      const Resource &R = S.Resources[ResIdx];
+      std::string Name = R.OutputProps.Name;
+      if (Name.empty())
+        Name = std::to_string(SetIdx) + "-" +
+               std::to_string(ResourceIndices.empty()
+                                  ? ResIdx
+                                  : ResourceIndices[SetIdx][ResIdx]);
+      SmallString<256> Path(OutputFilename);
+      sys::path::append(Path, Name + getResourceFileExtension(Format));
+      if (Error Err = writeResourceFile(R, Path, Format))
+        return Err;
+    }
+  }
+  return Error::success();
+}
+
+// Returns the first resource of P named Name, or null if there is none.
+static const Resource *findResource(const Pipeline &P, StringRef Name) {
+  for (const auto &S : P.Sets) {
+    auto It = llvm::find_if(S.Resources, [Name](const Resource &R) {
+      return R.OutputProps.Name == Name;
+    });
+    if (It != S.Resources.end())
+      return &*It;
+  }
+  return nullptr;
+}
+
+// Writes the resources selected with -r and -all-images as PNG files. The
+// images are encoded in parallel.
+Error writeImages(const Pipeline &P) {
+  struct ImageJob {
+    const Resource *R;
+    std::string Path;
+  };
+  std::vector<ImageJob> Jobs;
+
+  for (StringRef Spec : ImageOutputs) {
+    auto [Name, Path] = Spec.split('=');
+    if (!Spec.contains('=')) {
+      if (ImageOutputs.size() != 1)
+        return createStringError(
+            std::errc::invalid_argument,
+            "-r needs a <name>=<filename> pair when given more than once");
+      Path = OutputFilename;
+    }
+    const Resource *Match = findResource(P, Name);
+    if (!Match)
+      return createStringError(Twine("No descriptor with name ") + Name);
+    Jobs.push_back({Match, Path.str()});
+  }
+
+  if (AllImageOutputs) {
+    if (OutputFilename == "-")
+      return createStringError(std::errc::invalid_argument,
+                               "-all-images requires an output directory "
+                               "(-o)");
+    if (std::error_code EC = sys::fs::create_directories(OutputFilename))
+      return createFileError(OutputFilename, EC);
+    for (const auto &S : P.Sets) {
+      for (const auto &R : S.Resources) {
+        if (R.OutputProps.Name.empty())
+          continue;
+        SmallString<256> Path(OutputFilename);
+        sys::path::append(Path, R.OutputProps.Name + ".png");
+        Jobs.push_back({&R, std::string(Path)});
+      }
+    }
+  }
+
+  return parallelForEachError(Jobs, [](const ImageJob &J) {
+    return Image::writePNG(ImageRef(*J.R), J.Path);
+  });
 }
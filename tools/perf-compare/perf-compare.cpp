@@ -0,0 +1,234 @@
+//===- perf-compare.cpp - Benchmark Baseline Comparison -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares benchmark results written by offloader -timing-json against the
+// stored baseline of the device they ran on:
+//
+//   perf-compare -baseline-dir=<dir> <result.json>...
+//
+// Baselines are JSON files in <dir>/<api>/<device>.json mapping each
+// benchmark name to its median time and an optional threshold:
+//
+//   { "copy": { "gpu_ms": 0.52, "threshold": 0.15 } }
+//
+// The GPU time is compared when both the result and the baseline have one,
+// otherwise the host time. A result more than the threshold slower than its
+// baseline is a regression, and makes perf-compare fail. Benchmarks without a
+// baseline pass. -update replaces the baselines with the given results, keeping
+// their thresholds.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/DeviceLock.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <optional>
+#include <string>
+
+using namespace llvm;
+using namespace offloadtest;
+
+static cl::list<std::string> InputResults(cl::Positional, cl::OneOrMore,
+                                          cl::desc("<result.json>..."));
+
+static cl::opt<std::string>
+    BaselineDir("baseline-dir", cl::desc("Directory of the stored baselines"),
+                cl::value_desc("directory"), cl::Required);
+
+static cl::opt<double> DefaultThreshold(
+    "threshold",
+    cl::desc("Allowed slowdown, as a fraction of the baseline, of benchmarks "
+             "whose baseline doesn't set one"),
+    cl::init(0.1));
+
+static cl::opt<bool>
+    Update("update", cl::desc("Replace the baselines with the given results"));
+
+static ExitOnError ExitOnErr("perf-compare: error: ");
+
+namespace {
+struct BenchmarkResult {
+  std::string Path;
+  std::string Name;
+  std::string API;
+  std::string Device;
+  std::optional<double> GPUMilliseconds;
+  double HostMilliseconds = 0.0;
+};
+} // namespace
+
+static Expected<json::Value> readJSON(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> File = MemoryBuffer::getFile(Path);
+  if (!File)
+    return createFileError(Path, File.getError());
+  Expected<json::Value> V = json::parse((*File)->getBuffer());
+  if (!V)
+    return createFileError(Path, V.takeError());
+  return V;
+}
+
+static Expected<BenchmarkResult> readResult(StringRef Path) {
+  Expected<json::Value> V = readJSON(Path);
+  if (!V)
+    return V.takeError();
+  BenchmarkResult R;
+  R.Path = Path.str();
+  const json::Object *O = V->getAsObject();
+  std::optional<StringRef> Name, API, Device;
+  std::optional<double> Host;
+  if (O) {
+    Name = O->getString("name");
+    API = O->getString("api");
+    Device = O->getString("device");
+    if (const json::Object *HostTimes = O->getObject("host"))
+      Host = HostTimes->getNumber("median");
+    if (const json::Object *GPUTimes = O->getObject("gpu"))
+      R.GPUMilliseconds = GPUTimes->getNumber("median");
+  }
+  if (!Name || !API || !Device || !Host)
+    return createStringError(std::errc::invalid_argument,
+                             "%s is not an offloader -timing-json result",
+                             R.Path.c_str());
+  R.Name = Name->str();
+  R.API = API->str();
+  R.Device = Device->str();
+  R.HostMilliseconds = *Host;
+  return R;
+}
+
+static std::string getBaselinePath(const BenchmarkResult &R) {
+  SmallString<256> Path(BaselineDir);
+  sys::path::append(Path, R.API, getDeviceFileName(R.Device) + ".json");
+  return std::string(Path);
+}
+
+// Returns the baselines stored in Path, or none if it doesn't exist.
+static json::Object readBaselines(StringRef Path) {
+  if (!sys::fs::exists(Path))
+    return json::Object();
+  json::Value V = ExitOnErr(readJSON(Path));
+  json::Object *O = V.getAsObject();
+  if (!O)
+    ExitOnErr(createStringError(std::errc::invalid_argument,
+                                "%s is not a baseline file",
+                                Path.str().c_str()));
+  return std::move(*O);
+}
+
+// Compares R to its entry in Baselines. Returns true if it regressed.
+static bool compare(const BenchmarkResult &R, const json::Object &Baselines) {
+  outs() << R.Name << " on " << R.API << " " << R.Device << ": ";
+  const json::Object *B = Baselines.getObject(R.Name);
+  std::optional<double> BaselineGPU = B ? B->getNumber("gpu_ms") : std::nullopt;
+  std::optional<double> BaselineHost =
+      B ? B->getNumber("host_ms") : std::nullopt;
+  double Current, Baseline;
+  StringRef Metric;
+  if (R.GPUMilliseconds && BaselineGPU) {
+    Current = *R.GPUMilliseconds;
+    Baseline = *BaselineGPU;
+    Metric = "GPU";
+  } else if (BaselineHost) {
+    Current = R.HostMilliseconds;
+    Baseline = *BaselineHost;
+    Metric = "host";
+  } else {
+    outs() << "no baseline\n";
+    return false;
+  }
+  double Threshold = DefaultThreshold;
+  if (std::optional<double> T = B->getNumber("threshold"))
+    Threshold = *T;
+
+  double Change = Baseline > 0.0 ? Current / Baseline - 1.0 : 0.0;
+  bool Regressed = Change > Threshold;
+  outs() << format("%s %.4f ms, baseline %.4f ms (%+.1f%%, threshold %.1f%%)",
+                   Metric.str().c_str(), Current, Baseline, Change * 100.0,
+                   Threshold * 100.0)
+         << (Regressed ? " REGRESSED" : "") << "\n";
+  return Regressed;
+}
+
+// Records the results in their baseline files, keeping the thresholds of
+// existing entries. Each file is rewritten under a lock, since lit runs the
+// benchmarks of a suite in parallel.
+static void updateBaselines(ArrayRef<BenchmarkResult> Results) {
+  for (const BenchmarkResult &R : Results) {
+    std::string Path = getBaselinePath(R);
+    ExitOnErr(errorCodeToError(
+        sys::fs::create_directories(sys::path::parent_path(Path))));
+    // The lock file is kept out of the baseline directory, which is usually
+    // in the source tree.
+    SmallString<256> LockPath;
+    sys::path::system_temp_directory(/*ErasedOnReboot=*/true, LockPath);
+    sys::path::append(LockPath, "perf-compare-" +
+                                    utohexstr(xxHash64(Path), true) + ".lock");
+    int LockFD;
+    ExitOnErr(errorCodeToError(sys::fs::openFileForReadWrite(
+        LockPath, LockFD, sys::fs::CD_OpenAlways, sys::fs::OF_None)));
+    ExitOnErr(errorCodeToError(sys::fs::lockFile(LockFD)));
+
+    json::Object Baselines = readBaselines(Path);
+    json::Object Entry;
+    if (const json::Object *Old = Baselines.getObject(R.Name))
+      if (std::optional<double> T = Old->getNumber("threshold"))
+        Entry["threshold"] = *T;
+    Entry["host_ms"] = R.HostMilliseconds;
+    if (R.GPUMilliseconds)
+      Entry["gpu_ms"] = *R.GPUMilliseconds;
+    Baselines[R.Name] = std::move(Entry);
+
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+    ExitOnErr(errorCodeToError(EC));
+    OS << formatv("{0:2}", json::Value(std::move(Baselines))) << "\n";
+    OS.close();
+
+    sys::fs::unlockFile(LockFD);
+    sys::Process::SafelyCloseFileDescriptor(LockFD);
+    outs() << "Updated the baseline of " << R.Name << " in " << Path << "\n";
+  }
+}
+
+int main(int ArgC, char **ArgV) {
+  InitLLVM X(ArgC, ArgV);
+  cl::ParseCommandLineOptions(ArgC, ArgV, "Benchmark Baseline Comparison");
+
+  SmallVector<BenchmarkResult> Results;
+  for (const std::string &Path : InputResults)
+    Results.push_back(ExitOnErr(readResult(Path)));
+
+  if (Update) {
+    updateBaselines(Results);
+    return 0;
+  }
+
+  unsigned Regressions = 0;
+  for (const BenchmarkResult &R : Results)
+    Regressions += compare(R, readBaselines(getBaselinePath(R)));
+  if (Regressions) {
+    errs() << "perf-compare: " << Regressions
+           << " benchmark(s) regressed beyond their threshold\n";
+    return 1;
+  }
+  return 0;
+}
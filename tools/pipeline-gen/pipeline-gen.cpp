@@ -0,0 +1,444 @@
+//===- pipeline-gen.cpp - Synthetic Pipeline Generator --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Generates a pipeline description and a matching HLSL shader for scale
+// testing, sized along independent axes:
+//
+//   pipeline-gen -sets=N -resources=N -elements=N -formats=Int32,Float32
+//                -dispatch=X,Y,Z -o <prefix>
+//
+// writes <prefix>.yaml and <prefix>.hlsl. Every resource is ReadWrite and the
+// shader adds one to each of its elements, so the pipeline also carries the
+// expected results and offloader verifies the read back data. The output only
+// depends on the options, so a generated pipeline can be reproduced anywhere.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+using namespace offloadtest;
+
+namespace {
+enum class InitKind { Zero, Inline, File };
+enum class BufferKind { Typed, Structured };
+
+struct FormatInfo {
+  DataFormat Format;
+  StringRef Name;
+  // The HLSL scalar type the shader accesses the resource with.
+  StringRef HLSLType;
+  unsigned Size;
+  bool IsSigned;
+  bool IsFloat;
+  bool IsHex;
+};
+} // namespace
+
+static const FormatInfo Formats[] = {
+    {DataFormat::Hex16, "Hex16", "uint16_t", 2, false, false, true},
+    {DataFormat::Hex32, "Hex32", "uint", 4, false, false, true},
+    {DataFormat::Hex64, "Hex64", "uint64_t", 8, false, false, true},
+    {DataFormat::UInt16, "UInt16", "uint16_t", 2, false, false, false},
+    {DataFormat::UInt32, "UInt32", "uint", 4, false, false, false},
+    {DataFormat::UInt64, "UInt64", "uint64_t", 8, false, false, false},
+    {DataFormat::Int16, "Int16", "int16_t", 2, true, false, false},
+    {DataFormat::Int32, "Int32", "int", 4, true, false, false},
+    {DataFormat::Int64, "Int64", "int64_t", 8, true, false, false},
+    {DataFormat::Float32, "Float32", "float", 4, true, true, false},
+    {DataFormat::Float64, "Float64", "double", 8, true, true, false},
+};
+
+static cl::opt<std::string>
+    OutputPrefix("o", cl::desc("Prefix of the files to write"),
+                 cl::value_desc("prefix"), cl::init("pipeline"));
+
+static cl::opt<unsigned> SetCount("sets", cl::desc("Number of descriptor sets"),
+                                  cl::init(1));
+
+static cl::opt<unsigned>
+    ResourceCount("resources", cl::desc("Number of resources in each set"),
+                  cl::init(1));
+
+static cl::opt<uint64_t>
+    ElementCount("elements", cl::desc("Number of elements in each resource"),
+                 cl::init(64));
+
+static cl::opt<unsigned>
+    Channels("channels", cl::desc("Number of channels of each element (1-4)"),
+             cl::init(1));
+
+static cl::list<std::string>
+    FormatNames("formats", cl::CommaSeparated,
+                cl::desc("Formats of the resources, used in turn (default: "
+                         "Int32)"),
+                cl::value_desc("format,..."));
+
+static cl::list<unsigned>
+    DispatchSize("dispatch", cl::CommaSeparated,
+                 cl::desc("Number of thread groups to dispatch (default: "
+                          "1,1,1)"),
+                 cl::value_desc("X,Y,Z"));
+
+static cl::opt<unsigned>
+    GroupSize("group-size", cl::desc("Number of threads in a thread group"),
+              cl::init(64));
+
+static cl::opt<BufferKind> BufferKindOpt(
+    "buffer", cl::desc("Kind of buffer the resources are accessed as"),
+    cl::values(clEnumValN(BufferKind::Typed, "typed",
+                          "RWBuffer, for Int32 and Float32 (default)"),
+               clEnumValN(BufferKind::Structured, "structured",
+                          "RWStructuredBuffer, for every format")),
+    cl::init(BufferKind::Typed));
+
+static cl::opt<InitKind> InitKindOpt(
+    "init", cl::desc("How the resources are initialized"),
+    cl::values(clEnumValN(InitKind::Zero, "zero", "ZeroInitSize"),
+               clEnumValN(InitKind::Inline, "inline",
+                          "Data in the description (default)"),
+               clEnumValN(InitKind::File, "file",
+                          "Data files next to the description")),
+    cl::init(InitKind::Inline));
+
+static cl::opt<bool> EmitExpected(
+    "expected",
+    cl::desc("Add the expected results to the description, inline with "
+             "-init=inline and in files otherwise (default: on)"),
+    cl::init(true));
+
+static ExitOnError ExitOnErr("pipeline-gen: error: ");
+
+static const FormatInfo *findFormat(StringRef Name) {
+  for (const FormatInfo &F : Formats)
+    if (F.Name == Name)
+      return &F;
+  return nullptr;
+}
+
+// Returns the value of scalar I of resource ResIdx before execution. Values
+// are small so adding one never overflows, and halves for floats so results
+// are exact.
+static double getInitialValue(const FormatInfo &F, uint64_t I,
+                              unsigned ResIdx) {
+  if (InitKindOpt == InitKind::Zero)
+    return 0.0;
+  double V = static_cast<double>((I + ResIdx) % 100);
+  if (F.IsSigned)
+    V -= 50.0;
+  if (F.IsFloat)
+    V *= 0.5;
+  return V;
+}
+
+// Calls Callback with each of the Count values of resource ResIdx, plus Add,
+// as the C type of F.
+template <typename Fn>
+static void forEachValue(const FormatInfo &F, uint64_t Count, unsigned ResIdx,
+                         double Add, Fn Callback) {
+  switch (F.Format) {
+#define VALUE_CASE(Enum, Type)                                                 \
+  case DataFormat::Enum:                                                       \
+    for (uint64_t I = 0; I < Count; ++I)                                       \
+      Callback(static_cast<Type>(getInitialValue(F, I, ResIdx) + Add));        \
+    break;
+    VALUE_CASE(Hex8, uint8_t)
+    VALUE_CASE(Hex16, uint16_t)
+    VALUE_CASE(Hex32, uint32_t)
+    VALUE_CASE(Hex64, uint64_t)
+    VALUE_CASE(UInt16, uint16_t)
+    VALUE_CASE(UInt32, uint32_t)
+    VALUE_CASE(UInt64, uint64_t)
+    VALUE_CASE(Int16, int16_t)
+    VALUE_CASE(Int32, int32_t)
+    VALUE_CASE(Int64, int64_t)
+    VALUE_CASE(Float32, float)
+    VALUE_CASE(Float64, double)
+#undef VALUE_CASE
+  }
+}
+
+static void writeInlineValues(raw_ostream &OS, const FormatInfo &F,
+                              uint64_t Count, unsigned ResIdx, double Add) {
+  OS << "[ ";
+  bool First = true;
+  forEachValue(F, Count, ResIdx, Add, [&](auto V) {
+    if (!First)
+      OS << ", ";
+    First = false;
+    if (F.IsHex)
+      OS << format_hex(static_cast<uint64_t>(V), 2 + 2 * sizeof(V));
+    else if (F.IsFloat)
+      OS << format("%g", static_cast<double>(V));
+    else
+      OS << static_cast<int64_t>(V);
+  });
+  OS << " ]";
+}
+
+static Error writeValueFile(StringRef Path, const FormatInfo &F,
+                            uint64_t Count, unsigned ResIdx, double Add) {
+  std::error_code EC;
+  ToolOutputFile Out(Path, EC, sys::fs::OF_None);
+  if (EC)
+    return createFileError(Path, EC);
+  forEachValue(F, Count, ResIdx, Add, [&](auto V) {
+    Out.os().write(reinterpret_cast<const char *>(&V), sizeof(V));
+  });
+  Out.os().close();
+  if (Out.os().has_error())
+    return createFileError(Path, Out.os().error());
+  Out.keep();
+  return Error::success();
+}
+
+static std::string getHLSLType(const FormatInfo &F) {
+  std::string Type = F.HLSLType.str();
+  if (Channels > 1)
+    Type += std::to_string(Channels);
+  return Type;
+}
+
+namespace {
+// Writes the description and the shader for the options.
+class Generator {
+  SmallVector<const FormatInfo *> ResourceFormats;
+  std::string Stem;
+  std::string BaseDir;
+  unsigned Dispatch[3] = {1, 1, 1};
+
+  const FormatInfo &getFormat(unsigned ResIdx) const {
+    return *ResourceFormats[ResIdx % ResourceFormats.size()];
+  }
+
+  uint64_t getScalarCount() const { return ElementCount * Channels; }
+
+  std::string getFileName(unsigned SetIdx, unsigned ResIdx,
+                          StringRef Kind) const {
+    return (Stem + ".s" + Twine(SetIdx) + ".r" + Twine(ResIdx) + Kind + ".bin")
+        .str();
+  }
+
+  Error writeFile(StringRef Name, const FormatInfo &F, unsigned ResIdx,
+                  double Add) const {
+    SmallString<256> Path(BaseDir);
+    sys::path::append(Path, Name);
+    return writeValueFile(Path, F, getScalarCount(), ResIdx, Add);
+  }
+
+  Error writeResource(raw_ostream &OS, unsigned SetIdx, unsigned Idx,
+                      unsigned Register) const {
+    const FormatInfo &F = getFormat(Register);
+    uint64_t Size = getScalarCount() * F.Size;
+    OS << "    - Access: ReadWrite\n";
+    OS << "      Format: " << F.Name << "\n";
+    if (Channels > 1)
+      OS << "      Channels: " << Channels << "\n";
+    if (BufferKindOpt == BufferKind::Structured)
+      OS << "      RawSize: " << Size / ElementCount << "\n";
+    switch (InitKindOpt) {
+    case InitKind::Zero:
+      OS << "      ZeroInitSize: " << Size << "\n";
+      break;
+    case InitKind::Inline:
+      OS << "      Data: ";
+      writeInlineValues(OS, F, getScalarCount(), Register, 0.0);
+      OS << "\n";
+      break;
+    case InitKind::File: {
+      std::string Name = getFileName(SetIdx, Idx, "");
+      if (Error Err = writeFile(Name, F, Register, 0.0))
+        return Err;
+      OS << "      DataFile: " << Name << "\n";
+      break;
+    }
+    }
+    OS << "      DirectXBinding:\n";
+    OS << "        Register: " << Register << "\n";
+    OS << "        Space: " << SetIdx << "\n";
+    if (!EmitExpected)
+      return Error::success();
+    OS << "      Expected:\n";
+    if (InitKindOpt == InitKind::Inline) {
+      OS << "        Data: ";
+      writeInlineValues(OS, F, getScalarCount(), Register, 1.0);
+      OS << "\n";
+      return Error::success();
+    }
+    std::string Name = getFileName(SetIdx, Idx, ".expected");
+    if (Error Err = writeFile(Name, F, Register, 1.0))
+      return Err;
+    OS << "        File: " << Name << "\n";
+    return Error::success();
+  }
+
+public:
+  Error init() {
+    for (const std::string &Name : FormatNames) {
+      const FormatInfo *F = findFormat(Name);
+      if (!F)
+        return createStringError(std::errc::invalid_argument,
+                                 "Unsupported format '%s'", Name.c_str());
+      if (BufferKindOpt == BufferKind::Typed &&
+          F->Format != DataFormat::Int32 && F->Format != DataFormat::Float32)
+        return createStringError(std::errc::invalid_argument,
+                                 "%s resources require -buffer=structured",
+                                 Name.c_str());
+      ResourceFormats.push_back(F);
+    }
+    if (ResourceFormats.empty())
+      ResourceFormats.push_back(findFormat("Int32"));
+
+    if (SetCount == 0 || ResourceCount == 0 || ElementCount == 0)
+      return createStringError(std::errc::invalid_argument,
+                               "-sets, -resources and -elements must be at "
+                               "least 1");
+    if (Channels < 1 || Channels > 4)
+      return createStringError(std::errc::invalid_argument,
+                               "-channels must be between 1 and 4");
+    if (GroupSize == 0 || GroupSize > 1024)
+      return createStringError(std::errc::invalid_argument,
+                               "-group-size must be between 1 and 1024");
+    if (!DispatchSize.empty()) {
+      if (DispatchSize.size() != 3 || is_contained(DispatchSize, 0u))
+        return createStringError(std::errc::invalid_argument,
+                                 "-dispatch must be three positive sizes");
+      copy(DispatchSize, Dispatch);
+    }
+
+    Stem = sys::path::filename(OutputPrefix).str();
+    BaseDir = sys::path::parent_path(OutputPrefix).str();
+    if (!BaseDir.empty())
+      if (std::error_code EC = sys::fs::create_directories(BaseDir))
+        return createFileError(BaseDir, EC);
+    return Error::success();
+  }
+
+  Expected<std::string> getDescription() const {
+    std::string YAML;
+    raw_string_ostream OS(YAML);
+    OS << "---\n";
+    OS << "DispatchSize: [" << Dispatch[0] << ", " << Dispatch[1] << ", "
+       << Dispatch[2] << "]\n";
+    OS << "DescriptorSets:\n";
+    unsigned Register = 0;
+    for (unsigned SetIdx = 0; SetIdx < SetCount; ++SetIdx) {
+      OS << "  - Resources:\n";
+      for (unsigned Idx = 0; Idx < ResourceCount; ++Idx)
+        if (Error Err = writeResource(OS, SetIdx, Idx, Register++))
+          return std::move(Err);
+    }
+    OS << "...\n";
+    return YAML;
+  }
+
+  std::string getShader() const {
+    std::string HLSL;
+    raw_string_ostream OS(HLSL);
+    bool Needs16Bit = any_of(ResourceFormats, [](const FormatInfo *F) {
+      return F->HLSLType.contains("16");
+    });
+    OS << "// Generated by pipeline-gen: " << SetCount << " set(s) of "
+       << ResourceCount << " resource(s) of " << ElementCount
+       << " element(s).\n";
+    if (Needs16Bit)
+      OS << "// Compile with -enable-16bit-types and at least -T cs_6_2.\n";
+    OS << "\n#if defined(__spirv__) || defined(__SPIRV__)\n"
+          "#define REGISTER(Idx, Space)\n"
+          "#else\n"
+          "#define REGISTER(Idx, Space) : register(Idx, Space)\n"
+          "#endif\n\n";
+    StringRef BufferType = BufferKindOpt == BufferKind::Structured
+                               ? "RWStructuredBuffer"
+                               : "RWBuffer";
+    unsigned Register = 0;
+    for (unsigned SetIdx = 0; SetIdx < SetCount; ++SetIdx)
+      for (unsigned Idx = 0; Idx < ResourceCount; ++Idx, ++Register)
+        OS << "[[vk::binding(" << Idx << ", " << SetIdx << ")]] "
+           << BufferType << "<" << getHLSLType(getFormat(Register)) << "> R"
+           << SetIdx << "_" << Idx << " REGISTER(u" << Register << ", space"
+           << SetIdx << ");\n";
+
+    uint64_t ThreadCount = uint64_t(GroupSize) * Dispatch[0] * Dispatch[1] *
+                           Dispatch[2];
+    OS << "\n[numthreads(" << GroupSize << ", 1, 1)]\n"
+       << "void main(uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex) {\n"
+       << "  uint Thread = ((Gid.z * " << Dispatch[1] << " + Gid.y) * "
+       << Dispatch[0] << " + Gid.x) * " << GroupSize << " + GI;\n"
+       << "  for (uint I = Thread; I < " << ElementCount << "; I += "
+       << ThreadCount << ") {\n";
+    for (unsigned SetIdx = 0; SetIdx < SetCount; ++SetIdx)
+      for (unsigned Idx = 0; Idx < ResourceCount; ++Idx)
+        OS << "    R" << SetIdx << "_" << Idx << "[I] = R" << SetIdx << "_"
+           << Idx << "[I] + 1;\n";
+    OS << "  }\n}\n";
+    return HLSL;
+  }
+};
+} // namespace
+
+static Error writeTextFile(StringRef Path, StringRef Contents) {
+  std::error_code EC;
+  ToolOutputFile Out(Path, EC, sys::fs::OF_Text);
+  if (EC)
+    return createFileError(Path, EC);
+  Out.os() << Contents;
+  Out.os().close();
+  if (Out.os().has_error())
+    return createFileError(Path, Out.os().error());
+  Out.keep();
+  return Error::success();
+}
+
+int main(int ArgC, char **ArgV) {
+  InitLLVM X(ArgC, ArgV);
+  cl::ParseCommandLineOptions(ArgC, ArgV, "Synthetic Pipeline Generator");
+
+  Generator Gen;
+  ExitOnErr(Gen.init());
+  std::string YAML = ExitOnErr(Gen.getDescription());
+
+  // The description must be one offloader accepts, so it is parsed back
+  // before it is written.
+  Pipeline P;
+  yaml::Input YIn(YAML);
+  YIn >> P;
+  if (YIn.error())
+    ExitOnErr(createStringError(std::errc::invalid_argument,
+                                "Generated an invalid pipeline description"));
+
+  ExitOnErr(writeTextFile(OutputPrefix + ".yaml", YAML));
+  ExitOnErr(writeTextFile(OutputPrefix + ".hlsl", Gen.getShader()));
+  uint64_t Bytes = 0;
+  for (const DescriptorSet &S : P.Sets)
+    for (const Resource &R : S.Resources)
+      Bytes += R.DataFile.empty()
+                   ? R.Size
+                   : ElementCount * Channels * R.getSingleElementSize();
+  outs() << "Wrote " << OutputPrefix << ".yaml and " << OutputPrefix
+         << ".hlsl: " << P.Sets.size() << " set(s), "
+         << P.getDescriptorCount() << " resource(s), " << Bytes
+         << " byte(s) of resource data\n";
+  return 0;
+}
@@ -0,0 +1,32 @@
+//===- ParsePipeline.h - Pipeline Parsing Test Helper -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_UNITTESTS_COMMON_PARSEPIPELINE_H
+#define OFFLOADTEST_UNITTESTS_COMMON_PARSEPIPELINE_H
+
+#include "Support/Pipeline.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include "gtest/gtest.h"
+
+namespace offloadtest {
+
+// Parses the pipeline description YAML, failing the test if it is invalid.
+inline Pipeline parsePipeline(llvm::StringRef YAML) {
+  Pipeline P;
+  llvm::yaml::Input YIn(YAML);
+  YIn >> P;
+  EXPECT_FALSE(YIn.error());
+  return P;
+}
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_UNITTESTS_COMMON_PARSEPIPELINE_H
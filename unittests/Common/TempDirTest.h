@@ -0,0 +1,44 @@
+//===- TempDirTest.h - Temporary Directory Test Fixture ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOADTEST_UNITTESTS_COMMON_TEMPDIRTEST_H
+#define OFFLOADTEST_UNITTESTS_COMMON_TEMPDIRTEST_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+namespace offloadtest {
+
+// A fixture for tests that work on files. Each test gets a new, empty
+// directory Dir, which is removed with its contents after the test.
+class TempDirTest : public ::testing::Test {
+protected:
+  llvm::SmallString<128> Dir;
+
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("offloadtest", Dir));
+  }
+  void TearDown() override { llvm::sys::fs::remove_directories(Dir); }
+
+  // Returns the path of the file Name in Dir.
+  std::string getPath(llvm::StringRef Name) const {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, Name);
+    return std::string(Path);
+  }
+};
+
+} // namespace offloadtest
+
+#endif // OFFLOADTEST_UNITTESTS_COMMON_TEMPDIRTEST_H
@@ -16,6 +16,7 @@
 #include "gtest/gtest.h"
 
 #include <algorithm>
+#include <vector>
 
 using namespace offloadtest;
 
@@ -50,3 +51,96 @@ TEST(ColorTests, RoundTrip) {
     EXPECT_EQ(RGB.getAs<uint16_t>(), RGBPrime.getAs<uint16_t>());
   }
 }
+
+namespace {
+// Planar RGB rows sampling the RGB cube in Steps steps per channel. The
+// pixel count isn't a multiple of any vector width or block size.
+struct PlanarRows {
+  std::vector<float> Channels[3];
+
+  PlanarRows(int Steps, int Shift = 0) {
+    for (int R = 0; R <= Steps; ++R)
+      for (int G = 0; G <= Steps; ++G)
+        for (int B = 0; B <= Steps; ++B) {
+          int Values[] = {R, G, B};
+          for (int C = 0; C < 3; ++C)
+            Channels[C].push_back(static_cast<float>((Values[C] + Shift) %
+                                                     (Steps + 1)) /
+                                  static_cast<float>(Steps));
+        }
+  }
+
+  size_t size() const { return Channels[0].size(); }
+  Color get(size_t I) const {
+    return Color(Channels[0][I], Channels[1][I], Channels[2][I]);
+  }
+};
+} // namespace
+
+TEST(ColorTests, BatchLAB) {
+  PlanarRows RGB(20);
+  std::vector<float> LAB[3];
+  for (auto &Channel : LAB)
+    Channel.resize(RGB.size());
+  const float *const In[] = {RGB.Channels[0].data(), RGB.Channels[1].data(),
+                             RGB.Channels[2].data()};
+  float *const Out[] = {LAB[0].data(), LAB[1].data(), LAB[2].data()};
+  Color::translateRGBToLAB(In, Out, RGB.size());
+
+  for (size_t I = 0; I < RGB.size(); ++I) {
+    Color Expected = RGB.get(I).translateSpace(ColorSpace::LAB);
+    EXPECT_NEAR(Expected.R, LAB[0][I], Color::BatchTolerance) << "pixel " << I;
+    EXPECT_NEAR(Expected.G, LAB[1][I], Color::BatchTolerance) << "pixel " << I;
+    EXPECT_NEAR(Expected.B, LAB[2][I], Color::BatchTolerance) << "pixel " << I;
+  }
+}
+
+TEST(ColorTests, BatchDistance) {
+  PlanarRows LHS(20);
+  PlanarRows RHS(20, 3);
+  std::vector<float> Distances(LHS.size());
+  const float *const L[] = {LHS.Channels[0].data(), LHS.Channels[1].data(),
+                            LHS.Channels[2].data()};
+  const float *const R[] = {RHS.Channels[0].data(), RHS.Channels[1].data(),
+                            RHS.Channels[2].data()};
+  Color::CIE75Distances(L, R, Distances.data(), LHS.size());
+
+  for (size_t I = 0; I < LHS.size(); ++I)
+    EXPECT_NEAR(Color::CIE75Distance(LHS.get(I), RHS.get(I)), Distances[I],
+                Color::BatchTolerance)
+        << "pixel " << I;
+}
+
+TEST(ColorTests, BatchDistanceFromLAB) {
+  PlanarRows LHS(20);
+  PlanarRows RHS(20, 3);
+  std::vector<float> LAB[3];
+  for (auto &Channel : LAB)
+    Channel.resize(LHS.size());
+  const float *const L[] = {LHS.Channels[0].data(), LHS.Channels[1].data(),
+                            LHS.Channels[2].data()};
+  float *const LOut[] = {LAB[0].data(), LAB[1].data(), LAB[2].data()};
+  Color::translateRGBToLAB(L, LOut, LHS.size());
+  const float *const LLAB[] = {LAB[0].data(), LAB[1].data(), LAB[2].data()};
+  const float *const R[] = {RHS.Channels[0].data(), RHS.Channels[1].data(),
+                            RHS.Channels[2].data()};
+  std::vector<float> Expected(LHS.size()), Distances(LHS.size());
+  Color::CIE75Distances(L, R, Expected.data(), LHS.size());
+  Color::CIE75DistancesFromLAB(LLAB, R, Distances.data(), LHS.size());
+
+  // Both convert the same values the same way.
+  for (size_t I = 0; I < LHS.size(); ++I)
+    EXPECT_EQ(Expected[I], Distances[I]) << "pixel " << I;
+}
+
+TEST(ColorTests, FloatTables) {
+  const float *Table8 = ColorUtils::getFloatTable<uint8_t>();
+  for (uint32_t I = 0; I <= 0xff; ++I)
+    EXPECT_EQ(Table8[I],
+              ColorUtils::convertColor<float>(static_cast<uint8_t>(I)));
+  const float *Table16 = ColorUtils::getFloatTable<uint16_t>();
+  for (uint32_t I = 0; I <= 0xffff; ++I)
+    ASSERT_EQ(Table16[I],
+              ColorUtils::convertColor<float>(static_cast<uint16_t>(I)))
+        << "value " << I;
+}
@@ -0,0 +1,176 @@
+//===- ImageCacheTests.cpp - Converted Golden Image Cache Tests -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/TempDirTest.h"
+#include "Image/Color.h"
+#include "Image/Image.h"
+#include "Image/ImageCache.h"
+#include "Image/ImageComparators.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace offloadtest;
+
+namespace {
+class ImageCacheTests : public TempDirTest {
+protected:
+  std::string CacheDir;
+  std::string PNGPath;
+
+  void SetUp() override {
+    TempDirTest::SetUp();
+    CacheDir = getPath("cache");
+    PNGPath = getPath("golden.png");
+  }
+
+  // Writes an 8-bit RGB gradient, offset by Shift, as the golden image.
+  void writeGolden(uint8_t Shift = 0) {
+    constexpr uint32_t Height = 40, Width = 70;
+    std::vector<uint8_t> Pixels;
+    for (uint32_t Y = 0; Y < Height; ++Y)
+      for (uint32_t X = 0; X < Width; ++X)
+        Pixels.insert(Pixels.end(), {static_cast<uint8_t>(X * 3 + Shift),
+                                     static_cast<uint8_t>(Y * 6),
+                                     static_cast<uint8_t>(X + Y)});
+    ImageRef Img(Height, Width, 1, 3, false,
+                 llvm::StringRef(reinterpret_cast<const char *>(Pixels.data()),
+                                 Pixels.size()));
+    ASSERT_FALSE(bool(Image::writePNG(Img, PNGPath)));
+  }
+
+  std::string getEntryPath() {
+    auto PNG = llvm::MemoryBuffer::getFile(PNGPath);
+    EXPECT_TRUE(bool(PNG));
+    return CachedImage::getCachePath(CacheDir, (*PNG)->getBuffer());
+  }
+};
+} // namespace
+
+// Checks Cached holds the decoded golden image and its L*a*b* values.
+static void checkMatchesPNG(const CachedImage &Cached,
+                            llvm::StringRef PNGPath) {
+  llvm::Expected<Image> Decoded = Image::loadPNG(PNGPath);
+  ASSERT_TRUE(bool(Decoded));
+  ImageRef Img = Cached.getImage();
+  ASSERT_EQ(Img.getHeight(), Decoded->getHeight());
+  ASSERT_EQ(Img.getWidth(), Decoded->getWidth());
+  ASSERT_EQ(Img.getDepth(), Decoded->getDepth());
+  ASSERT_EQ(Img.getChannels(), Decoded->getChannels());
+  ASSERT_EQ(Img.isFloat(), Decoded->isFloat());
+  ASSERT_EQ(Img.size(), Decoded->size());
+  EXPECT_EQ(memcmp(Img.data(), Decoded->data(), Img.size()), 0);
+
+  const uint8_t *Pixels = reinterpret_cast<const uint8_t *>(Img.data());
+  const float *const *LAB = Cached.getLAB();
+  for (uint64_t I = 0; I < uint64_t(Img.getHeight()) * Img.getWidth(); ++I) {
+    Color Expected = Color(Pixels[I * 3] / 255.0, Pixels[I * 3 + 1] / 255.0,
+                           Pixels[I * 3 + 2] / 255.0)
+                         .translateSpace(ColorSpace::LAB);
+    ASSERT_NEAR(Expected.R, LAB[0][I], Color::BatchTolerance) << "pixel " << I;
+    ASSERT_NEAR(Expected.G, LAB[1][I], Color::BatchTolerance) << "pixel " << I;
+    ASSERT_NEAR(Expected.B, LAB[2][I], Color::BatchTolerance) << "pixel " << I;
+  }
+}
+
+TEST_F(ImageCacheTests, MissThenHit) {
+  writeGolden();
+  llvm::Expected<CachedImage> Miss = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Miss));
+  EXPECT_FALSE(Miss->wasCached());
+  EXPECT_TRUE(llvm::sys::fs::exists(getEntryPath()));
+  checkMatchesPNG(*Miss, PNGPath);
+
+  llvm::Expected<CachedImage> Hit = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Hit));
+  EXPECT_TRUE(Hit->wasCached());
+  checkMatchesPNG(*Hit, PNGPath);
+}
+
+TEST_F(ImageCacheTests, ChangedPNGIsAMiss) {
+  writeGolden();
+  ASSERT_TRUE(bool(CachedImage::load(PNGPath, CacheDir)));
+  std::string OldEntry = getEntryPath();
+
+  writeGolden(/*Shift=*/1);
+  EXPECT_NE(getEntryPath(), OldEntry);
+  llvm::Expected<CachedImage> Changed = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Changed));
+  EXPECT_FALSE(Changed->wasCached());
+  checkMatchesPNG(*Changed, PNGPath);
+}
+
+TEST_F(ImageCacheTests, CorruptEntryIsRebuilt) {
+  writeGolden();
+  ASSERT_TRUE(bool(CachedImage::load(PNGPath, CacheDir)));
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(getEntryPath(), EC);
+    ASSERT_FALSE(EC);
+    OS << "OTLC truncated";
+  }
+
+  llvm::Expected<CachedImage> Rebuilt = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Rebuilt));
+  EXPECT_FALSE(Rebuilt->wasCached());
+  checkMatchesPNG(*Rebuilt, PNGPath);
+  llvm::Expected<CachedImage> Hit = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Hit));
+  EXPECT_TRUE(Hit->wasCached());
+}
+
+TEST_F(ImageCacheTests, UnwritableCacheStillLoads) {
+  writeGolden();
+  // A file where the cache directory should be.
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(CacheDir, EC);
+    ASSERT_FALSE(EC);
+  }
+  llvm::Expected<CachedImage> Loaded = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Loaded));
+  EXPECT_FALSE(Loaded->wasCached());
+  checkMatchesPNG(*Loaded, PNGPath);
+}
+
+// Comparing with the cached L*a*b* values gives the same distances as
+// converting the expected image.
+TEST_F(ImageCacheTests, CompareWithCachedLAB) {
+  writeGolden();
+  llvm::Expected<CachedImage> Cached = CachedImage::load(PNGPath, CacheDir);
+  ASSERT_TRUE(bool(Cached));
+  ImageRef Expected = Cached->getImage();
+  std::vector<uint8_t> Actual(Expected.data(),
+                              Expected.data() + Expected.size());
+  for (size_t I = 0; I < Actual.size(); I += 7)
+    Actual[I] ^= 0x15;
+  ImageRef ActualRef(Expected.getHeight(), Expected.getWidth(), 1, 3, false,
+                     llvm::StringRef(reinterpret_cast<const char *>(
+                                         Actual.data()),
+                                     Actual.size()));
+
+  std::string Reports[2];
+  for (int UseLAB = 0; UseLAB < 2; ++UseLAB) {
+    llvm::SmallVector<ImageComparatorRef> Cmps;
+    Cmps.push_back(make_comparator<ImageComparatorDistance>());
+    ASSERT_FALSE(bool(Image::compareImages(
+        Expected, ActualRef, Cmps, UseLAB ? Cached->getLAB() : nullptr)));
+    Cmps[0].result();
+    llvm::raw_string_ostream OS(Reports[UseLAB]);
+    Cmps[0].print(OS);
+  }
+  EXPECT_EQ(Reports[0], Reports[1]);
+}
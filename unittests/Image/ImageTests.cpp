@@ -0,0 +1,243 @@
+//===- ImageTests.cpp - Image Tests -----------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Image/Image.h"
+#include "Image/ImageComparators.h"
+
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace offloadtest;
+
+TEST(ImageTests, TranslateDropsChannels) {
+  const uint8_t Pixels[] = {0, 51, 255, 128, 255, 0, 102, 7};
+  ImageRef RGBA(1, 2, 1, 4, false,
+                llvm::StringRef(reinterpret_cast<const char *>(Pixels), 8));
+  Image RGB = Image::translateImage(RGBA, 1, 3, false);
+  ASSERT_EQ(RGB.size(), 6u);
+  const uint8_t *Data = reinterpret_cast<const uint8_t *>(RGB.data());
+  EXPECT_EQ(Data[0], 0);
+  EXPECT_EQ(Data[1], 51);
+  EXPECT_EQ(Data[2], 255);
+  EXPECT_EQ(Data[3], 255);
+  EXPECT_EQ(Data[4], 0);
+  EXPECT_EQ(Data[5], 102);
+}
+
+TEST(ImageTests, TranslateAddsSaturatedChannels) {
+  const float Pixels[] = {0.0f, 0.25f, 1.0f, 0.5f, 0.75f, 0.125f};
+  ImageRef RGB(1, 2, 4, 3, true,
+               llvm::StringRef(reinterpret_cast<const char *>(Pixels), 24));
+  Image RGBA = Image::translateImage(RGB, 4, 4, true);
+  ASSERT_EQ(RGBA.size(), 32u);
+  const float *Data = reinterpret_cast<const float *>(RGBA.data());
+  EXPECT_EQ(Data[0], 0.0f);
+  EXPECT_EQ(Data[2], 1.0f);
+  EXPECT_EQ(Data[3], 1.0f);
+  EXPECT_EQ(Data[4], 0.5f);
+  EXPECT_EQ(Data[6], 0.125f);
+  EXPECT_EQ(Data[7], 1.0f);
+}
+
+namespace {
+// Records which pixels it processed, by the red value compareImages passes
+// it, so tests can check every pixel is seen once.
+class ImageComparatorRecord : public ImageComparatorBase {
+public:
+  std::vector<float> Values;
+  std::vector<uint32_t> Rows;
+  bool Clonable = true;
+
+  void processPixel(Color L, Color) override {
+    Values.push_back(static_cast<float>(L.R));
+  }
+  void setRow(uint32_t Row) override { Rows.push_back(Row); }
+  std::unique_ptr<ImageComparatorBase> clone() const override {
+    if (!Clonable)
+      return nullptr;
+    return std::make_unique<ImageComparatorRecord>();
+  }
+  void merge(ImageComparatorBase &Other) override {
+    auto &O = static_cast<ImageComparatorRecord &>(Other);
+    Values.insert(Values.end(), O.Values.begin(), O.Values.end());
+    Rows.insert(Rows.end(), O.Rows.begin(), O.Rows.end());
+  }
+};
+
+// A float RGB image whose pixels' red values count up from 0.
+struct CountingImage {
+  std::vector<float> Pixels;
+  ImageRef Ref;
+
+  CountingImage(uint32_t Height, uint32_t Width) {
+    for (uint32_t I = 0; I < Height * Width; ++I) {
+      Pixels.push_back(static_cast<float>(I) / (Height * Width));
+      Pixels.push_back(0.5f);
+      Pixels.push_back(0.25f);
+    }
+    Ref = ImageRef(Height, Width, 4, 3, true,
+                   llvm::StringRef(reinterpret_cast<const char *>(
+                                       Pixels.data()),
+                                   Pixels.size() * sizeof(float)));
+  }
+};
+} // namespace
+
+static void checkProcessedInOrder(const ImageComparatorRecord &Rec,
+                                  const CountingImage &Img) {
+  ASSERT_EQ(Rec.Values.size(), Img.Pixels.size() / 3);
+  for (size_t I = 0; I < Rec.Values.size(); ++I)
+    ASSERT_EQ(Rec.Values[I], Img.Pixels[I * 3]) << "pixel " << I;
+}
+
+TEST(ImageTests, CompareImagesMergesTiles) {
+  // Several tiles of rows, the last one partial.
+  CountingImage Img(700, 256);
+  auto Rec = std::make_unique<ImageComparatorRecord>();
+  ImageComparatorRecord *RecPtr = Rec.get();
+  llvm::SmallVector<ImageComparatorRef> Cmps;
+  Cmps.push_back(ImageComparatorRef(std::move(Rec)));
+  ASSERT_FALSE(bool(Image::compareImages(Img.Ref, Img.Ref, Cmps)));
+
+  checkProcessedInOrder(*RecPtr, Img);
+  ASSERT_GT(RecPtr->Rows.size(), 1u);
+  EXPECT_EQ(RecPtr->Rows[0], 0u);
+  for (size_t I = 1; I < RecPtr->Rows.size(); ++I)
+    EXPECT_GT(RecPtr->Rows[I], RecPtr->Rows[I - 1]);
+}
+
+TEST(ImageTests, CompareImagesWithoutClones) {
+  CountingImage Img(700, 256);
+  auto Rec = std::make_unique<ImageComparatorRecord>();
+  Rec->Clonable = false;
+  ImageComparatorRecord *RecPtr = Rec.get();
+  llvm::SmallVector<ImageComparatorRef> Cmps;
+  Cmps.push_back(ImageComparatorRef(std::move(Rec)));
+  ASSERT_FALSE(bool(Image::compareImages(Img.Ref, Img.Ref, Cmps)));
+
+  checkProcessedInOrder(*RecPtr, Img);
+  EXPECT_EQ(RecPtr->Rows, std::vector<uint32_t>{0});
+}
+
+// The distance comparator takes whole rows through the batch distance
+// function, which must agree with the scalar distance.
+TEST(ImageTests, CompareImagesDistanceSpans) {
+  constexpr uint32_t Size = 300;
+  std::vector<float> LPixels, RPixels;
+  for (uint32_t I = 0; I < Size * Size; ++I) {
+    LPixels.insert(LPixels.end(), {0.2f, 0.4f, 0.6f});
+    RPixels.insert(RPixels.end(), {0.25f, 0.4f, 0.55f});
+  }
+  auto makeRef = [](const std::vector<float> &Pixels) {
+    return ImageRef(Size, Size, 4, 3, true,
+                    llvm::StringRef(reinterpret_cast<const char *>(
+                                        Pixels.data()),
+                                    Pixels.size() * sizeof(float)));
+  };
+  double Expected = Color::CIE75Distance(Color(0.2f, 0.4f, 0.6f),
+                                         Color(0.25f, 0.4f, 0.55f));
+
+  for (double Offset : {Color::BatchTolerance, -Color::BatchTolerance}) {
+    CompareCheck Check{CompareCheck::Furthest, Expected + Offset};
+    llvm::SmallVector<ImageComparatorRef> Cmps;
+    Cmps.push_back(make_comparator<ImageComparatorDistance>(
+        llvm::ArrayRef<CompareCheck>(Check)));
+    ASSERT_FALSE(
+        bool(Image::compareImages(makeRef(LPixels), makeRef(RPixels), Cmps)));
+    EXPECT_EQ(Cmps[0].result(), Offset > 0);
+  }
+}
+
+namespace {
+// Counts the pixels compareImages passes as identical and as spans.
+class ImageComparatorCount : public ImageComparatorBase {
+public:
+  uint64_t Identical = 0;
+  uint64_t Compared = 0;
+
+  void processPixel(Color, Color) override { ++Compared; }
+  bool processIdentical(size_t Count) override {
+    Identical += Count;
+    return true;
+  }
+};
+} // namespace
+
+TEST(ImageTests, CompareImagesSkipsIdenticalPixels) {
+  constexpr uint32_t Size = 100;
+  std::vector<uint8_t> LPixels(Size * Size * 4, 128);
+  std::vector<uint8_t> RPixels = LPixels;
+  // A single pixel, a run at the end of a row, a pixel differing only in
+  // alpha, which still needs converting, and two pixels whose short gap is
+  // compared along with them.
+  RPixels[(5 * Size + 7) * 4] = 0;
+  for (uint32_t X = 90; X < Size; ++X)
+    RPixels[(20 * Size + X) * 4 + 1] = 0;
+  RPixels[(50 * Size + 50) * 4 + 3] = 0;
+  RPixels[(70 * Size + 10) * 4 + 2] = 0;
+  RPixels[(70 * Size + 13) * 4 + 2] = 0;
+  auto makeRef = [](const std::vector<uint8_t> &Pixels) {
+    return ImageRef(Size, Size, 1, 4, false,
+                    llvm::StringRef(reinterpret_cast<const char *>(
+                                        Pixels.data()),
+                                    Pixels.size()));
+  };
+
+  auto Count = std::make_unique<ImageComparatorCount>();
+  ImageComparatorCount *CountPtr = Count.get();
+  llvm::SmallVector<ImageComparatorRef> Cmps;
+  Cmps.push_back(ImageComparatorRef(std::move(Count)));
+  ASSERT_FALSE(
+      bool(Image::compareImages(makeRef(LPixels), makeRef(RPixels), Cmps)));
+  EXPECT_EQ(CountPtr->Compared, 16u);
+  EXPECT_EQ(CountPtr->Identical, Size * Size - 16u);
+}
+
+// Images deeper than 8 bits are converted for writing a chunk of rows at a
+// time. Each row of this one has a single white pixel on the diagonal, so
+// the rows' order survives the round trip through 8 bits.
+TEST(ImageTests, WritePNGInRowChunks) {
+  constexpr uint32_t Height = 300, Width = 2048;
+  std::vector<float> Pixels(Height * Width * 3, 0.0f);
+  for (uint32_t Y = 0; Y < Height; ++Y)
+    for (uint32_t C = 0; C < 3; ++C)
+      Pixels[(Y * Width + Y) * 3 + C] = 1.0f;
+  ImageRef Img(Height, Width, 4, 3, true,
+               llvm::StringRef(reinterpret_cast<const char *>(Pixels.data()),
+                               Pixels.size() * sizeof(float)));
+
+  llvm::SmallString<128> Path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("write-png", "png", Path));
+  auto RemoveFile = llvm::make_scope_exit([&] { llvm::sys::fs::remove(Path); });
+  ASSERT_FALSE(bool(Image::writePNG(Img, Path)));
+  llvm::Expected<Image> Loaded = Image::loadPNG(Path);
+  ASSERT_TRUE(bool(Loaded));
+  ASSERT_EQ(Loaded->getHeight(), Height);
+  ASSERT_EQ(Loaded->getWidth(), Width);
+  ASSERT_EQ(Loaded->getDepth(), 1u);
+
+  // writePNG stores the rows bottom up.
+  const uint8_t *Data = reinterpret_cast<const uint8_t *>(Loaded->data());
+  for (uint32_t Y = 0; Y < Height; ++Y) {
+    uint32_t Bright = Height - 1 - Y;
+    for (uint32_t X = 0; X < Width; ++X)
+      ASSERT_EQ(Data[(Y * Width + X) * 3], X == Bright ? 255 : 0)
+          << "row " << Y << ", column " << X;
+  }
+}
@@ -0,0 +1,99 @@
+//===- CaptureTests.cpp - Execution Capture Tests ---------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Common/TempDirTest.h"
+#include "Support/Capture.h"
+#include "Support/Pipeline.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [2, 1, 1]
+DescriptorSets:
+  - Resources:
+    - Access: ReadOnly
+      Format: Int32
+      Data: [ 1, 2, 3, 4 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadWrite
+      Format: Float32
+      ZeroInitSize: 16
+      DirectXBinding:
+        Register: 1
+        Space: 0
+...
+)";
+
+using CaptureTests = TempDirTest;
+
+TEST_F(CaptureTests, RoundTrip) {
+  Capture C;
+  C.API = "Vulkan";
+  C.DeviceDescription = "Test Device";
+  C.DriverVersion = "1:2:3";
+  C.Program = std::string("\x03\x02\x23\x07\0\x01", 6);
+  C.Inputs = parsePipeline(PipelineYAML);
+  C.Outputs = C.Inputs.clone();
+  const float Results[] = {0.5f, 1.5f, 2.5f, 3.5f};
+  memcpy(C.Outputs.Sets[0].Resources[1].Data.data(), Results,
+         sizeof(Results));
+  C.Runs.push_back({2.0, 0.25});
+  C.Runs.push_back({1.5, -1.0});
+
+  std::string Path = getPath("run.capture");
+  ASSERT_FALSE(llvm::errorToBool(writeCapture(C, Path)));
+  llvm::Expected<Capture> Read = readCapture(Path);
+  ASSERT_TRUE(!!Read) << llvm::toString(Read.takeError());
+
+  EXPECT_EQ(Read->API, "Vulkan");
+  EXPECT_EQ(Read->DeviceDescription, "Test Device");
+  EXPECT_EQ(Read->DriverVersion, "1:2:3");
+  EXPECT_EQ(Read->Program, C.Program);
+  ASSERT_EQ(Read->Runs.size(), 2u);
+  EXPECT_EQ(Read->Runs[0].HostMilliseconds, 2.0);
+  EXPECT_EQ(Read->Runs[0].GPUMilliseconds, 0.25);
+  EXPECT_FALSE(Read->Runs[1].hasGPUTime());
+
+  EXPECT_EQ(Read->Inputs.DispatchSize[0], 2);
+  const Resource &In = Read->Inputs.Sets[0].Resources[0];
+  EXPECT_EQ(In.Data.getStringRef(),
+            C.Inputs.Sets[0].Resources[0].Data.getStringRef());
+  // The output starts zeroed and holds the results afterwards.
+  const Resource &Zeroed = Read->Inputs.Sets[0].Resources[1];
+  EXPECT_EQ(Zeroed.Size, 16u);
+  EXPECT_EQ(Zeroed.Data.getStringRef(), std::string(16, '\0'));
+  const Resource &Out = Read->Outputs.Sets[0].Resources[1];
+  ASSERT_EQ(Out.Size, sizeof(Results));
+  EXPECT_EQ(memcmp(Out.Data.data(), Results, sizeof(Results)), 0);
+}
+
+TEST_F(CaptureTests, RejectsOtherFiles) {
+  std::string Path = getPath("not.capture");
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC);
+    ASSERT_FALSE(EC);
+    OS << "OTCP this is not a capture";
+  }
+  llvm::Expected<Capture> Read = readCapture(Path);
+  EXPECT_FALSE(!!Read);
+  llvm::consumeError(Read.takeError());
+
+  Read = readCapture(getPath("missing.capture"));
+  EXPECT_FALSE(!!Read);
+  llvm::consumeError(Read.takeError());
+}
@@ -0,0 +1,57 @@
+//===- DeviceLockTests.cpp - Device Scheduling Tests ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/TempDirTest.h"
+#include "Support/DeviceLock.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+using DeviceLockTests = TempDirTest;
+
+TEST(DeviceFileNameTests, Sanitized) {
+  EXPECT_EQ(getDeviceFileName("GPU (Vendor) 1/2"), "GPU__Vendor__1_2");
+  EXPECT_EQ(getDeviceFileName("Microsoft Basic Render Driver"),
+            "Microsoft_Basic_Render_Driver");
+}
+
+TEST_F(DeviceLockTests, SlotPath) {
+  std::string Path = DeviceLock::getSlotPath(Dir, "GPU (Vendor) 1/2", 3);
+  EXPECT_EQ(llvm::sys::path::filename(Path), "GPU__Vendor__1_2.3.lock");
+}
+
+TEST_F(DeviceLockTests, SharedAndExclusive) {
+  llvm::Expected<DeviceLock> Shared =
+      DeviceLock::acquire(Dir, "Device", 4, /*Exclusive=*/false);
+  ASSERT_TRUE(!!Shared) << llvm::toString(Shared.takeError());
+  EXPECT_EQ(Shared->getHeldSlots(), 1u);
+  for (unsigned Slot = 0; Slot < 4; ++Slot)
+    EXPECT_TRUE(
+        llvm::sys::fs::exists(DeviceLock::getSlotPath(Dir, "Device", Slot)));
+  Shared->release();
+  EXPECT_EQ(Shared->getHeldSlots(), 0u);
+
+  llvm::Expected<DeviceLock> Exclusive =
+      DeviceLock::acquire(Dir, "Device", 4, /*Exclusive=*/true);
+  ASSERT_TRUE(!!Exclusive) << llvm::toString(Exclusive.takeError());
+  EXPECT_EQ(Exclusive->getHeldSlots(), 4u);
+  DeviceLock Moved = std::move(*Exclusive);
+  EXPECT_EQ(Moved.getHeldSlots(), 4u);
+  EXPECT_EQ(Exclusive->getHeldSlots(), 0u);
+}
+
+TEST_F(DeviceLockTests, ZeroConcurrency) {
+  llvm::Expected<DeviceLock> Lock =
+      DeviceLock::acquire(Dir, "Device", 0, /*Exclusive=*/false);
+  EXPECT_FALSE(!!Lock);
+  llvm::consumeError(Lock.takeError());
+}
@@ -0,0 +1,121 @@
+//===- OutputSelectionTests.cpp - Output Selection Tests --------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Support/OutputSelection.h"
+#include "Support/Pipeline.h"
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [1, 1, 1]
+DescriptorSets:
+  - Resources:
+    - Access: ReadOnly
+      Format: Int32
+      Data: [ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadWrite
+      Format: Int32
+      Channels: 2
+      Data: [ 0, 1, 2, 3, 4, 5, 6, 7 ]
+      DirectXBinding:
+        Register: 1
+        Space: 0
+      OutputProps:
+        Name: Out
+        Height: 1
+        Width: 1
+        Depth: 4
+  - Resources:
+    - Access: ReadWrite
+      Format: Float32
+      Data: [ 1, 2 ]
+      DirectXBinding:
+        Register: 0
+        Space: 1
+...
+)";
+
+static std::vector<int32_t> values(const Resource &R) {
+  const int32_t *Begin = reinterpret_cast<const int32_t *>(R.Data.data());
+  return std::vector<int32_t>(Begin, Begin + R.Size / sizeof(int32_t));
+}
+
+TEST(OutputSelectionTests, Resources) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  OutputSelection Sel;
+  Sel.Resources = {"Out", "1:0"};
+  llvm::SmallVector<llvm::SmallVector<unsigned>> Indices;
+  llvm::Expected<Pipeline> Out = selectOutput(P, Sel, &Indices);
+  ASSERT_TRUE(!!Out) << llvm::toString(Out.takeError());
+  ASSERT_EQ(Indices.size(), 2u);
+  EXPECT_EQ(Indices[0], llvm::SmallVector<unsigned>{1});
+  EXPECT_EQ(Indices[1], llvm::SmallVector<unsigned>{0});
+  ASSERT_EQ(Out->Sets.size(), 2u);
+  ASSERT_EQ(Out->Sets[0].Resources.size(), 1u);
+  EXPECT_EQ(Out->Sets[0].Resources[0].OutputProps.Name, "Out");
+  ASSERT_EQ(Out->Sets[1].Resources.size(), 1u);
+  EXPECT_EQ(Out->Sets[1].Resources[0].Format, DataFormat::Float32);
+
+  // Unselected elements are borrowed, not copied.
+  EXPECT_TRUE(Out->Sets[0].Resources[0].Data.isBorrowed());
+  EXPECT_EQ(Out->Sets[0].Resources[0].Data.data(),
+            P.Sets[0].Resources[1].Data.data());
+
+  Sel.Resources = {"Missing"};
+  llvm::Expected<Pipeline> Bad = selectOutput(P, Sel);
+  EXPECT_FALSE(!!Bad);
+  llvm::consumeError(Bad.takeError());
+}
+
+TEST(OutputSelectionTests, Elements) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  const Resource &Scalars = P.Sets[0].Resources[0];
+  const Resource &Vectors = P.Sets[0].Resources[1];
+
+  OutputSelection Sel;
+  Sel.First = 3;
+  EXPECT_EQ(values(selectElements(Scalars, Sel)),
+            (std::vector<int32_t>{0, 1, 2}));
+  // Elements of a vector resource include all of their channels.
+  EXPECT_EQ(values(selectElements(Vectors, Sel)),
+            (std::vector<int32_t>{0, 1, 2, 3, 4, 5}));
+
+  Sel.First = 0;
+  Sel.Last = 2;
+  Resource Tail = selectElements(Scalars, Sel);
+  EXPECT_EQ(values(Tail), (std::vector<int32_t>{8, 9}));
+  EXPECT_TRUE(Tail.Data.isBorrowed());
+
+  Sel.Last = 100;
+  EXPECT_EQ(selectElements(Scalars, Sel).Size, Scalars.Size);
+
+  Sel.Last = 0;
+  Sel.Stride = 3;
+  EXPECT_EQ(values(selectElements(Scalars, Sel)),
+            (std::vector<int32_t>{0, 3, 6, 9}));
+  EXPECT_EQ(values(selectElements(Vectors, Sel)),
+            (std::vector<int32_t>{0, 1, 6, 7}));
+
+  Sel.Last = 5;
+  EXPECT_EQ(values(selectElements(Scalars, Sel)),
+            (std::vector<int32_t>{5, 8}));
+
+  Sel.First = 1;
+  llvm::Expected<Pipeline> Bad = selectOutput(P, Sel);
+  EXPECT_FALSE(!!Bad);
+  llvm::consumeError(Bad.takeError());
+}
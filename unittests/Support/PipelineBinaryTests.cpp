@@ -0,0 +1,151 @@
+//===- PipelineBinaryTests.cpp - Binary Pipeline Tests ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Support/Pipeline.h"
+#include "Support/PipelineBinary.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [4, 2, 1]
+Sweep:
+  - DispatchSize: [8, 1, 1]
+    Scale: 2
+  - DispatchSize: [16, 1, 1]
+    Scale: 4
+DescriptorSets:
+  - Resources:
+    - Access: ReadWrite
+      Format: Float32
+      Channels: 4
+      Data: [ 1, 2, 3, 4, 5, 6, 7, 8 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadWrite
+      Format: Int16
+      ZeroInitSize: 4096
+      DirectXBinding:
+        Register: 1
+        Space: 2
+      OutputProps:
+        Name: Out
+        Height: 16
+        Width: 32
+        Depth: 8
+      Expected:
+        Data: [ 1, 2 ]
+        Tolerance:
+          Abs: 0.5
+  - Resources:
+    - Access: ReadOnly
+      Format: Float32
+      DataFile: input.bin
+      DirectXBinding:
+        Register: 1
+        Space: 1
+    - Access: ReadWrite
+      Format: Hex8
+      RawSize: 3
+      Data: [ 0x1, 0x2, 0x3 ]
+      DirectXBinding:
+        Register: 0
+        Space: 1
+...
+)";
+
+static std::unique_ptr<llvm::WritableMemoryBuffer>
+toWritableBuffer(llvm::StringRef Data) {
+  auto Buf = llvm::WritableMemoryBuffer::getNewUninitMemBuffer(Data.size());
+  memcpy(Buf->getBufferStart(), Data.data(), Data.size());
+  return Buf;
+}
+
+TEST(PipelineBinaryTests, RoundTrip) {
+  Pipeline P = parsePipeline(PipelineYAML);
+
+  uint64_t Hash = hashPipelineSource(PipelineYAML);
+  llvm::SmallString<512> Encoded;
+  llvm::raw_svector_ostream OS(Encoded);
+  writePipelineBinary(P, Hash, OS);
+
+  // The zero-filled resource should not be stored.
+  EXPECT_LT(Encoded.size(), 4096u);
+  EXPECT_EQ(getPipelineBinarySourceHash(Encoded), Hash);
+
+  llvm::Expected<Pipeline> Decoded =
+      readPipelineBinary(toWritableBuffer(Encoded));
+  ASSERT_TRUE(!!Decoded) << llvm::toString(Decoded.takeError());
+
+  EXPECT_EQ(Decoded->DispatchSize[0], 4);
+  EXPECT_EQ(Decoded->DispatchSize[1], 2);
+  EXPECT_EQ(Decoded->DispatchSize[2], 1);
+  ASSERT_EQ(Decoded->Sweep.size(), 2u);
+  EXPECT_EQ(Decoded->Sweep[1].DispatchSize[0], 16);
+  EXPECT_EQ(Decoded->Sweep[1].Scale, 4u);
+  ASSERT_EQ(Decoded->Sets.size(), P.Sets.size());
+  for (size_t SetIdx = 0; SetIdx < P.Sets.size(); ++SetIdx) {
+    const auto &Expected = P.Sets[SetIdx].Resources;
+    const auto &Actual = Decoded->Sets[SetIdx].Resources;
+    ASSERT_EQ(Actual.size(), Expected.size());
+    for (size_t I = 0; I < Expected.size(); ++I) {
+      EXPECT_EQ(Actual[I].Format, Expected[I].Format);
+      EXPECT_EQ(Actual[I].Channels, Expected[I].Channels);
+      EXPECT_EQ(Actual[I].RawSize, Expected[I].RawSize);
+      EXPECT_EQ(Actual[I].Access, Expected[I].Access);
+      EXPECT_EQ(Actual[I].DXBinding.Register, Expected[I].DXBinding.Register);
+      EXPECT_EQ(Actual[I].DXBinding.Space, Expected[I].DXBinding.Space);
+      EXPECT_EQ(Actual[I].OutputProps.Name, Expected[I].OutputProps.Name);
+      EXPECT_EQ(Actual[I].OutputProps.Height, Expected[I].OutputProps.Height);
+      EXPECT_EQ(Actual[I].OutputProps.Width, Expected[I].OutputProps.Width);
+      EXPECT_EQ(Actual[I].OutputProps.Depth, Expected[I].OutputProps.Depth);
+      EXPECT_EQ(Actual[I].DataFile, Expected[I].DataFile);
+      ASSERT_EQ(Actual[I].Size, Expected[I].Size);
+      EXPECT_EQ(Actual[I].ZeroInitSize, Expected[I].ZeroInitSize);
+      EXPECT_EQ(Actual[I].Data.getStringRef(), Expected[I].Data.getStringRef());
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(Actual[I].Data.data()) %
+                    ResourceBuffer::DefaultAlignment,
+                0u);
+      EXPECT_EQ(Actual[I].Expected.isSet(), Expected[I].Expected.isSet());
+      EXPECT_EQ(Actual[I].Expected.Tol.Kind, Expected[I].Expected.Tol.Kind);
+      EXPECT_EQ(Actual[I].Expected.Tol.Abs, Expected[I].Expected.Tol.Abs);
+      EXPECT_EQ(Actual[I].Expected.Data.getStringRef(),
+                Expected[I].Expected.Data.getStringRef());
+    }
+  }
+}
+
+TEST(PipelineBinaryTests, RejectsInvalid) {
+  EXPECT_EQ(getPipelineBinarySourceHash("not a pipeline"), 0u);
+
+  llvm::Expected<Pipeline> Bad =
+      readPipelineBinary(toWritableBuffer("OTPB\x01\x00\x00\x00"));
+  EXPECT_FALSE(!!Bad);
+  llvm::consumeError(Bad.takeError());
+
+  Pipeline P = parsePipeline(PipelineYAML);
+  llvm::SmallString<512> Encoded;
+  llvm::raw_svector_ostream OS(Encoded);
+  writePipelineBinary(P, 1, OS);
+
+  // Truncating the data section must be detected.
+  llvm::Expected<Pipeline> Truncated =
+      readPipelineBinary(toWritableBuffer(Encoded.str().drop_back(4)));
+  EXPECT_FALSE(!!Truncated);
+  llvm::consumeError(Truncated.takeError());
+}
@@ -0,0 +1,81 @@
+//===- PipelineTests.cpp - Pipeline Description Tests -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Support/Pipeline.h"
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [1, 1, 1]
+Sweep:
+  - DispatchSize: [4, 1, 1]
+    Scale: 4
+  - DispatchSize: [8, 2, 1]
+DescriptorSets:
+  - Resources:
+    - Access: ReadOnly
+      Format: Int32
+      Data: [ 1, 2, 3, 4 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadWrite
+      Format: Float32
+      ZeroInitSize: 16
+      DirectXBinding:
+        Register: 1
+        Space: 0
+...
+)";
+
+TEST(PipelineTests, Sweep) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  ASSERT_EQ(P.Sweep.size(), 2u);
+  EXPECT_EQ(P.Sweep[0].DispatchSize[0], 4);
+  EXPECT_EQ(P.Sweep[0].Scale, 4u);
+  EXPECT_EQ(P.Sweep[1].DispatchSize[1], 2);
+  EXPECT_EQ(P.Sweep[1].Scale, 1u);
+  EXPECT_EQ(P.Sets[0].Resources[0].ZeroInitSize, 0u);
+  EXPECT_EQ(P.Sets[0].Resources[1].ZeroInitSize, 16u);
+}
+
+TEST(PipelineTests, Clone) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  Pipeline Copy = P.clone();
+  ASSERT_EQ(Copy.Sets.size(), 1u);
+  ASSERT_EQ(Copy.Sweep.size(), 2u);
+  const Resource &In = Copy.Sets[0].Resources[0];
+  const Resource &Out = Copy.Sets[0].Resources[1];
+
+  // Read-only data is shared, read-write data is not.
+  EXPECT_TRUE(In.Data.isBorrowed());
+  EXPECT_EQ(In.Data.data(), P.Sets[0].Resources[0].Data.data());
+  EXPECT_FALSE(Out.Data.isBorrowed());
+  EXPECT_NE(Out.Data.data(), P.Sets[0].Resources[1].Data.data());
+  EXPECT_EQ(Out.Data.getStringRef(),
+            P.Sets[0].Resources[1].Data.getStringRef());
+  EXPECT_EQ(Out.ZeroInitSize, 16u);
+}
+
+TEST(PipelineTests, LayoutHash) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  Pipeline Resized = P.clone();
+  Resized.Sets[0].Resources[1].Size = 64;
+  Resized.Sets[0].Resources[1].Data = ResourceBuffer::allocateZeroed(64);
+  EXPECT_EQ(P.getLayoutHash(), Resized.getLayoutHash());
+
+  Pipeline Rebound = P.clone();
+  Rebound.Sets[0].Resources[1].DXBinding.Register = 2;
+  EXPECT_NE(P.getLayoutHash(), Rebound.getLayoutHash());
+}
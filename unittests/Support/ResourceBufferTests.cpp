@@ -0,0 +1,96 @@
+//===- ResourceBufferTests.cpp - ResourceBuffer Tests -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/ResourceBuffer.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+
+using namespace offloadtest;
+
+static bool isAligned(const char *Ptr, size_t Alignment) {
+  return reinterpret_cast<uintptr_t>(Ptr) % Alignment == 0;
+}
+
+TEST(ResourceBufferTests, Alignment) {
+  for (size_t Size : {0, 1, 3, 64, 1000, 1 << 20}) {
+    ResourceBuffer Buf = ResourceBuffer::allocate(Size);
+    EXPECT_EQ(Buf.size(), Size);
+    EXPECT_TRUE(isAligned(Buf.data(), ResourceBuffer::DefaultAlignment));
+  }
+
+  ResourceBuffer Pages = ResourceBuffer::allocatePages(12345);
+  EXPECT_TRUE(isAligned(Pages.data(), 4096));
+}
+
+TEST(ResourceBufferTests, ZeroedAndCopy) {
+  ResourceBuffer Zero = ResourceBuffer::allocateZeroed(256);
+  for (char C : Zero.getBuffer())
+    EXPECT_EQ(C, 0);
+
+  const char Src[] = "resource";
+  ResourceBuffer Copy = ResourceBuffer::copy(Src);
+  EXPECT_EQ(Copy.getStringRef(), llvm::StringRef(Src, sizeof(Src)));
+  EXPECT_FALSE(Copy.isBorrowed());
+}
+
+TEST(ResourceBufferTests, Wrap) {
+  char Storage[16] = {0};
+  {
+    ResourceBuffer Borrowed = ResourceBuffer::wrap(Storage, sizeof(Storage));
+    EXPECT_TRUE(Borrowed.isBorrowed());
+    EXPECT_EQ(Borrowed.data(), Storage);
+  }
+
+  int Released = 0;
+  {
+    ResourceBuffer Owned = ResourceBuffer::wrap(
+        Storage, sizeof(Storage), [&Released](char *, size_t) { ++Released; });
+    ResourceBuffer Moved = std::move(Owned);
+    EXPECT_FALSE(Owned);
+    EXPECT_EQ(Released, 0);
+  }
+  EXPECT_EQ(Released, 1);
+}
+
+TEST(ResourceBufferTests, PoolReuse) {
+  BufferPool Pool;
+  char *First = nullptr;
+  {
+    ResourceBuffer Buf = Pool.allocate(5000);
+    First = Buf.data();
+    EXPECT_EQ(Buf.size(), 5000u);
+    EXPECT_TRUE(isAligned(Buf.data(), ResourceBuffer::DefaultAlignment));
+  }
+  EXPECT_EQ(Pool.getCachedBytes(), 8192u);
+
+  // Same size class, so the block is reused.
+  ResourceBuffer Again = Pool.allocateZeroed(7000);
+  EXPECT_EQ(Again.data(), First);
+  EXPECT_EQ(Pool.getCachedBytes(), 0u);
+  for (char C : Again.getBuffer())
+    EXPECT_EQ(C, 0);
+
+  Pool.trim();
+  EXPECT_EQ(Pool.getCachedBytes(), 0u);
+}
+
+TEST(ResourceBufferTests, BufferOutlivesPool) {
+  ResourceBuffer Buf;
+  {
+    BufferPool Pool;
+    Buf = Pool.allocate(128);
+  }
+  Buf.data()[0] = 1;
+  Buf.reset();
+  EXPECT_FALSE(Buf);
+}
@@ -0,0 +1,130 @@
+//===- ResourceIOTests.cpp - Resource Data File Tests -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Common/TempDirTest.h"
+#include "Support/Pipeline.h"
+#include "Support/ResourceIO.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [1, 1, 1]
+DescriptorSets:
+  - Resources:
+    - Access: ReadWrite
+      Format: Float32
+      Channels: 2
+      Data: [ 1, 2, 3, 4, 5, 6 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadOnly
+      Format: Float32
+      Channels: 2
+      DataFile: input.npy
+      DirectXBinding:
+        Register: 1
+        Space: 0
+...
+)";
+
+using ResourceIOTests = TempDirTest;
+
+TEST_F(ResourceIOTests, NumPyHeader) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  const Resource &R = P.Sets[0].Resources[0];
+  EXPECT_EQ(getNumPyDType(R), llvm::sys::IsBigEndianHost ? ">f4" : "<f4");
+
+  std::string Header;
+  llvm::raw_string_ostream OS(Header);
+  writeNumPyHeader(R, OS);
+  OS.flush();
+  EXPECT_EQ(Header.size() % ResourceBuffer::DefaultAlignment, 0u);
+  EXPECT_TRUE(llvm::StringRef(Header).starts_with("\x93NUMPY\x01"));
+  EXPECT_NE(Header.find("'shape': (3, 2), }"), std::string::npos);
+  EXPECT_EQ(Header.back(), '\n');
+}
+
+TEST_F(ResourceIOTests, RoundTrip) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  const Resource &R = P.Sets[0].Resources[0];
+  for (ResourceFileFormat Format :
+       {ResourceFileFormat::Raw, ResourceFileFormat::NumPy,
+        ResourceFileFormat::GZip}) {
+    std::string Path =
+        getPath(("out" + getResourceFileExtension(Format)).str());
+    EXPECT_EQ(getResourceFileFormat(Path), Format);
+    ASSERT_FALSE(!!writeResourceFile(R, Path, Format));
+    llvm::Expected<ResourceBuffer> Data = readResourceFile(R, Path);
+    ASSERT_TRUE(!!Data) << llvm::toString(Data.takeError());
+    EXPECT_EQ(Data->getStringRef(), R.Data.getStringRef());
+  }
+
+  // A NumPy file of a different dtype is rejected.
+  Resource Ints = R.cloneDescription();
+  Ints.Format = DataFormat::Int32;
+  llvm::Expected<ResourceBuffer> Bad =
+      readResourceFile(Ints, getPath("out.npy"));
+  EXPECT_FALSE(!!Bad);
+  llvm::consumeError(Bad.takeError());
+}
+
+TEST_F(ResourceIOTests, MalformedNumPy) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  const Resource &R = P.Sets[0].Resources[0];
+  std::string Header;
+  llvm::raw_string_ostream OS(Header);
+  writeNumPyHeader(R, OS);
+  OS.flush();
+  std::string Data = R.Data.getStringRef().str();
+
+  auto Write = [&](llvm::StringRef Name, llvm::StringRef Contents) {
+    std::string Path = getPath(Name);
+    std::error_code EC;
+    llvm::raw_fd_ostream File(Path, EC);
+    EXPECT_FALSE(EC);
+    File << Contents;
+    return Path;
+  };
+  auto ExpectRejected = [&](llvm::StringRef Path) {
+    llvm::Expected<ResourceBuffer> Read = readResourceFile(R, Path);
+    EXPECT_FALSE(!!Read);
+    llvm::consumeError(Read.takeError());
+  };
+
+  // The data of a truncated file isn't a whole number of elements.
+  ExpectRejected(Write("truncated.npy", Header + Data.substr(0, 20)));
+  // The shape says 3 elements of 2 channels, but there are only 2.
+  ExpectRejected(Write("short.npy", Header + Data.substr(0, 16)));
+  // Each element has 2 channels, not 3.
+  std::string Misshapen = Header;
+  size_t Pos = Misshapen.find("(3, 2)");
+  ASSERT_NE(Pos, std::string::npos);
+  Misshapen.replace(Pos, 6, "(2, 3)");
+  ExpectRejected(Write("misshapen.npy", Misshapen + Data));
+}
+
+TEST_F(ResourceIOTests, DataFile) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  const Resource &Source = P.Sets[0].Resources[0];
+  Resource &R = P.Sets[0].Resources[1];
+  EXPECT_EQ(R.DataFile, "input.npy");
+  EXPECT_EQ(R.Size, 0u);
+  ASSERT_FALSE(!!writeResourceFile(Source, getPath("input.npy"),
+                                   ResourceFileFormat::NumPy));
+  llvm::Error Err = loadResourceFiles(P, Dir);
+  ASSERT_FALSE(!!Err) << llvm::toString(std::move(Err));
+  EXPECT_EQ(R.Size, Source.Size);
+  EXPECT_EQ(R.Data.getStringRef(), Source.Data.getStringRef());
+}
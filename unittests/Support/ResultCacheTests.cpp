@@ -0,0 +1,96 @@
+//===- ResultCacheTests.cpp - Execution Result Cache Tests ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Common/ParsePipeline.h"
+#include "Common/TempDirTest.h"
+#include "Support/Pipeline.h"
+#include "Support/PipelineBinary.h"
+#include "Support/ResultCache.h"
+
+
+#include "gtest/gtest.h"
+
+using namespace offloadtest;
+
+static const char *PipelineYAML = R"(---
+DispatchSize: [1, 1, 1]
+DescriptorSets:
+  - Resources:
+    - Access: ReadOnly
+      Format: Int32
+      Data: [ 1, 2, 3, 4 ]
+      DirectXBinding:
+        Register: 0
+        Space: 0
+    - Access: ReadWrite
+      Format: Int32
+      ZeroInitSize: 16
+      DirectXBinding:
+        Register: 1
+        Space: 0
+...
+)";
+
+using ResultCacheTests = TempDirTest;
+
+static ResultKeyInputs makeKey(const Pipeline &P) {
+  ResultKeyInputs K;
+  K.Program = "program";
+  K.PipelineHash = hashPipelineSource(PipelineYAML);
+  K.Inputs = &P;
+  K.API = "Vulkan";
+  K.DeviceDescription = "Device";
+  K.DriverVersion = "1.0";
+  return K;
+}
+
+TEST_F(ResultCacheTests, Key) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  ResultKeyInputs K = makeKey(P);
+  uint64_t Key = getResultKey(K);
+  EXPECT_EQ(getResultKey(K), Key);
+
+  ResultKeyInputs Driver = K;
+  Driver.DriverVersion = "1.1";
+  EXPECT_NE(getResultKey(Driver), Key);
+  ResultKeyInputs Program = K;
+  Program.Program = "program2";
+  EXPECT_NE(getResultKey(Program), Key);
+
+  // Data read from a data file isn't in the source, so it is hashed.
+  P.Sets[0].Resources[0].DataFile = "input.bin";
+  uint64_t FileKey = getResultKey(K);
+  EXPECT_NE(FileKey, Key);
+  P.Sets[0].Resources[0].Data.data()[0] = 5;
+  EXPECT_NE(getResultKey(K), FileKey);
+}
+
+TEST_F(ResultCacheTests, StoreAndApply) {
+  Pipeline P = parsePipeline(PipelineYAML);
+  uint64_t Key = getResultKey(makeKey(P));
+  EXPECT_FALSE(lookupResult(Dir, Key));
+
+  Pipeline Executed = P.clone();
+  Executed.Sets[0].Resources[1].Data.data()[4] = 7;
+  ASSERT_FALSE(!!storeResult(Dir, Key, Executed));
+  EXPECT_FALSE(lookupResult(Dir, Key + 1));
+
+  std::optional<Pipeline> Cached = lookupResult(Dir, Key);
+  ASSERT_TRUE(Cached);
+  ASSERT_TRUE(applyResult(P, *Cached));
+  EXPECT_EQ(P.Sets[0].Resources[1].Data.getStringRef(),
+            Executed.Sets[0].Resources[1].Data.getStringRef());
+
+  // A result for a differently sized resource doesn't apply.
+  Pipeline Other = parsePipeline(PipelineYAML);
+  Other.Sets[0].Resources.pop_back();
+  std::optional<Pipeline> Again = lookupResult(Dir, Key);
+  ASSERT_TRUE(Again);
+  EXPECT_FALSE(hasResultLayout(*Again, Other));
+  EXPECT_FALSE(applyResult(Other, *Again));
+}
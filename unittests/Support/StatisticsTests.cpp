@@ -0,0 +1,103 @@
+//===- StatisticsTests.cpp - Summary Statistics Tests -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Pipeline.h"
+#include "Support/Statistics.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace offloadtest;
+
+template <typename T>
+static Resource makeResource(DataFormat Format, llvm::ArrayRef<T> Values) {
+  Resource R;
+  R.Format = Format;
+  R.Channels = 1;
+  R.RawSize = 0;
+  R.Access = DataAccess::ReadWrite;
+  R.Size = Values.size() * sizeof(T);
+  R.Data = ResourceBuffer::copy(llvm::ArrayRef<char>(
+      reinterpret_cast<const char *>(Values.data()), R.Size));
+  return R;
+}
+
+TEST(StatisticsTests, Floats) {
+  const float Inf = std::numeric_limits<float>::infinity();
+  const float NaN = std::numeric_limits<float>::quiet_NaN();
+  const float Values[] = {0.0f, -0.0f, 1.0f, 3.0f, 4.0f, NaN, -NaN, Inf, 4.0f};
+  ResourceStatistics S = computeStatistics(
+      makeResource(DataFormat::Float32, llvm::ArrayRef<float>(Values)), 4);
+  EXPECT_EQ(S.Count, 9u);
+  EXPECT_EQ(S.NaNCount, 2u);
+  EXPECT_EQ(S.InfCount, 1u);
+  EXPECT_EQ(S.Min, 0.0);
+  EXPECT_EQ(S.Max, 4.0);
+  EXPECT_EQ(S.Sum, 12.0);
+  EXPECT_EQ(S.Mean, 2.0);
+  // 0, 1, 3, 4, NaN and Inf.
+  EXPECT_EQ(S.DistinctCount, 6u);
+  ASSERT_EQ(S.Histogram.size(), 4u);
+  EXPECT_EQ(S.Histogram[0], 2u);
+  EXPECT_EQ(S.Histogram[1], 1u);
+  EXPECT_EQ(S.Histogram[2], 0u);
+  EXPECT_EQ(S.Histogram[3], 3u);
+}
+
+TEST(StatisticsTests, ManyChunks) {
+  // Large enough to be split across several parallel chunks.
+  std::vector<int32_t> Values(300000);
+  for (size_t I = 0; I < Values.size(); ++I)
+    Values[I] = static_cast<int32_t>(I % 1000) - 500;
+  ResourceStatistics S = computeStatistics(
+      makeResource(DataFormat::Int32, llvm::ArrayRef<int32_t>(Values)), 10);
+  EXPECT_EQ(S.Count, Values.size());
+  EXPECT_EQ(S.Min, -500.0);
+  EXPECT_EQ(S.Max, 499.0);
+  EXPECT_EQ(S.Sum, -150000.0);
+  EXPECT_EQ(S.NaNCount, 0u);
+  EXPECT_EQ(S.DistinctCount, 1000u);
+  uint64_t Total = 0;
+  for (uint64_t Bin : S.Histogram) {
+    EXPECT_EQ(Bin, Values.size() / 10);
+    Total += Bin;
+  }
+  EXPECT_EQ(Total, Values.size());
+}
+
+TEST(StatisticsTests, YAML) {
+  Pipeline P;
+  P.Sets.emplace_back().Resources.push_back(makeResource(
+      DataFormat::UInt32, llvm::ArrayRef<uint32_t>({2u, 2u, 8u})));
+  P.Sets[0].Resources[0].OutputProps.Name = "Out";
+  std::vector<ResourceSummary> Summaries = summarizePipeline(P, 2);
+
+  std::string Str;
+  llvm::raw_string_ostream OS(Str);
+  llvm::yaml::Output YOut(OS);
+  YOut << Summaries;
+  OS.flush();
+  EXPECT_NE(Str.find("Name:            Out"), std::string::npos);
+  EXPECT_NE(Str.find("Format:          UInt32"), std::string::npos);
+  EXPECT_NE(Str.find("Mean:            4"), std::string::npos);
+  EXPECT_NE(Str.find("Distinct:        2"), std::string::npos);
+  EXPECT_NE(Str.find("Histogram:       [ 2, 1 ]"), std::string::npos);
+}
+
+TEST(StatisticsTests, Median) {
+  EXPECT_EQ(getMedian({3.0}), 3.0);
+  EXPECT_EQ(getMedian({5.0, 1.0, 3.0}), 3.0);
+  EXPECT_EQ(getMedian({4.0, 1.0, 2.0, 8.0}), 3.0);
+}
@@ -0,0 +1,157 @@
+//===- VerificationTests.cpp - Expected Data Verification Tests -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//
+//===----------------------------------------------------------------------===//
+
+#include "Support/Pipeline.h"
+#include "Support/Verification.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace offloadtest;
+
+template <typename T>
+static llvm::ArrayRef<char> bytes(const std::vector<T> &V) {
+  return llvm::ArrayRef<char>(reinterpret_cast<const char *>(V.data()),
+                              V.size() * sizeof(T));
+}
+
+static Tolerance makeULP(uint64_t N) {
+  Tolerance T;
+  T.Kind = ToleranceKind::ULP;
+  T.ULP = N;
+  return T;
+}
+
+static Tolerance makeAbs(double X) {
+  Tolerance T;
+  T.Kind = ToleranceKind::Abs;
+  T.Abs = X;
+  return T;
+}
+
+TEST(VerificationTests, FloatULP) {
+  std::vector<float> Expected(3000, 1.0f);
+  std::vector<float> Actual = Expected;
+  Actual[5] = std::nextafter(1.0f, 2.0f);
+  Actual[2500] = std::nextafter(std::nextafter(1.0f, 0.0f), 0.0f);
+
+  MismatchSummary S = compareData(DataFormat::Float32, bytes(Actual),
+                                  bytes(Expected), makeULP(2));
+  EXPECT_TRUE(S.passed());
+  EXPECT_EQ(S.ValueCount, 3000u);
+  EXPECT_EQ(S.MaxError, 2.0);
+  EXPECT_EQ(S.MaxErrorIndex, 2500u);
+
+  S = compareData(DataFormat::Float32, bytes(Actual), bytes(Expected),
+                  makeULP(1));
+  EXPECT_FALSE(S.passed());
+  EXPECT_EQ(S.MismatchCount, 1u);
+  ASSERT_EQ(S.FirstMismatches.size(), 1u);
+  EXPECT_EQ(S.FirstMismatches[0], 2500u);
+
+  // Signed zeros are adjacent, and NaNs only match NaNs.
+  std::vector<double> E = {0.0, std::numeric_limits<double>::quiet_NaN(), 1.0};
+  std::vector<double> A = {-0.0, std::numeric_limits<double>::quiet_NaN(),
+                           std::numeric_limits<double>::quiet_NaN()};
+  S = compareData(DataFormat::Float64, bytes(A), bytes(E), Tolerance());
+  EXPECT_EQ(S.MismatchCount, 1u);
+  EXPECT_EQ(S.FirstMismatches[0], 2u);
+  EXPECT_TRUE(std::isinf(S.MaxError));
+}
+
+TEST(VerificationTests, AbsAndIntegers) {
+  std::vector<float> Expected = {1.0f, 2.0f, 3.0f};
+  std::vector<float> Actual = {1.05f, 2.0f, 2.5f};
+  MismatchSummary S = compareData(DataFormat::Float32, bytes(Actual),
+                                  bytes(Expected), makeAbs(0.1));
+  EXPECT_EQ(S.MismatchCount, 1u);
+  EXPECT_EQ(S.MaxErrorIndex, 2u);
+  EXPECT_NEAR(S.MaxError, 0.5, 1e-6);
+
+  std::vector<int64_t> IE(5000, -7);
+  std::vector<int64_t> IA = IE;
+  for (size_t I = 100; I < 120; ++I)
+    IA[I] = INT64_MAX;
+  S = compareData(DataFormat::Int64, bytes(IA), bytes(IE), Tolerance(), 4);
+  EXPECT_EQ(S.MismatchCount, 20u);
+  ASSERT_EQ(S.FirstMismatches.size(), 4u);
+  EXPECT_EQ(S.FirstMismatches[0], 100u);
+  EXPECT_EQ(S.FirstMismatches[3], 103u);
+
+  std::vector<uint16_t> Short = {1, 2};
+  std::vector<uint16_t> Long = {1, 2, 3};
+  S = compareData(DataFormat::UInt16, bytes(Short), bytes(Long), Tolerance());
+  EXPECT_TRUE(S.SizeMismatch);
+  EXPECT_FALSE(S.passed());
+}
+
+TEST(VerificationTests, PrintSummary) {
+  std::vector<float> Actual = {1.0f, 3.0f, 3.0f, 4.5f};
+  std::vector<float> Expected = {1.0f, 2.0f, 3.0f, 4.0f};
+  MismatchSummary S = compareData(DataFormat::Float32, bytes(Actual),
+                                  bytes(Expected), makeAbs(0.001), 8);
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  printMismatchSummary(OS, S, makeAbs(0.001));
+  EXPECT_EQ(OS.str(), "  2 of 4 values differ (tolerance: abs 0.001)\n"
+                      "  max error 1 at index 1\n"
+                      "  first mismatches: 1 3\n");
+}
+
+TEST(VerificationTests, ParseExpected) {
+  const char *YAML = R"(---
+Access: ReadWrite
+Format: Float32
+ZeroInitSize: 8
+DirectXBinding:
+  Register: 0
+  Space: 0
+Expected:
+  Data: [ 1.5, 2.5 ]
+  Tolerance:
+    ULP: 4
+...
+)";
+  Resource R;
+  llvm::yaml::Input YIn(YAML);
+  YIn >> R;
+  ASSERT_FALSE(YIn.error());
+  ASSERT_TRUE(R.Expected.isSet());
+  EXPECT_EQ(R.Expected.Size, 8u);
+  EXPECT_EQ(R.Expected.Tol.Kind, ToleranceKind::ULP);
+  EXPECT_EQ(R.Expected.Tol.ULP, 4u);
+
+  MismatchSummary S = verifyResource(R);
+  EXPECT_EQ(S.MismatchCount, 2u);
+
+  const char *BadYAML = R"(---
+Access: ReadWrite
+Format: Float32
+ZeroInitSize: 8
+DirectXBinding:
+  Register: 0
+  Space: 0
+Expected:
+  File: expected.bin
+  Tolerance: { ULP: 1, Abs: 0.5 }
+...
+)";
+  Resource Bad;
+  llvm::yaml::Input BadIn(BadYAML, nullptr,
+                          [](const llvm::SMDiagnostic &, void *) {});
+  BadIn >> Bad;
+  EXPECT_TRUE(!!BadIn.error());
+}